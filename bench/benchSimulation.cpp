@@ -0,0 +1,450 @@
+/* Throughput benchmarks for the simulation engine and the pure C++ parts of
+ * the ABC drivers, run on synthetic models outside of R.
+ *
+ * Usage: ./benchSimulation [key=value ...]
+ *
+ *   locations=100   number of locations (L)
+ *   tpt=100         number of time points (T)
+ *   dm=1            number of distance matrices
+ *   tdm=0           number of lagged (temporal) distance matrices
+ *   density=0.05    fraction of non-zero distance matrix entries
+ *   mode=exponential  transition mode: exponential, path_specific, weibull
+ *   data=0          data model: 0 (identity), 1 (overdispersed), 2 (binomial)
+ *   m=1             replicates per particle
+ *   particles=1000  particles per batch
+ *   batches=5       timed batches per thread count
+ *   threads=1,2,4   comma separated thread counts
+ *   capture=0       1 to also time sim_result_atom compartment capture
+ *   kernel=1        1 to also time importance weights and ancestor draws
+ *   seed=123        random seed
+ *   population=10000  susceptibles per location
+ *   approx=0        binomial variance from which transitions use the normal
+ *                   approximation, 0 for exact draws
+ *   precision=double  distance matrix precision: double or single
+ *   affinity=none   worker placement: none, compact or scatter
+ *   storage=auto    distance matrix storage: auto, dense or sparse
+ *   check=0         1 to compare simulateParticle, the simulation of the
+ *                   CUDA backend, run on the host against NodePool for
+ *                   each particle instead of timing. Exits with status 1
+ *                   if any distance differs.
+ */
+#include <SEIRSimNodes.hpp>
+#include <particleKernelDensity.hpp>
+#include <aliasTable.hpp>
+#include <compartmentStore.hpp>
+#include <philox.hpp>
+#include <batchSimulation.hpp>
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock benchClock;
+
+struct benchConfig
+{
+    int locations;
+    int tpt;
+    int dm;
+    int tdm;
+    double density;
+    std::string mode;
+    int data;
+    int m;
+    int particles;
+    int batches;
+    std::vector<int> threads;
+    bool capture;
+    bool kernel;
+    int seed;
+    int population;
+    double approx;
+    int precision;
+    int affinity;
+    int storage;
+    bool check;
+};
+
+static benchConfig parseArgs(int argc, char** argv)
+{
+    std::map<std::string, std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        const size_t eq = arg.find('=');
+        if (eq == std::string::npos)
+        {
+            std::fprintf(stderr, "Ignoring argument without '=': %s\n",
+                         argv[i]);
+            continue;
+        }
+        args[arg.substr(0, eq)] = arg.substr(eq + 1);
+    }
+    auto get = [&args](const std::string& key, const std::string& dflt){
+        return(args.count(key) ? args[key] : dflt);};
+
+    benchConfig cfg;
+    cfg.locations = std::atoi(get("locations", "100").c_str());
+    cfg.tpt = std::atoi(get("tpt", "100").c_str());
+    cfg.dm = std::atoi(get("dm", "1").c_str());
+    cfg.tdm = std::atoi(get("tdm", "0").c_str());
+    cfg.density = std::atof(get("density", "0.05").c_str());
+    cfg.mode = get("mode", "exponential");
+    cfg.data = std::atoi(get("data", "0").c_str());
+    cfg.m = std::atoi(get("m", "1").c_str());
+    cfg.particles = std::atoi(get("particles", "1000").c_str());
+    cfg.batches = std::atoi(get("batches", "5").c_str());
+    cfg.capture = std::atoi(get("capture", "0").c_str()) != 0;
+    cfg.kernel = std::atoi(get("kernel", "1").c_str()) != 0;
+    cfg.seed = std::atoi(get("seed", "123").c_str());
+    cfg.population = std::atoi(get("population", "10000").c_str());
+    cfg.approx = std::atof(get("approx", "0").c_str());
+    cfg.precision = (get("precision", "double") == "single" ?
+                     DM_PRECISION_SINGLE : DM_PRECISION_DOUBLE);
+    const std::string affinity = get("affinity", "none");
+    cfg.affinity = (affinity == "compact" ? AFFINITY_COMPACT :
+                    (affinity == "scatter" ? AFFINITY_SCATTER :
+                     AFFINITY_NONE));
+    const std::string storage = get("storage", "auto");
+    cfg.storage = (storage == "dense" ? DM_STORAGE_DENSE :
+                   (storage == "sparse" ? DM_STORAGE_SPARSE :
+                    DM_STORAGE_AUTO));
+    cfg.check = std::atoi(get("check", "0").c_str()) != 0;
+    std::stringstream threadList(get("threads", "1,2,4"));
+    std::string item;
+    while (std::getline(threadList, item, ','))
+    {
+        cfg.threads.push_back(std::atoi(item.c_str()));
+    }
+    return(cfg);
+}
+
+/** Symmetric random matrix with roughly the requested density and rows
+ * scaled to sum to one*/
+static Eigen::MatrixXd randomDistance(int L, double density, std::mt19937& rng)
+{
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
+    Eigen::MatrixXd D = Eigen::MatrixXd::Zero(L, L);
+    for (int i = 0; i < L; i++)
+    {
+        // Keep every location connected to its neighbour
+        D(i, (i + 1) % L) = D((i + 1) % L, i) = 1.0;
+        for (int j = i + 1; j < L; j++)
+        {
+            if (unif(rng) < density)
+            {
+                D(i, j) = D(j, i) = unif(rng);
+            }
+        }
+    }
+    for (int i = 0; i < L; i++)
+    {
+        D.row(i) /= D.row(i).sum();
+    }
+    return(D);
+}
+
+static std::shared_ptr<const simulationContext> buildContext(
+        const benchConfig& cfg)
+{
+    const int L = cfg.locations;
+    const int T = cfg.tpt;
+    std::mt19937 rng(cfg.seed);
+    std::shared_ptr<simulationContext> ctx(new simulationContext());
+    ctx -> random_seed = cfg.seed;
+    ctx -> S0 = Eigen::VectorXi::Constant(L, cfg.population);
+    ctx -> E0 = Eigen::VectorXi::Zero(L);
+    ctx -> I0 = Eigen::VectorXi::Constant(L, 10);
+    ctx -> R0 = Eigen::VectorXi::Zero(L);
+    ctx -> offset = Eigen::VectorXd::Ones(T);
+    ctx -> Y = Eigen::MatrixXi::Constant(T, L, 20);
+    ctx -> na_mask = MatrixXb::Constant(T, L, false);
+    ctx -> dataModelType = cfg.data;
+    for (int i = 0; i < cfg.dm; i++)
+    {
+        ctx -> DM_vec.push_back(distanceMatrix(
+                    randomDistance(L, cfg.density, rng), cfg.storage,
+                    cfg.precision));
+    }
+    ctx -> TDM_vec = std::vector<std::vector<distanceMatrix> >(T);
+    ctx -> TDM_empty = std::vector<int>(T, cfg.tdm > 0 ? 0 : 1);
+    for (int t = 0; t < T; t++)
+    {
+        for (int lag = 0; lag < cfg.tdm; lag++)
+        {
+            ctx -> TDM_vec[t].push_back(distanceMatrix(
+                    randomDistance(L, cfg.density, rng), cfg.storage,
+                    cfg.precision));
+        }
+    }
+    ctx -> X = Eigen::MatrixXd::Ones(T*L, 1);
+    ctx -> X_rs = Eigen::MatrixXd::Ones(T, 1);
+    ctx -> transitionMode = cfg.mode;
+    // Path specific priors hold one row per bin, with the bin transition
+    // probability in column 5. Weibull priors hold the bin count in (4, 0).
+    ctx -> E_to_I_prior = Eigen::MatrixXd::Constant(10, 6, 0.3);
+    ctx -> I_to_R_prior = Eigen::MatrixXd::Constant(10, 6, 0.3);
+    ctx -> E_to_I_prior(4, 0) = 10;
+    ctx -> I_to_R_prior(4, 0) = 10;
+    ctx -> inf_mean = 1;
+    ctx -> spatial_prior = Eigen::VectorXd::Ones(2);
+    ctx -> exposure_precision = Eigen::VectorXd::Ones(1);
+    ctx -> reinfection_precision = Eigen::VectorXd::Constant(1, -1);
+    ctx -> exposure_mean = Eigen::VectorXd::Zero(1);
+    ctx -> reinfection_mean = Eigen::VectorXd::Zero(1);
+    ctx -> phi = (cfg.data == 1 ? 2.0 : 0.0);
+    ctx -> data_compartment = 0;
+    ctx -> cumulative = false;
+    ctx -> m = cfg.m;
+    ctx -> lpow = 1;
+    ctx -> binomial_approx_threshold = cfg.approx;
+    return(ctx);
+}
+
+/** Parameters in the order read by SEIR_sim_node::simulate, jittered so
+ * that particles differ*/
+static Eigen::MatrixXd buildParams(const benchConfig& cfg)
+{
+    const int L = cfg.locations;
+    const int nRho = (L > 1 ? cfg.dm + cfg.tdm : 0);
+    const int nTrans = (cfg.mode == "exponential" ? 2 :
+                       (cfg.mode == "weibull" ? 4 : 0));
+    const int nReport = (cfg.data == 2 ? 1 : 0);
+    Eigen::MatrixXd params(cfg.particles, 1 + nRho + nTrans + nReport + 4*L);
+    std::mt19937 rng(cfg.seed + 1);
+    std::uniform_real_distribution<double> jitter(-0.05, 0.05);
+    for (int r = 0; r < cfg.particles; r++)
+    {
+        int c = 0;
+        params(r, c++) = -0.8 + jitter(rng);
+        for (int i = 0; i < nRho; i++)
+        {
+            params(r, c++) = 0.1 + jitter(rng);
+        }
+        if (cfg.mode == "exponential")
+        {
+            params(r, c++) = 0.3 + jitter(rng);
+            params(r, c++) = 0.2 + jitter(rng);
+        }
+        else if (cfg.mode == "weibull")
+        {
+            params(r, c++) = 1.5;
+            params(r, c++) = 2.0 + jitter(rng);
+            params(r, c++) = 1.5;
+            params(r, c++) = 2.0 + jitter(rng);
+        }
+        if (nReport > 0)
+        {
+            params(r, c++) = 0.7;
+        }
+        for (int l = 0; l < L; l++)
+        {
+            params(r, c + l) = 10000;
+            params(r, c + L + l) = 0;
+            params(r, c + 2*L + l) = 10;
+            params(r, c + 3*L + l) = 0;
+        }
+    }
+    return(params);
+}
+
+static double secondsSince(benchClock::time_point start)
+{
+    return(std::chrono::duration<double>(benchClock::now() - start).count());
+}
+
+static long peakRSSKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return(usage.ru_maxrss);
+}
+
+static void benchSimulate(const benchConfig& cfg,
+                          std::shared_ptr<const simulationContext> ctx,
+                          const Eigen::MatrixXd& params,
+                          simulationAction action)
+{
+    const double locationSteps = ((double) cfg.particles)*cfg.batches*
+        cfg.m*cfg.tpt*cfg.locations;
+    Eigen::MatrixXd results(cfg.particles, cfg.m);
+    compartmentStore store;
+    if (action == sim_result_atom)
+    {
+        store.allocate(cfg.tpt, cfg.locations, cfg.particles);
+    }
+    std::printf("%s\n", (action == sim_atom ? "simulate" :
+                         "simulate with compartment capture"));
+    std::printf("  %8s %12s %14s %11s\n", "threads", "sims/sec",
+                "ns/loc-step", "efficiency");
+    double baseRate = 0.0;
+    int baseThreads = 0;
+    for (int threads : cfg.threads)
+    {
+        NodePool pool(&results, &store, threads, ctx, 0,
+                      placeWorkers(cfg.affinity, std::vector<int>(), 
+                                   threads));
+        // Warm up node storage before timing
+        pool.enqueue(action, &params, std::numeric_limits<double>::infinity());
+        pool.awaitFinished();
+        benchClock::time_point start = benchClock::now();
+        for (int b = 0; b < cfg.batches; b++)
+        {
+            pool.enqueue(action, &params,
+                         std::numeric_limits<double>::infinity());
+            pool.awaitFinished();
+        }
+        const double elapsed = secondsSince(start);
+        const double rate = cfg.particles*cfg.batches/elapsed;
+        if (baseThreads == 0)
+        {
+            baseRate = rate;
+            baseThreads = threads;
+        }
+        std::printf("  %8d %12.1f %14.2f %11.3f\n", threads, rate,
+                    elapsed*1e9/locationSteps,
+                    (rate/baseRate)/(((double) threads)/baseThreads));
+    }
+}
+
+static void benchDrivers(const benchConfig& cfg,
+                         std::shared_ptr<const simulationContext> ctx,
+                         const Eigen::MatrixXd& params)
+{
+    const int N = cfg.particles;
+    Eigen::MatrixXd results(N, cfg.m);
+    compartmentStore store;
+    // Perturb the fitted parameters only; the initial values are fixed
+    const int nFree = params.cols() - 4*cfg.locations;
+    Eigen::VectorXi fixed = Eigen::VectorXi::Zero(params.cols());
+    fixed.tail(4*cfg.locations).setOnes();
+    Eigen::VectorXd tau = Eigen::VectorXd::Constant(params.cols(), 0.02);
+    Eigen::VectorXd weights = Eigen::VectorXd::Constant(N, 1.0/N);
+    Eigen::VectorXd density(N);
+
+    std::printf("importance weights (%d particles, %d free dimensions)\n",
+                N, nFree);
+    std::printf("  %8s %12s %12s\n", "threads", "exact ms", "truncated ms");
+    for (int threads : cfg.threads)
+    {
+        NodePool pool(&results, &store, threads, ctx, 0);
+        double ms[2];
+        for (int k = 0; k < 2; k++)
+        {
+            const particleKernelDensity kde(params, weights, tau, fixed,
+                                            (k == 0 ? 0.0 : 6.0));
+            std::function<void(int, int)> evaluate =
+                [&kde, &params, &density](int start, int end){
+                    kde.evaluate(params, start, end, density);};
+            benchClock::time_point start = benchClock::now();
+            pool.parallelFor(N, evaluate);
+            ms[k] = secondsSince(start)*1e3;
+        }
+        std::printf("  %8d %12.2f %12.2f\n", threads, ms[0], ms[1]);
+    }
+
+    const aliasTable ancestors(weights);
+    philox4x32 generator;
+    generator.seed(cfg.seed, 0, 0, 0);
+    const int nDraws = 10000000;
+    long checksum = 0;
+    benchClock::time_point start = benchClock::now();
+    for (int i = 0; i < nDraws; i++)
+    {
+        checksum += ancestors(generator);
+    }
+    std::printf("ancestor draws: %.2f ns/draw (checksum %ld)\n",
+                secondsSince(start)*1e9/nDraws, checksum);
+}
+
+/** Simulate every particle with simulateParticle on this thread and with a
+ * NodePool, on the same random streams, and report how many particles
+ * have identical distances. Returns whether all of them do.*/
+static bool checkBatchSimulation(const benchConfig& cfg,
+                                 std::shared_ptr<const simulationContext> ctx,
+                                 const Eigen::MatrixXd& params)
+{
+    if (!batchModelData::supports(*ctx))
+    {
+        std::printf("batch check: model not covered by simulateParticle\n");
+        return(true);
+    }
+    const int N = cfg.particles;
+    const double threshold = std::numeric_limits<double>::infinity();
+    Eigen::MatrixXd expected(N, cfg.m);
+    compartmentStore store;
+    NodePool pool(&expected, &store, cfg.threads[0], ctx, 0);
+    const unsigned int batch_id = pool.batchCount();
+    pool.enqueue(sim_atom, &params, threshold);
+    pool.awaitFinished();
+
+    const batchModelData data(*ctx);
+    std::vector<int> ints(batchIntWorkspace(data.model));
+    std::vector<double> doubles(batchDoubleWorkspace(data.model));
+    std::vector<binomialSampler> samplers(batchSamplerWorkspace(data.model));
+    std::vector<philox4x32> generators(cfg.m);
+    batchWorkspace ws;
+    ws.ints = ints.data();
+    ws.doubles = doubles.data();
+    ws.samplers = samplers.data();
+    ws.generators = generators.data();
+    Eigen::MatrixXd actual(N, cfg.m);
+    Eigen::VectorXd row(params.cols());
+    int identical = 0;
+    double maxRelDiff = 0.0;
+    for (int i = 0; i < N; i++)
+    {
+        row = params.row(i).transpose();
+        simulateParticle(data.model, row.data(), threshold, batch_id, i, ws,
+                         actual.data() + i, N);
+        bool same = true;
+        for (int w = 0; w < cfg.m; w++)
+        {
+            same = same && (actual(i, w) == expected(i, w));
+            maxRelDiff = std::max(maxRelDiff,
+                                  std::abs(actual(i, w) - expected(i, w))/
+                                  std::max(1.0, std::abs(expected(i, w))));
+        }
+        identical += same;
+    }
+    std::printf("batch check: %d/%d particles identical, largest relative "
+                "difference %g\n", identical, N, maxRelDiff);
+    return(identical == N);
+}
+
+int main(int argc, char** argv)
+{
+    const benchConfig cfg = parseArgs(argc, argv);
+    std::printf("L=%d T=%d dm=%d tdm=%d density=%g mode=%s data=%d m=%d "
+                "particles=%d batches=%d precision=%s affinity=%d\n",
+                cfg.locations, cfg.tpt, cfg.dm, cfg.tdm, cfg.density,
+                cfg.mode.c_str(), cfg.data, cfg.m, cfg.particles, cfg.batches,
+                (cfg.precision == DM_PRECISION_SINGLE ? "single" : "double"),
+                cfg.affinity);
+    std::shared_ptr<const simulationContext> ctx = buildContext(cfg);
+    const Eigen::MatrixXd params = buildParams(cfg);
+
+    if (cfg.check)
+    {
+        return(checkBatchSimulation(cfg, ctx, params) ? 0 : 1);
+    }
+    benchSimulate(cfg, ctx, params, sim_atom);
+    if (cfg.capture)
+    {
+        benchSimulate(cfg, ctx, params, sim_result_atom);
+    }
+    if (cfg.kernel)
+    {
+        benchDrivers(cfg, ctx, params);
+    }
+    std::printf("peak RSS: %.1f MB\n", peakRSSKb()/1024.0);
+    return(0);
+}
@@ -0,0 +1,17 @@
+/* Worker process for spreading the simulations of ABSEIR over MPI ranks.
+ * The package must be built with ABSEIR_USE_MPI (see src/Makevars). R
+ * runs on rank 0 and this program on every other rank, for example
+ *
+ *   mpirun -n 1 Rscript fit.R : -n 4 ./abseirWorker
+ *
+ * Each SpatialSEIRModel sends its data to the workers once, when it is
+ * created; the number of threads per worker is taken from samplingControl's
+ * n_cores. Workers exit when the R process does.
+ */
+
+#include <mpiBackend.hpp>
+
+int main()
+{
+    return(mpiServe());
+}
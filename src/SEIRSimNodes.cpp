@@ -1,12 +1,11 @@
 #include <iostream>
 #include <sstream>
 #include <random>
+#include <limits>
 #include <math.h>
-#include <Rmath.h>
-#include <Rcpp.h>
 #include <util.hpp>
 #include "SEIRSimNodes.hpp"
-#include "spatialSEIRModel.hpp" 
+#include <transitionDistribution.hpp>
 #include <chrono>
 #include <thread>
 using namespace std;
@@ -15,90 +14,90 @@ using namespace std;
 
 void printDMatrix(Eigen::MatrixXd inMat, std::string name)
 {
-    Rcpp::Rcout << "Matrix (" << inMat.rows() << ", " << inMat.cols() << "): " << name << "\n";
-    Rcpp::Rcout << "[";
+    coreLog() << "Matrix (" << inMat.rows() << ", " << inMat.cols() << "): " << name << "\n";
+    coreLog() << "[";
     int i,j;
     for (i = 0; i < inMat.rows(); i++)
     {
-        Rcpp::Rcout << "[";
+        coreLog() << "[";
         for (j = 0; j < inMat.cols(); j++)
         {
-            Rcpp::Rcout << inMat(i,j);
+            coreLog() << inMat(i,j);
             if (j + 1 != inMat.cols())
             {
-                Rcpp::Rcout << ", ";
+                coreLog() << ", ";
             }
             else
             {
-                Rcpp::Rcout << "]";
+                coreLog() << "]";
             }
         }
         if (i + 1 != inMat.rows())
         {
-            Rcpp::Rcout << "\n";
+            coreLog() << "\n";
         }
-        else Rcpp::Rcout << "]\n";
+        else coreLog() << "]\n";
     } 
 }
 
 void printDVector(Eigen::VectorXd inVec, std::string name)
 {
-    Rcpp::Rcout << "Vector (" << inVec.size() << "): " << name << "\n";
+    coreLog() << "Vector (" << inVec.size() << "): " << name << "\n";
     int i;
-    Rcpp::Rcout << "[";
+    coreLog() << "[";
     for (i = 0; i < inVec.size(); i++)
     {
-        Rcpp::Rcout << inVec(i);
+        coreLog() << inVec(i);
         if (i + 1 != inVec.size())
         {
-            Rcpp::Rcout << ", ";
+            coreLog() << ", ";
         }
-        else Rcpp::Rcout << "]\n";
+        else coreLog() << "]\n";
     }
 
 }
 
 void printIMatrix(Eigen::MatrixXi inMat, std::string name)
 {
-    Rcpp::Rcout << "Matrix (" << inMat.rows() << ", " << inMat.cols() << "): " << name << "\n";
-    Rcpp::Rcout << "[";
+    coreLog() << "Matrix (" << inMat.rows() << ", " << inMat.cols() << "): " << name << "\n";
+    coreLog() << "[";
     int i,j;
     for (i = 0; i < inMat.rows(); i++)
     {
-        Rcpp::Rcout << "[";
+        coreLog() << "[";
         for (j = 0; j < inMat.cols(); j++)
         {
-            Rcpp::Rcout << inMat(i,j);
+            coreLog() << inMat(i,j);
             if (j + 1 != inMat.cols())
             {
-                Rcpp::Rcout << ", ";
+                coreLog() << ", ";
             }
             else
             {
-                Rcpp::Rcout << "]";
+                coreLog() << "]";
             }
         }
         if (i + 1 != inMat.rows())
         {
-            Rcpp::Rcout << "\n";
+            coreLog() << "\n";
         }
-        else Rcpp::Rcout << "]\n";
+        else coreLog() << "]\n";
     } 
 }
 
 void printIVector(Eigen::VectorXi inVec, std::string name)
 {
-    Rcpp::Rcout << "Vector (" << inVec.size() << "): " << name << "\n";
+    coreLog() << "Vector (" << inVec.size() << "): " << name << "\n";
     int i;
-    Rcpp::Rcout << "[";
+    coreLog() << "[";
     for (i = 0; i < inVec.size(); i++)
     {
-        Rcpp::Rcout << inVec(i);
+        coreLog() << inVec(i);
         if (i + 1 != inVec.size())
         {
-            Rcpp::Rcout << ", ";
+            coreLog() << ", ";
         }
-        else Rcpp::Rcout << "]\n";
+        else coreLog() << "]\n";
     }
 
 }
@@ -125,221 +124,518 @@ void printIVector(Eigen::VectorXi inVec, std::string name)
 
 
 NodeWorker::NodeWorker(NodePool* pl,
-                       int sd,
-                       Eigen::VectorXi s,
-                       Eigen::VectorXi e,
-                       Eigen::VectorXi i,
-                       Eigen::VectorXi r,
-                       Eigen::VectorXd offs,
-                       Eigen::MatrixXi y,
-                       MatrixXb nm,
-                       int dmt,
-                       std::vector<Eigen::MatrixXd> dmv,
-                       std::vector<std::vector<Eigen::MatrixXd> > tdmv,
-                       std::vector<int> tdme,
-                       Eigen::MatrixXd x,
-                       Eigen::MatrixXd x_rs,
-                       std::string mode,
-                       Eigen::MatrixXd ei_prior,
-                       Eigen::MatrixXd ir_prior,
-                       double avgI,
-                       Eigen::VectorXd sp_prior,
-                       Eigen::VectorXd se_prec,
-                       Eigen::VectorXd rs_prec,
-                       Eigen::VectorXd se_mean,
-                       Eigen::VectorXd rs_mean,
-                       double ph,
-                       int dmc,
-                       bool cmltv,
-                       int m,
-					   double lp)
+                       int idx,
+                       std::shared_ptr<const simulationContext> ctx)
 {
     pool = pl;
-    node = std::unique_ptr<SEIR_sim_node>(new SEIR_sim_node(this, sd,s,e,i,
-                         r,offs,y,nm,dmt,dmv,tdmv,tdme,x,x_rs,mode,ei_prior,ir_prior,avgI,
-                         sp_prior,se_prec,rs_prec,se_mean,rs_mean, ph,dmc,cmltv, m, lp));
+    worker_idx = idx;
+#ifdef SPATIALSEIR_SINGLETHREAD
+    node = std::unique_ptr<SEIR_sim_node>(new SEIR_sim_node(this, ctx));
+#else
+    // The worker thread builds the node itself, see NodePool::startWorker
+    (void) ctx;
+#endif
 }
 
-void NodeWorker::operator()()
+bool NodeWorker::nextTask(instruction* task)
 {
-    instruction task;
-#ifdef SPATIALSEIR_SINGLETHREAD
-    while ((pool -> tasks).size() > 0)
+    const int nQueues = (pool -> queues).size();
+    int offset, idx;
+    // Own queue first, then steal from the others starting with the 
+    // next worker over, so that thieves spread out.
+    for (offset = 0; offset < nQueues; offset++)
     {
-        task = (pool -> tasks).front();
-        (pool -> nBusy)++;
-        (pool -> tasks).pop_front();
-        if (task.action_type == sim_atom)
+        idx = (worker_idx + offset) % nQueues;
+        workerQueue& queue = *((pool -> queues)[idx]);
+        std::lock_guard<std::mutex> lock(queue.queue_mutex);
+        if (!queue.tasks.empty())
         {
-            Eigen::VectorXd result = node -> simulate(task.params, false).result;
-            (*(pool -> result_pointer)).row(task.param_idx) = result; 
-        }
-        else if (task.action_type == sim_result_atom)
-        {
-            // Do these need to be re-sorted?
-            simulationResultSet result = node -> simulate(task.params, true);
-            (*(pool -> result_pointer)).row(task.param_idx) = result.result; 
-            pool -> result_complete_pointer -> push_back(result);
-            pool -> index_pointer -> push_back(task.param_idx);
+            // Streaming batches are finished front to back, so thieves 
+            // also take the lowest rows they can find.
+            if (offset == 0 || pool -> accept_function != nullptr)
+            {
+                *task = queue.tasks.front();
+                queue.tasks.pop_front();
+            }
+            else
+            {
+                *task = queue.tasks.back();
+                queue.tasks.pop_back();
+            }
+            (pool -> nAvailable)--;
+            return(true);
         }
-        (pool -> nBusy)--;
     }
-#else
-    while(true)
+    return(false);
+}
+
+void NodeWorker::runTask(const instruction& task)
+{
+    const telemetryClock::time_point started = telemetryClock::now();
+    stats.queue_wait_seconds += std::chrono::duration<double>(started 
+            - task.queued_at).count();
+    stats.tasks++;
+    if (task.action_type == range_atom)
     {
+        (*(pool -> range_function))(task.start_idx, task.end_idx);
+        stats.busy_seconds += std::chrono::duration<double>(
+                telemetryClock::now() - started).count();
+        return;
+    }
+    int i;
+    const Eigen::MatrixXd& params = *(pool -> params_pointer);
+    for (i = task.start_idx; i < task.end_idx && i < pool -> row_cutoff; i++)
+    {
+        stats.simulations++;
+        param_buffer = params.row(i/(pool -> row_replicates)).transpose();
+        switch (task.action_type)
         {
-            std::unique_lock<std::mutex> lock(pool -> queue_mutex);
-
-            while (!pool -> exit && (pool -> tasks).empty())
+            case sim_atom:
             {
-                (pool -> condition).wait(lock);
+                // Rows are disjoint between tasks, so no lock is needed
+                (*(pool -> result_pointer)).row(i) = node -> simulate(
+                        param_buffer, false, task.threshold, task.batch_id, 
+                        pool -> particle_offset + i).result.transpose();
+                break;
             }
-            if (pool -> exit)
-                return;
-            task = (pool -> tasks).front();
-            (pool -> nBusy)++;
-            (pool -> tasks).pop_front();
-        }
-        if (task.action_type == sim_atom)
-        {
-            Eigen::VectorXd result = node -> simulate(task.params, false).result;
+            case sim_result_atom:
             {
-				std::lock_guard<std::mutex> lock(pool -> result_mutex);
-                (*(pool -> result_pointer)).row(task.param_idx) = result; 
-				while (!(node -> messages).empty()) 
-				{
-					(pool -> messages).push_back((node -> messages).front()); 
-					(node -> messages).pop_front();
-				}
+                // Compartment capture always runs the full time series
+                const simulationResultSet& result = node -> simulate(param_buffer, true,
+                                    std::numeric_limits<double>::infinity(),
+                                    task.batch_id, 
+                                    pool -> particle_offset + i);
+                (*(pool -> result_pointer)).row(i) = result.result.transpose(); 
+                // Each row has its own slot, so no lock is needed
+                pool -> compartment_pointer -> store(i, result);
+                break;
             }
+            default:
+                break;
         }
-        else if (task.action_type == sim_result_atom)
+    }
+    if (pool -> accept_function != nullptr && i == task.end_idx)
+    {
+        int nAccepted = 0;
+        for (i = task.start_idx; i < task.end_idx; i++)
+        {
+            nAccepted += (*(pool -> accept_function))(i);
+        }
+        pool -> chunkFinished(task.chunk_idx, nAccepted);
+    }
+    const double elapsed = std::chrono::duration<double>(
+            telemetryClock::now() - started).count();
+    stats.busy_seconds += elapsed;
+    stats.simulation_seconds += elapsed;
+}
+
+void NodeWorker::operator()()
+{
+    instruction task;
+#ifdef SPATIALSEIR_SINGLETHREAD
+    while (nextTask(&task))
+    {
+        runTask(task);
+        (pool -> nPending)--;
+    }
+#else
+    while(true)
+    {
+        if (nextTask(&task))
         {
-            simulationResultSet result = node -> simulate(task.params, true);
+            runTask(task);
+            if (--(pool -> nPending) == 0)
             {
-                std::lock_guard<std::mutex> lock(pool -> result_mutex);
-                pool -> index_pointer -> push_back(task.param_idx);
-                pool -> result_complete_pointer -> push_back(result);
-                (*(pool -> result_pointer)).row(task.param_idx) = result.result; 
-                while (!((node -> messages).empty())) 
-                {
-                    (pool -> messages).push_back((node -> messages).front()); 
-                    (node -> messages).pop_front();
-                }
+                std::lock_guard<std::mutex> lock(pool -> queue_mutex);
+                (pool -> finished).notify_all();
             }
         }
-
+        else
         {
-            std::lock_guard<std::mutex> lock(pool -> queue_mutex);
-            (pool -> nBusy)--;
-            (pool -> finished).notify_one();
+            std::unique_lock<std::mutex> lock(pool -> queue_mutex);
+            (pool -> condition).wait(lock, [this](){
+                    return(pool -> exit || pool -> nAvailable > 0);});
+            if (pool -> exit)
+                return;
         }
     }
 #endif
 }
 
 NodePool::NodePool(Eigen::MatrixXd* rslt_ptr,
-                   std::vector<simulationResultSet>* rslt_c_ptr,
-                   std::vector<int>* idx_ptr,
-                       int threads,
-                       int sd,
-                       Eigen::VectorXi s,
-                       Eigen::VectorXi e,
-                       Eigen::VectorXi i,
-                       Eigen::VectorXi r,
-                       Eigen::VectorXd offs,
-                       Eigen::MatrixXi y,
-                       MatrixXb nm,
-                       int dmt,
-                       std::vector<Eigen::MatrixXd> dmv,
-                       std::vector<std::vector<Eigen::MatrixXd> > tdmv,
-                       std::vector<int> tdme,
-                       Eigen::MatrixXd x,
-                       Eigen::MatrixXd x_rs,
-                       std::string mode,
-                       Eigen::MatrixXd ei_prior,
-                       Eigen::MatrixXd ir_prior,
-                       double avgI,
-                       Eigen::VectorXd sp_prior,
-                       Eigen::VectorXd se_prec,
-                       Eigen::VectorXd rs_prec,
-                       Eigen::VectorXd se_mean,
-                       Eigen::VectorXd rs_mean,
-                       double ph,
-                       int dmc,
-                       bool cmltv,
-                       int m,
-                       double lp)
+                   compartmentStore* rslt_c_ptr,
+                   int threads,
+                   std::shared_ptr<const simulationContext> ctx,
+                   int chnk,
+                   const std::vector<cpuSlot>& plcmnt) : placement(plcmnt)
 {
     result_pointer = rslt_ptr;
-    result_complete_pointer = rslt_c_ptr;
-    index_pointer = idx_ptr;
+    compartment_pointer = rslt_c_ptr;
+    params_pointer = nullptr;
+    particle_offset = 0;
+    row_replicates = 1;
+    range_function = nullptr;
+    accept_function = nullptr;
+    accept_needed = 0;
+    batch_chunk = 1;
+    frontier_chunk = 0;
+    frontier_accepted = 0;
+    row_cutoff = 0;
+    chunk_size = chnk;
+    batch_counter = 0;
     exit = false;
-    nBusy = 0;
+    nAvailable = 0;
+    nPending = 0;
+    telemetry_reset = telemetryClock::now();
+    nStarted = 0;
+    nUnpinned = 0;
 #ifdef SPATIALSEIR_SINGLETHREAD
     // Single threaded mode only needs single worker
-    nodes.push_back(NodeWorker(this,
-                                           sd + 1000*(1),s,e,i,
-                     r,offs,y,nm,dmt,dmv,tdmv,tdme,x,x_rs,mode,ei_prior,ir_prior,avgI,
-                     sp_prior,se_prec,rs_prec,se_mean,rs_mean,ph,dmc,cmltv, m, lp
-                    ));
-#else
+    threads = 1;
+    placement.clear();
+#endif
+    if (!placement.empty() && (int) placement.size() < threads)
+    {
+        throw abseirError("fewer CPUs placed than worker threads.\n");
+    }
+    replicate_context = false;
+    for (unsigned int i = 1; i < placement.size() && (int) i < threads; i++)
+    {
+        replicate_context = replicate_context || 
+            (placement[i].numa_node != placement[0].numa_node);
+    }
+    for (int itr = 0; itr < threads; itr++)
+    {
+        queues.push_back(std::unique_ptr<workerQueue>(new workerQueue()));
+        // Every worker shares the seed: streams are told apart by batch, 
+        // particle and replicate rather than by worker.
+        workers.push_back(std::unique_ptr<NodeWorker>(
+                    new NodeWorker(this, itr, ctx)));
+    }
+#ifndef SPATIALSEIR_SINGLETHREAD
     for (int itr = 0; itr < threads; itr++)
     {
-        nodes.push_back(std::thread(NodeWorker(this,
-                                               sd + 1000*(itr+1),s,e,i,
-                         r,offs,y,nm,dmt,dmv,tdmv,tdme,x,x_rs,mode,ei_prior,ir_prior,avgI,
-                         sp_prior,se_prec,rs_prec,se_mean,rs_mean,ph,dmc,cmltv, m, lp
-                        )));
+        nodes.push_back(std::thread([this, itr, ctx](){
+                    startWorker(itr, ctx);
+                    (*workers[itr])();}));
+    }
+    {
+        std::unique_lock<std::mutex> lock(startup_mutex);
+        started.wait(lock, [this, threads](){return(nStarted == threads);});
+    }
+    if (startup_error)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            exit = true;
+        }
+        condition.notify_all();
+        for (unsigned int i = 0; i < nodes.size(); i++)
+        {
+            nodes[i].join();
+        }
+        std::rethrow_exception(startup_error);
+    }
+    if (nUnpinned > 0)
+    {
+        std::stringstream msg;
+        msg << nUnpinned << " of " << threads << " worker threads could not "
+            << "be placed on their CPU.";
+        coreWarning(msg.str());
     }
 #endif
 }
 
+void NodePool::startWorker(int worker_idx,
+                           std::shared_ptr<const simulationContext> ctx)
+{
+    bool pinned = true;
+    std::exception_ptr error;
+    try
+    {
+        std::shared_ptr<const simulationContext> local_ctx = ctx;
+        if (!placement.empty())
+        {
+            pinned = pinCurrentThread(placement[worker_idx].cpu);
+            if (replicate_context)
+            {
+                local_ctx = nodeContext(placement[worker_idx].numa_node, ctx);
+            }
+        }
+        // Storage is first touched here, on the worker's own node
+        workers[worker_idx] -> node = std::unique_ptr<SEIR_sim_node>(
+                new SEIR_sim_node(workers[worker_idx].get(), local_ctx));
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> lock(startup_mutex);
+        nStarted++;
+        nUnpinned += !pinned;
+        if (error && !startup_error)
+        {
+            startup_error = error;
+        }
+    }
+    started.notify_all();
+}
+
+std::shared_ptr<const simulationContext> NodePool::nodeContext(int numa_node,
+        std::shared_ptr<const simulationContext> ctx)
+{
+    // Copies are made under the lock, so each node is copied once, by a
+    // thread running on it
+    std::lock_guard<std::mutex> lock(startup_mutex);
+    std::shared_ptr<const simulationContext>& out = node_contexts[numa_node];
+    if (!out)
+    {
+        out = std::make_shared<simulationContext>(*ctx);
+    }
+    return(out);
+}
+
 void NodePool::setResultsDest(Eigen::MatrixXd* rslt_ptr,
-                              std::vector<simulationResultSet>* rslt_c_ptr,
-                              std::vector<int>* rslt_idx)
+                              compartmentStore* rslt_c_ptr)
 {
     result_pointer = rslt_ptr;
-    result_complete_pointer = rslt_c_ptr;
-    index_pointer = rslt_idx;
+    compartment_pointer = rslt_c_ptr;
+}
+
+
+void NodePool::resetTelemetry()
+{
+    for (unsigned int i = 0; i < workers.size(); i++)
+    {
+        workers[i] -> stats = workerTelemetry();
+    }
+    telemetry_reset = telemetryClock::now();
 }
 
+std::vector<workerTelemetry> NodePool::getTelemetry() const
+{
+    std::vector<workerTelemetry> out;
+    for (unsigned int i = 0; i < workers.size(); i++)
+    {
+        out.push_back(workers[i] -> stats);
+    }
+    return(out);
+}
+
+double NodePool::telemetrySeconds() const
+{
+    return(std::chrono::duration<double>(telemetryClock::now() 
+                - telemetry_reset).count());
+}
+
+long NodePool::totalSimulations() const
+{
+    long out = 0;
+    for (unsigned int i = 0; i < workers.size(); i++)
+    {
+        out += workers[i] -> stats.simulations;
+    }
+    return(out);
+}
 
 void NodePool::awaitFinished()
 {
 #ifdef SPATIALSEIR_SINGLETHREAD
-    nodes[0]();
+    (*workers[0])();
 #else
     {
         std::unique_lock<std::mutex> lock(queue_mutex);
-        finished.wait(lock, [this](){return tasks.empty() && (nBusy == 0); });
+        finished.wait(lock, [this](){return(nPending == 0);});
     }
-	resolveMessages();
 #endif
+	resolveMessages();
 }
 
 void NodePool::resolveMessages()
 {    
 	// 2020-02-27: Changed to only be called in master thread, avoid synchronization issues. 
+    // Workers are idle here, so their message queues can be drained directly
+    for (unsigned int i = 0; i < workers.size(); i++)
+    {
+        std::deque<std::string>& node_messages = workers[i] -> node -> messages;
+        while (!(node_messages.empty()))
+        {
+            messages.push_back(node_messages.front());
+            node_messages.pop_front();
+        }
+    }
 	while (!(messages.empty())) 
 	{
-		Rcpp::Rcout << messages.front() << "\n"; 
+		coreLog() << messages.front() << "\n"; 
 		messages.pop_front();
 	}
 }
 
-void NodePool::enqueue(std::string action_type, int param_idx, Eigen::VectorXd params)
+void NodePool::enqueue(simulationAction action_type, 
+                       const Eigen::MatrixXd* params, 
+                       double threshold,
+                       int replicates)
 {
-    instruction inst;
-    inst.param_idx = param_idx;
-    inst.action_type = action_type;
-    inst.params = params;
+    const int nRows = (params -> rows())*replicates;
+    const int nQueues = queues.size();
+    if (nRows == 0)
+    {
+        return;
+    }
+    // By default aim for several chunks per worker, so that stealing can
+    // even out simulations of differing length. 
+    int chunk = (chunk_size > 0 ? chunk_size : 
+                 std::max(1, nRows/(8*nQueues)));
+    params_pointer = params;
+    particle_offset = 0;
+    row_replicates = replicates;
+    accept_function = nullptr;
+    row_cutoff = nRows;
+    queueTasks(action_type, nRows, chunk, threshold, batch_counter++, false);
+}
+
+unsigned int NodePool::reserveBatch()
+{
+    return(batch_counter++);
+}
+
+unsigned int NodePool::batchCount() const
+{
+    return(batch_counter);
+}
+
+void NodePool::setBatchCount(unsigned int count)
+{
+    batch_counter = count;
+}
+
+void NodePool::enqueueRows(simulationAction action_type,
+                           const Eigen::MatrixXd* params,
+                           double threshold,
+                           unsigned int batch_id,
+                           int first_particle)
+{
+    const int nRows = params -> rows();
+    const int nQueues = queues.size();
+    if (nRows == 0)
+    {
+        return;
+    }
+    int chunk = (chunk_size > 0 ? chunk_size : 
+                 std::max(1, nRows/(8*nQueues)));
+    params_pointer = params;
+    particle_offset = first_particle;
+    row_replicates = 1;
+    accept_function = nullptr;
+    row_cutoff = nRows;
+    queueTasks(action_type, nRows, chunk, threshold, batch_id, false);
+}
+
+void NodePool::enqueueUntil(simulationAction action_type,
+                            const Eigen::MatrixXd* params,
+                            double threshold,
+                            int needed,
+                            const std::function<bool(int)>* accept)
+{
+    const int nRows = params -> rows();
+    const int nQueues = queues.size();
+    if (nRows == 0)
+    {
+        return;
+    }
+    int chunk = (chunk_size > 0 ? chunk_size : 
+                 std::max(1, nRows/(8*nQueues)));
+    params_pointer = params;
+    particle_offset = 0;
+    row_replicates = 1;
+    accept_function = accept;
+    accept_needed = needed;
+    batch_chunk = chunk;
+    chunk_accepted = std::vector<int>((nRows + chunk - 1)/chunk, -1);
+    frontier_chunk = 0;
+    frontier_accepted = 0;
+    row_cutoff = nRows;
+    queueTasks(action_type, nRows, chunk, threshold, batch_counter++, true);
+}
+
+void NodePool::chunkFinished(int chunk_idx, int nAccepted)
+{
+    std::lock_guard<std::mutex> lock(stream_mutex);
+    chunk_accepted[chunk_idx] = nAccepted;
+    while (frontier_chunk < (int) chunk_accepted.size() && 
+           frontier_accepted < accept_needed &&
+           chunk_accepted[frontier_chunk] >= 0)
+    {
+        frontier_accepted += chunk_accepted[frontier_chunk];
+        frontier_chunk++;
+        if (frontier_accepted >= accept_needed)
+        {
+            row_cutoff = std::min((int) row_cutoff, frontier_chunk*batch_chunk);
+        }
+    }
+}
+
+void NodePool::parallelFor(int nRows, 
+                           const std::function<void(int, int)>& fn)
+{
+    const int nQueues = queues.size();
+    if (nRows == 0)
+    {
+        return;
+    }
+    // Range tasks are of even cost, so the simulation chunk_size does not
+    // apply. They draw no random numbers and leave batch_counter alone.
+    range_function = &fn;
+    accept_function = nullptr;
+    queueTasks(range_atom, nRows, std::max(1, nRows/(4*nQueues)), 
+               std::numeric_limits<double>::infinity(), 0, false);
+    awaitFinished();
+    range_function = nullptr;
+}
+
+void NodePool::queueTasks(simulationAction action_type,
+                          int nRows,
+                          int chunk,
+                          double threshold,
+                          unsigned int batch_id,
+                          bool interleave)
+{
+    const int nQueues = queues.size();
+    int nChunks = (nRows + chunk - 1)/chunk;
+    nPending += nChunks;
+    // By default deal contiguous chunks out to the queues, so that each 
+    // worker starts on its own block of rows. Interleaving instead has all
+    // workers move through the rows together from the front.
+    int chunksPerQueue = (nChunks + nQueues - 1)/nQueues;
+    int chunkIdx, q;
+    const telemetryClock::time_point queued_at = telemetryClock::now();
+    for (q = 0; q < nQueues; q++)
+    {
+        std::lock_guard<std::mutex> lock(queues[q] -> queue_mutex);
+        for (int k = 0; k < chunksPerQueue; k++)
+        {
+            chunkIdx = (interleave ? k*nQueues + q : q*chunksPerQueue + k);
+            if (chunkIdx >= nChunks)
+            {
+                break;
+            }
+            instruction inst;
+            inst.action_type = action_type;
+            inst.chunk_idx = chunkIdx;
+            inst.start_idx = chunkIdx*chunk;
+            inst.end_idx = std::min(nRows, (chunkIdx + 1)*chunk);
+            inst.threshold = threshold;
+            inst.batch_id = batch_id;
+            inst.queued_at = queued_at;
+            queues[q] -> tasks.push_back(inst);
+        }
+    }
     {
         std::lock_guard<std::mutex> lock(queue_mutex);
-        tasks.push_back(inst);
+        nAvailable += nChunks;
     }
-    //resolveMessages();
-    condition.notify_one();
+    condition.notify_all();
 }
 
 NodePool::~NodePool()
@@ -349,119 +645,108 @@ NodePool::~NodePool()
 		exit = true;
 	}
     condition.notify_all();
+#ifndef SPATIALSEIR_SINGLETHREAD
     for (unsigned int i = 0; i < nodes.size(); i++)
     {
-#ifdef SPATIALSEIR_SINGLETHREAD
-        nodes.pop_back();
-#else
         nodes[i].join();
-#endif
     }
+#endif
 }
 
-
 SEIR_sim_node::SEIR_sim_node(NodeWorker* worker,
-                             int sd,
-                             Eigen::VectorXi s,
-                             Eigen::VectorXi e,
-                             Eigen::VectorXi i,
-                             Eigen::VectorXi r,
-                             Eigen::VectorXd offs,
-                             Eigen::MatrixXi y,
-                             MatrixXb nm,
-                             int dmt,
-                             std::vector<Eigen::MatrixXd> dmv,
-                             std::vector<std::vector<Eigen::MatrixXd> > tdmv,
-                             std::vector<int> tdme,
-                             Eigen::MatrixXd x,
-                             Eigen::MatrixXd x_rs,
-                             std::string mode,
-                             Eigen::MatrixXd ei_prior,
-                             Eigen::MatrixXd ir_prior,
-                             double avgI,
-                             Eigen::VectorXd sp_prior,
-                             Eigen::VectorXd se_prec,
-                             Eigen::VectorXd rs_prec,
-                             Eigen::VectorXd se_mean,
-                             Eigen::VectorXd rs_mean,
-                             double ph,
-                             int dmc,
-                             bool cmltv,
-                             int m_,
-							 double lp
+                             std::shared_ptr<const simulationContext> ctx
                              ) : parent(worker),
-                                 random_seed(sd),
-                                 S0(s),
-                                 E0(e),
-                                 I0(i),
-                                 R0(r),
-                                 offset(offs),
-                                 Y(y),
-                                 na_mask(nm),
-                                 dataModelType(dmt),
-                                 DM_vec(dmv),
-                                 TDM_vec(tdmv),
-                                 TDM_empty(tdme),
-                                 X(x),
-                                 X_rs(x_rs),
-                                 transitionMode(mode),
-                                 E_to_I_prior(ei_prior),
-                                 I_to_R_prior(ir_prior),
-                                 inf_mean(avgI),
-                                 spatial_prior(sp_prior),
-                                 exposure_precision(se_prec),
-                                 reinfection_precision(rs_prec),
-                                 exposure_mean(se_mean),
-                                 reinfection_mean(rs_mean),
-                                 phi(ph),
-                                 data_compartment(dmc),
-                                 cumulative(cmltv),
-                                 m(m_),
-								 lpow(lp)
+                                 context(ctx),
+                                 random_seed(ctx -> random_seed),
+                                 S0(ctx -> S0),
+                                 E0(ctx -> E0),
+                                 I0(ctx -> I0),
+                                 R0(ctx -> R0),
+                                 offset(ctx -> offset),
+                                 Y(ctx -> Y),
+                                 na_mask(ctx -> na_mask),
+                                 dataModelType(ctx -> dataModelType),
+                                 DM_vec(ctx -> DM_vec),
+                                 TDM_vec(ctx -> TDM_vec),
+                                 TDM_empty(ctx -> TDM_empty),
+                                 X(ctx -> X),
+                                 X_rs(ctx -> X_rs),
+                                 transitionMode(ctx -> transitionMode),
+                                 E_to_I_prior(ctx -> E_to_I_prior),
+                                 I_to_R_prior(ctx -> I_to_R_prior),
+                                 inf_mean(ctx -> inf_mean),
+                                 spatial_prior(ctx -> spatial_prior),
+                                 exposure_precision(ctx -> exposure_precision),
+                                 reinfection_precision(ctx -> reinfection_precision),
+                                 exposure_mean(ctx -> exposure_mean),
+                                 reinfection_mean(ctx -> reinfection_mean),
+                                 phi(ctx -> phi),
+                                 data_compartment(ctx -> data_compartment),
+                                 cumulative(ctx -> cumulative),
+                                 m(ctx -> m),
+                                 lpow(ctx -> lpow),
+                                 I_lag((ctx -> TDM_vec)[0].size(), 
+                                       (ctx -> S0).size(), ctx -> m)
 {
     try
     {
-        std::minstd_rand0 lc_generator(sd);
-        std::uint_least32_t seed_data[std::mt19937::state_size];
-        std::generate_n(seed_data, std::mt19937::state_size, std::ref(lc_generator));
-        std::seed_seq q(std::begin(seed_data), std::end(seed_data));
-        generator = new mt19937{q};   
+        replicate_generators = std::vector<philox4x32>(m);
+        generator = &(replicate_generators[0]);
         int i;
  
-        E_paths = std::vector<Eigen::MatrixXi>();
-        I_paths = std::vector<Eigen::MatrixXi>();
+        E_paths = std::vector<pathCompartment>();
+        I_paths = std::vector<pathCompartment>();
 
-        if (transitionMode == "weibull")
+        transition_type = (transitionMode == "weibull" ? TRANSITION_WEIBULL :
+                          (transitionMode == "path_specific" ? 
+                           TRANSITION_PATH_SPECIFIC : TRANSITION_EXPONENTIAL));
+        if (transition_type == TRANSITION_WEIBULL)
         {
             EI_transition_dist = std::unique_ptr<weibullTransitionDistribution>(
                     new weibullTransitionDistribution(E_to_I_prior.col(0)));
             IR_transition_dist = std::unique_ptr<weibullTransitionDistribution>(
                     new weibullTransitionDistribution(I_to_R_prior.col(0)));
             for (i = 0; i < m; i++){
-                E_paths.push_back(Eigen::MatrixXi((int) E_to_I_prior(4,0), Y.cols()));
-                I_paths.push_back(Eigen::MatrixXi((int) I_to_R_prior(4,0), Y.cols()));
+                E_paths.push_back(pathCompartment((int) E_to_I_prior(4,0), Y.cols()));
+                I_paths.push_back(pathCompartment((int) I_to_R_prior(4,0), Y.cols()));
             }
+            // Probabilities are set from the parameters in simulate
+            EI_path_samplers = std::vector<binomialSampler>((int) E_to_I_prior(4,0));
+            IR_path_samplers = std::vector<binomialSampler>((int) I_to_R_prior(4,0));
         }
-        else if (transitionMode == "path_specific")
+        else if (transition_type == TRANSITION_PATH_SPECIFIC)
         {
             for (i = 0; i < m; i++){
-                E_paths.push_back(Eigen::MatrixXi(E_to_I_prior.rows(),Y.cols()));
-                I_paths.push_back(Eigen::MatrixXi(I_to_R_prior.rows(),Y.cols()));
+                E_paths.push_back(pathCompartment(E_to_I_prior.rows(), Y.cols()));
+                I_paths.push_back(pathCompartment(I_to_R_prior.rows(), Y.cols()));
+            }
+            for (i = 0; i < E_to_I_prior.rows(); i++)
+            {
+                EI_path_samplers.push_back(binomialSampler(E_to_I_prior(i,5)));
+            }
+            for (i = 0; i < I_to_R_prior.rows(); i++)
+            {
+                IR_path_samplers.push_back(binomialSampler(I_to_R_prior(i,5)));
             }
         }
         else
         {
             for (i = 0; i < m; i++)
             {
-                E_paths.push_back(Eigen::MatrixXi(1,Y.cols()));
-                I_paths.push_back(Eigen::MatrixXi(1,Y.cols()));
+                E_paths.push_back(pathCompartment(1, Y.cols()));
+                I_paths.push_back(pathCompartment(1, Y.cols()));
             }
         }
         if (dataModelType == 1 && phi > 0)
         {   
             // We take the floor of the resulting continuous normal, so shift by 0.5
-            overdispersion_distribution = std::normal_distribution<double>(0.5, 
-                    1.0/phi);
+            overdispersion_distributions = std::vector<std::normal_distribution<double> >(
+                    m, std::normal_distribution<double>(0.5, 1.0/phi));
+        }
+        else
+        {
+            overdispersion_distributions = 
+                std::vector<std::normal_distribution<double> >(m);
         }
     }
     catch (int e)
@@ -469,88 +754,143 @@ SEIR_sim_node::SEIR_sim_node(NodeWorker* worker,
         // TODO: handle these errors
         // aout(this) << "Error in constructor: " << e << "\n"; 
     }
+    // Only the transitions of the epidemic are approximated, not the
+    // reporting of cases
+    const double approx = ctx -> binomial_approx_threshold;
+    rs_sampler.setApproximation(approx);
+    se_sampler.setApproximation(approx);
+    ei_sampler.setApproximation(approx);
+    ir_sampler.setApproximation(approx);
+    for (unsigned int k = 0; k < EI_path_samplers.size(); k++)
+    {
+        EI_path_samplers[k].setApproximation(approx);
+    }
+    for (unsigned int k = 0; k < IR_path_samplers.size(); k++)
+    {
+        IR_path_samplers[k].setApproximation(approx);
+    }
     has_reinfection = (reinfection_precision(0) > 0); 
     has_spatial = (Y.cols() > 1);
     has_ts_spatial = (TDM_vec[0].size() > 0);
+
+    // Weibull transitions share the path specific kernel
+    step_kernel = (transition_type == TRANSITION_EXPONENTIAL ?
+            selectByDataModel<TRANSITION_EXPONENTIAL>(dataModelType, 
+                cumulative, has_reinfection) :
+            selectByDataModel<TRANSITION_PATH_SPECIFIC>(dataModelType, 
+                cumulative, has_reinfection));
     
     const int nRho = (has_spatial && has_ts_spatial ? DM_vec.size() + TDM_vec[0].size() :
                      (has_spatial ? DM_vec.size() : 0));
     const int nReinf = (has_reinfection ? X_rs.cols() : 0);
     const int nBeta = X.cols();
-    const int nTrans = (transitionMode == "exponential" ? 2 : 
-                       (transitionMode == "weibull" ? 4 : 0));
+    const int nTrans = (transition_type == TRANSITION_EXPONENTIAL ? 2 : 
+                       (transition_type == TRANSITION_WEIBULL ? 4 : 0));
     total_size = nRho + nReinf + nBeta + nTrans;
+
+    const int nLoc = S0.size();
+    results = Eigen::VectorXd::Zero(m);
+    beta = Eigen::VectorXd::Zero(nBeta);
+    beta_rs = Eigen::VectorXd::Zero(has_reinfection ? nReinf : 1);
+    rho = Eigen::VectorXd::Ones(has_spatial ? nRho : 1);
+    EI_params = Eigen::VectorXd::Zero(transition_type == TRANSITION_WEIBULL ? 2 : 1);
+    IR_params = Eigen::VectorXd::Zero(transition_type == TRANSITION_WEIBULL ? 2 : 1);
+    N = Eigen::VectorXi::Zero(nLoc);
+    N_double = Eigen::VectorXd::Zero(nLoc);
+    eta = Eigen::VectorXd::Zero(X.rows());
+    p_se_cache = Eigen::MatrixXd::Zero(nLoc, m);
+    p_se = Eigen::MatrixXd::Zero(nLoc, m);
+    pressure_single = Eigen::MatrixXf::Zero(nLoc, m);
+    product_single = Eigen::MatrixXf::Zero(nLoc, m);
+    p_ei = Eigen::VectorXd::Zero(offset.size());
+    p_ir = Eigen::VectorXd::Zero(offset.size());
+    p_rs = Eigen::VectorXd::Zero(has_reinfection ? X_rs.rows() : Y.rows());
+    current_S = Eigen::MatrixXi::Zero(nLoc, m);
+    current_E = Eigen::MatrixXi::Zero(nLoc, m);
+    current_I = Eigen::MatrixXi::Zero(nLoc, m);
+    current_R = Eigen::MatrixXi::Zero(nLoc, m);
+    previous_S = Eigen::MatrixXi::Zero(nLoc, m);
+    previous_E = Eigen::MatrixXi::Zero(nLoc, m);
+    previous_I = Eigen::MatrixXi::Zero(nLoc, m);
+    previous_R = Eigen::MatrixXi::Zero(nLoc, m);
+    previous_S_star = Eigen::MatrixXi::Zero(nLoc, m);
+    previous_E_star = Eigen::MatrixXi::Zero(nLoc, m);
+    previous_I_star = Eigen::MatrixXi::Zero(nLoc, m);
+    previous_R_star = Eigen::MatrixXi::Zero(nLoc, m);
+    cumulative_compartment = Eigen::MatrixXi::Zero(nLoc, m);
 }
 
-simulationResultSet SEIR_sim_node::simulate(Eigen::VectorXd params, bool keepCompartments)
+const simulationResultSet& SEIR_sim_node::simulate(const Eigen::VectorXd& params, 
+                                            bool keepCompartments,
+                                            double threshold,
+                                            unsigned int batch_id,
+                                            unsigned int particle_idx)
 {
     // Params is a vector made of:
     // [Beta, Beta_RS, rho, gamma_ei, gamma_ir]    
-    int time_idx, i, j, k;   
+    int time_idx, i, k, w;   
     unsigned int idx; 
 
     const int nRho = (has_spatial && has_ts_spatial ? DM_vec.size() + TDM_vec[0].size() :
                      (has_spatial ? DM_vec.size() : 0));
     const int nReinf = (has_reinfection ? X_rs.cols() : 0);
     const int nBeta = X.cols();
-	const int nTrans = (transitionMode == "exponential" ? 2 :
-                       (transitionMode == "weibull" ? 4 : 0));
+	const int nTrans = (transition_type == TRANSITION_EXPONENTIAL ? 2 :
+                       (transition_type == TRANSITION_WEIBULL ? 4 : 0));
     const int nReport = (dataModelType == 2 ? 1: 0);
-	const int nIVC = S0.size()*4;
     
 					   
     double report_fraction;
     
-    simulationResultSet compartmentResults;
- 
-    Eigen::VectorXd results = Eigen::VectorXd::Zero(m); 
+    // All working storage is held by the node and sized in the constructor, 
+    // none of the assignments below allocate. 
+    results.setZero(); 
 
     // Load Beta
-    Eigen::VectorXd beta = params.segment(0, nBeta); 
+    beta = params.segment(0, nBeta); 
 
     // Load Beta RS
-    Eigen::VectorXd beta_rs;
-
     if (has_reinfection) 
     {
         beta_rs = params.segment(nBeta, nReinf);
-    }
-    else 
-    {
-        beta_rs = Eigen::VectorXd(1);
     }
      // Load Rho
-    Eigen::VectorXd rho;
     if (has_spatial)
     {
         rho = params.segment(nBeta + nReinf, nRho);
     }
-    else
-    {
-        rho = Eigen::VectorXd(1);
-        rho(0) = 1.0;
-    }
    
     // Load Gamma_EI
     // Should really unify these two code paths...
-    double gamma_ei = (transitionMode == "exponential" ? 
+    double gamma_ei = (transition_type == TRANSITION_EXPONENTIAL ? 
             params(nBeta + nReinf + nRho) : -1.0);
-    double gamma_ir = (transitionMode == "exponential" ? 
+    double gamma_ir = (transition_type == TRANSITION_EXPONENTIAL ? 
             params(nBeta + nReinf + nRho + 1) : -1.0);
 
-    Eigen::VectorXd EI_params;
-    Eigen::VectorXd IR_params;
-    if (transitionMode == "weibull")
+    if (transition_type == TRANSITION_WEIBULL)
     {
         EI_params = params.segment(nBeta + nReinf + nRho, 2);
         IR_params = params.segment(nBeta + nReinf + nRho + 2, 2); 
         EI_transition_dist -> setCurrentParams(EI_params);
         IR_transition_dist -> setCurrentParams(IR_params);
+        // Bin transition probabilities are fixed for the whole simulation
+        const std::vector<double>& EI_table = 
+            EI_transition_dist -> getTransitionTable();
+        const std::vector<double>& IR_table = 
+            IR_transition_dist -> getTransitionTable();
+        for (k = 0; k < (int) EI_path_samplers.size(); k++)
+        {
+            EI_path_samplers[k].setProb(EI_table[k]);
+        }
+        for (k = 0; k < (int) IR_path_samplers.size(); k++)
+        {
+            IR_path_samplers[k].setProb(IR_table[k]);
+        }
     } 
     else
     {
-        EI_params = Eigen::VectorXd::Zero(1);
-        IR_params = Eigen::VectorXd::Zero(1);
+        EI_params.setZero();
+        IR_params.setZero();
     }
 
     // Load report fraction
@@ -561,6 +901,7 @@ simulationResultSet SEIR_sim_node::simulate(Eigen::VectorXd params, bool keepCom
     else{
         report_fraction = 0;
     }
+    report_sampler.setProb(report_fraction);
 	
     
 	// Load IVC values
@@ -580,70 +921,35 @@ simulationResultSet SEIR_sim_node::simulate(Eigen::VectorXd params, bool keepCom
 	
     // Both Weibull and arbitrary path specific priors require
     // Empty paths at beginning of sim
-    if (transitionMode != "exponential")
+    if (transition_type != TRANSITION_EXPONENTIAL)
     {
-        // Clear out paths
-        for (k = 0; k < m; k++)
+        for (w = 0; w < m; w++)
         {
-            for (i = 0; i < E_paths[k].cols(); i++)
-            {
-                for(j = 0; j < E_paths[k].rows(); j++)
-                {
-                    E_paths[k](j,i) = 0;
-                }
-            }
-            for (i = 0; i < I_paths[k].cols(); i++)
-            {
-                for(j = 0; j < I_paths[k].rows(); j++)
-                {
-                    I_paths[k](j,i) = 0;
-                }
-            }
+            E_paths[w].reset();
+            I_paths[w].reset();
+            E_paths[w].setEntrants(E0);
+            I_paths[w].setEntrants(I0);
         }
     }
 
-    Eigen::VectorXi N(S0.size());
     N = (S0 + E0 + I0 + R0);
+    N_double = N.cast<double>();
 
-    Eigen::MatrixXd p_se_cache(S0.size(), m);
-
-    Eigen::MatrixXi current_S(S0.size(), m);
-    Eigen::MatrixXi current_E(S0.size(), m);
-    Eigen::MatrixXi current_I(S0.size(), m);
-    Eigen::MatrixXi current_R(S0.size(), m);
-
-    std::vector<compartment_tap> I_lag;
-    for (i = 0; i < m; i++)
-    {
-        I_lag.push_back(compartment_tap(TDM_vec[0].size(), S0.size()));
-    }
-
-    Eigen::MatrixXi previous_S(S0.size(), m);
-    Eigen::MatrixXi previous_E(S0.size(), m);
-    Eigen::MatrixXi previous_I(S0.size(), m);
-    Eigen::MatrixXi previous_R(S0.size(), m);
-
-    Eigen::MatrixXi previous_S_star(S0.size(), m);
-    Eigen::MatrixXi previous_E_star(S0.size(), m);
-    Eigen::MatrixXi previous_I_star(S0.size(), m);
-    Eigen::MatrixXi previous_R_star(S0.size(), m); 
+    I_lag.reset();
 
-    Eigen::MatrixXi cumulative_compartment(S0.size(), m);
-
-    Eigen::MatrixXi* comparison_compartment = (data_compartment == 0 ?
-                                               &previous_I_star : 
+    const Eigen::MatrixXi& comparison_compartment = (data_compartment == 0 ?
+                                               previous_I_star : 
                                               (data_compartment == 1 ? 
-                                               &previous_R_star : 
+                                               previous_R_star : 
                                               (data_compartment == 2 ? 
-                                               &previous_I : &previous_I_star)));
+                                               previous_I : previous_I_star)));
 
     // Calculate probabilities
     // p_se calculation
     // Equivalent R expression: 
     // exp(matrix(X %*% beta, nrow = nrow(Y), ncol = ncol(Y)))
-    Eigen::MatrixXd eta = (X*beta).unaryExpr([](double elem){return(
-                std::exp(elem));
-            });
+    eta.noalias() = X*beta;
+    eta = eta.array().exp();
     //printDMatrix(eta, "eta");
 
     Eigen::Map<Eigen::MatrixXd, Eigen::ColMajor> p_se_components(eta.data(), 
@@ -651,100 +957,51 @@ simulationResultSet SEIR_sim_node::simulate(Eigen::VectorXd params, bool keepCom
 
     //printDMatrix(p_se_components, "p_se_components");
 
-
-    time_idx = 0;
-    for (i = 0; i < m; i++)
-    {
-        previous_S.col(i) = S0;
-        previous_E.col(i) = E0;
-        previous_I.col(i) = I0;
-        previous_R.col(i) = R0;
-        previous_S_star.col(i) = Eigen::VectorXi::Zero(S0.size());
-        previous_E_star.col(i) = Eigen::VectorXi::Zero(S0.size());
-        previous_I_star.col(i) = Eigen::VectorXi::Zero(S0.size());
-        previous_R_star.col(i) = Eigen::VectorXi::Zero(S0.size());
-    }
-    if (has_ts_spatial)
-    {
-        for (i = 0; i < m; i++)
-        {
-            I_lag[i].push(previous_I.col(i));
-        }
-    }
-
-    if (transitionMode != "exponential")
-    {
-        for (i = 0; i < m; i++)
-        {
-            I_paths[i].row(0) = I0;
-            E_paths[i].row(0) = E0;
-        }
-    }
-
-    p_se_cache = (((previous_I.cast<double>().array().colwise())
-        /N.cast<double>().array()).array().colwise()*
-        p_se_components.row(0).transpose().array()).unaryExpr([](double e){
-            // Protect against overflow in components
-            return(e == e ? e : 0);
-        });
-
-    Eigen::MatrixXd p_se = 1*p_se_cache; 
-
-    if (has_spatial)
+    for (w = 0; w < m; w++)
     {
-        for (idx = 0; idx < DM_vec.size(); idx++)
-        {
-            p_se += rho[idx]*(DM_vec[idx] * (p_se_cache));
-        }
+        previous_S.col(w) = S0;
+        previous_E.col(w) = E0;
+        previous_I.col(w) = I0;
+        previous_R.col(w) = R0;
     }
-    p_se = (((-1.0*p_se.array()) * (offset(0)))).unaryExpr([](double e){
-            return(1-std::exp(e));
-            }); 
+    cumulative_compartment.setZero();
 
     // Not used if transitionMode != "exponential"
-    Eigen::VectorXd p_ei = (-1.0*gamma_ei*offset)
+    p_ei = (-1.0*gamma_ei*offset)
                             .unaryExpr([](double e){return(1-std::exp(e));});
     
-    Eigen::VectorXd p_ir = (-1.0*gamma_ir*offset)
+    p_ir = (-1.0*gamma_ir*offset)
                             .unaryExpr([](double e){return(1-std::exp(e));}); 
 
-    Eigen::VectorXd p_rs;
     if (has_reinfection)
     {
-        p_rs = ((((X_rs*beta_rs).unaryExpr([](double e){return(std::exp(e));})).array() 
-                    * offset(0)).matrix()).unaryExpr([](double e){return(1-std::exp(-e));});
+        p_rs.noalias() = X_rs*beta_rs;
+        p_rs = (p_rs.array().exp() * offset(0)).unaryExpr([](double e){
+                return(1-std::exp(-e));});
     }
     else
     {
-        p_rs = Eigen::VectorXd::Zero(Y.rows());
+        p_rs.setZero();
     }
 
     // Initialize debug info if applicable
     if (keepCompartments)
     {
-        compartmentResults.result = Eigen::VectorXd(m);
-        for (i = 0; i < m; i++)
-        {
-            compartmentResults.result(i) = 0.0;
-        }
-        compartmentResults.S = Eigen::MatrixXi(Y.rows(), Y.cols());
-        compartmentResults.E = Eigen::MatrixXi(Y.rows(), Y.cols());
-        compartmentResults.I = Eigen::MatrixXi(Y.rows(), Y.cols());
-        compartmentResults.R = Eigen::MatrixXi(Y.rows(), Y.cols());
-
-        compartmentResults.S_star = Eigen::MatrixXi(Y.rows(), Y.cols());
-        compartmentResults.E_star = Eigen::MatrixXi(Y.rows(), Y.cols());
-        compartmentResults.I_star = Eigen::MatrixXi(Y.rows(), Y.cols());
-        compartmentResults.R_star = Eigen::MatrixXi(Y.rows(), Y.cols());
+        // resize is a no-op after the first call
+        compartmentResults.S.resize(Y.rows(), Y.cols());
+        compartmentResults.E.resize(Y.rows(), Y.cols());
+        compartmentResults.I.resize(Y.rows(), Y.cols());
+        compartmentResults.R.resize(Y.rows(), Y.cols());
+
+        compartmentResults.S_star.resize(Y.rows(), Y.cols());
+        compartmentResults.E_star.resize(Y.rows(), Y.cols());
+        compartmentResults.I_star.resize(Y.rows(), Y.cols());
+        compartmentResults.R_star.resize(Y.rows(), Y.cols());
         
-        compartmentResults.X = Eigen::MatrixXd(X.rows(), X.cols());  
-        compartmentResults.X = X; 
-        compartmentResults.beta = Eigen::MatrixXd(1, beta.size());
         compartmentResults.beta = beta.transpose(); 
 
-        compartmentResults.p_se = Eigen::MatrixXd(Y.rows(), Y.cols());
-        compartmentResults.p_se.row(0) = p_se.col(0);
-        if (transitionMode == "exponential")
+        compartmentResults.p_se.resize(Y.rows(), Y.cols());
+        if (transition_type == TRANSITION_EXPONENTIAL)
         {
             compartmentResults.p_ei = p_ei.transpose(); 
             compartmentResults.p_ir = p_ir.transpose(); 
@@ -760,423 +1017,254 @@ simulationResultSet SEIR_sim_node::simulate(Eigen::VectorXd params, bool keepCom
         }
         else
         {
-            compartmentResults.rho = Eigen::MatrixXd(1,1);
+            compartmentResults.rho.resize(1,1);
             compartmentResults.rho(0, 0) = 0.0; 
         }
     }
 
     // Initialize Random Draws
-    time_idx = 0;     
-
-    int tmpDraw, w;
     for (w = 0; w < m; w++)
     {
-        for (i = 0; i < Y.cols(); i++)
-        {
-            previous_S_star(i, w) = std::binomial_distribution<int>(
-                    previous_R(i, w), p_rs(0))(*generator);
-            previous_E_star(i, w) = std::binomial_distribution<int>(
-                    previous_S(i, w), p_se(i, w))(*generator);
+        replicate_generators[w].seed(random_seed, batch_id, particle_idx, w);
+        // Drop any draw cached from the previous simulation
+        overdispersion_distributions[w].reset();
+    }
 
-            if (transitionMode == "exponential")
-            {
-                previous_I_star(i, w) = std::binomial_distribution<int>(
-                        previous_E(i, w), p_ei(0))(*generator);
-                previous_R_star(i, w) = std::binomial_distribution<int>(
-                        previous_I(i, w), p_ir(0))(*generator);
-            }
-            else if (transitionMode == "path_specific")
+    // Early rejection: the running distances only grow, so once every 
+    // replicate has reached the threshold the particle can no longer be 
+    // accepted and the rest of the time series is skipped. The partial 
+    // distances are reported, which are already at or above epsilon, so 
+    // comparisons against the current (or any smaller) epsilon are 
+    // unaffected. Particles with any replicate below the threshold are 
+    // always simulated in full.
+
+    // Simulation: iterative case. All replicates advance together, so the
+    // exposure pressure for every replicate is a single L x m product.
+    int lag;
+    for (time_idx = 0; time_idx < Y.rows(); time_idx++)
+    {
+        p_se_cache = (((previous_I.cast<double>().array().colwise())
+            /N_double.array()).array().colwise()*
+            p_se_components.row(time_idx).transpose().array()
+            ).unaryExpr([](double e){
+                // Protect against overflow in components
+                return(e == e ? e : 0);
+            });
+
+        p_se = p_se_cache; 
+        if (has_spatial)
+        {
+            // Single precision matrices share one rounded copy of the
+            // pressure
+            bool rounded = false;
+            for (idx = 0; idx < DM_vec.size(); idx++)
             {
-                // Updating E_paths and I_paths is repetative - factor out into a function?
-                // That might be costly, unless it's inlined...
-                previous_I_star(i, w) = E_paths[w](E_paths[w].rows() - 1, i); // could take outside loop
-                E_paths[w](E_paths[w].rows() -1, i) = 0;
-                for (j = 0; j < offset(0); j++)
+                if (DM_vec[idx].isSingle())
                 {
-                    // TODO: stop early when possible
-                    // idea: cache previous max?
-                    for (k = E_paths[w].rows() - 2; 
-                            k >= 0; k--)
+                    if (!rounded)
                     {
-                        if (E_paths[w](k,i) > 0)
-                        {
-                            tmpDraw = std::binomial_distribution<int>(
-                                    E_paths[w](k,i), E_to_I_prior(k,5))(*generator);
-                            previous_I_star(i, w) += tmpDraw;
-                            E_paths[w](k,i) -= tmpDraw;
-                            E_paths[w](k+1, i) = E_paths[w](k,i);
-                            E_paths[w](k,i) = 0; // not needed?
-                        }
+                        pressure_single = p_se_cache.cast<float>();
+                        rounded = true;
                     }
+                    DM_vec[idx].multiplyAddSingle(rho[idx], pressure_single,
+                                                  product_single, p_se);
                 }
-                previous_R_star(i, w) = I_paths[w](I_paths[w].rows() - 1, i); // could take outside loop
-                I_paths[w](I_paths[w].rows() -1, i) = 0;
-                for (j = 0; j < offset(0); j++)
+                else
                 {
-                    // TODO: stop early when possible
-                    // idea: cache previous max?
-                    for (k = I_paths[w].rows() - 2; 
-                            k >= 0; k--)
-                    {
-                        if (I_paths[w](k,i) > 0)
-                        {
-                            tmpDraw = std::binomial_distribution<int>(
-                                    I_paths[w](k,i), I_to_R_prior(k,5))(*generator);
-                            previous_R_star(i,w) += tmpDraw;
-                            I_paths[w](k, i) -= tmpDraw;
-                            I_paths[w](k+1, i) = I_paths[w](k,i);
-                            I_paths[w](k, i) = 0; // not needed?
-                        }
-                    }
+                    DM_vec[idx].multiplyAdd(rho[idx], p_se_cache, p_se);
                 }
             }
-            else
+        }
+
+        if (has_ts_spatial && !TDM_empty[time_idx])
+        {   
+            // Pressure from lag+1 steps ago was stored when it was computed
+            for (lag = 0; time_idx - lag - 1 >= 0 && lag < (int) TDM_vec[0].size(); lag++)
             {
-                // Updating E_paths and I_paths is repetative - factor out into a function?
-                // That might be costly, unless it's inlined...
-                previous_I_star(i, w) = E_paths[w](E_paths[w].rows() - 1, i); // could take outside loop
-                E_paths[w](E_paths[w].rows() - 1, i) = 0;
-                for (j = 0; j < offset(0); j++)
+                const distanceMatrix& lagged = TDM_vec[time_idx-lag - 1][lag];
+                if (lagged.isSingle())
                 {
-                    // TODO: stop early when possible
-                    // idea: cache previous max?
-                    for (k = E_paths[w].rows() - 2; 
-                            k >= 0; k--)
-                    {
-                        if (E_paths[w](k,i) > 0)
-                        { 
-                            tmpDraw = std::binomial_distribution<int>(
-                                        E_paths[w](k,i),
-                                        EI_transition_dist -> getTransitionProb(k, k+1)
-                                        )(*generator);
-                            previous_I_star(i,w) += tmpDraw;
-                            E_paths[w](k,i) -= tmpDraw;
-                            E_paths[w](k+1, i) = E_paths[w](k,i);
-                            E_paths[w](k,i) = 0; // not needed?
-                        }
-                    }
+                    pressure_single = I_lag.get(lag).cast<float>();
+                    lagged.multiplyAddSingle(rho[DM_vec.size() + lag],
+                                             pressure_single, product_single,
+                                             p_se);
                 }
-                previous_R_star(i,w) = I_paths[w](I_paths[w].rows() - 1, i); // could take outside loop
-                I_paths[w](I_paths[w].rows() -1, i) = 0;
-                for (j = 0; j < offset(0); j++)
+                else
                 {
-                    // TODO: stop early when possible
-                    // idea: cache previous max?
-                    for (k = I_paths[w].rows() - 2; 
-                            k >= 0; k--)
-                    {
-                        if (I_paths[w](k,i) > 0)
-                        {
-                            tmpDraw = std::binomial_distribution<int>(
-                                        I_paths[w](k,i),
-                                        IR_transition_dist -> getTransitionProb(k, k+1)
-                                        )(*generator);
-                            previous_R_star(i,w) += tmpDraw;
-                            I_paths[w](k,i) -= tmpDraw;
-                            I_paths[w](k+1, i) = I_paths[w](k,i);
-                            I_paths[w](k,i) = 0; // not needed?
-                        }
-                    }
+                    lagged.multiplyAdd(rho[DM_vec.size() + lag],
+                                       I_lag.get(lag), p_se);
                 }
             }
+        }
+
+        //coreLog() << "offset(" << time_idx << "): " << offset(time_idx) << "\n";
+        p_se = ((-1.0*p_se.array() * offset(time_idx)).matrix()
+                ).unaryExpr([](double e){return(1-std::exp(e));});
+        rs_sampler.setProb(p_rs(time_idx));
+        ei_sampler.setProb(p_ei(time_idx));
+        ir_sampler.setProb(p_ir(time_idx));
+
+        (this->*step_kernel)(time_idx, comparison_compartment);
 
-            if (cumulative)
+        if (keepCompartments)
+        {
+            for (i = 0; i < S0.size(); i++)
             {
-                cumulative_compartment(i) = (*comparison_compartment)(i);
+                compartmentResults.S(time_idx, i) = previous_S(i,0);
+                compartmentResults.E(time_idx, i) = previous_E(i,0);
+                compartmentResults.I(time_idx, i) = previous_I(i,0);
+                compartmentResults.R(time_idx, i) = previous_R(i,0);
+
+                compartmentResults.S_star(time_idx, i) = previous_S_star(i,0);
+                compartmentResults.E_star(time_idx, i) = previous_E_star(i,0);
+                compartmentResults.I_star(time_idx, i) = previous_I_star(i,0);
+                compartmentResults.R_star(time_idx, i) = previous_R_star(i,0);
             }
+            compartmentResults.p_se.row(time_idx) = p_se.col(0);
+        }
 
-            
-            if (!na_mask(0,i))
+        current_S = previous_S + previous_S_star - previous_E_star;
+        current_E = previous_E + previous_E_star - previous_I_star;
+        current_I = previous_I + previous_I_star - previous_R_star;
+        current_R = previous_R + previous_R_star - previous_S_star;
+
+        if (transition_type != TRANSITION_EXPONENTIAL)
+        {
+            for (w = 0; w < m; w++)
             {
-                if (dataModelType == 1){
-                    results(w) += std::pow((*comparison_compartment)(i,w) + 
-                        std::floor(overdispersion_distribution(*generator)) -
-                        Y(0, i), lpow);
-                }
-                else if (dataModelType == 2){
-                    results(w) += std::pow(std::abs(std::binomial_distribution<int>(
-                                (*comparison_compartment)(i,w),
-                            report_fraction)(*generator) - Y(0,i)), lpow);
-                }
-                else{
-                    results(w) += std::pow(std::abs((*comparison_compartment)(i,w) -
-                        Y(0, i)), lpow);
-                }
+                E_paths[w].advanceHead(pathSteps(time_idx));
+                I_paths[w].advanceHead(pathSteps(time_idx));
+                E_paths[w].setEntrants(previous_E_star.col(w));
+                I_paths[w].setEntrants(previous_I_star.col(w));
             }
-        }// End i loop
-    }// End w loop
+        }
 
-    if (keepCompartments)
-    {
-        for (i = 0; i < S0.size(); i++)
+        if (has_ts_spatial)
         {
-            compartmentResults.S(time_idx, i) = S0(i);
-            compartmentResults.E(time_idx, i) = E0(i);
-            compartmentResults.I(time_idx, i) = I0(i);
-            compartmentResults.R(time_idx, i) = R0(i);
-
-            compartmentResults.S_star(time_idx, i) = previous_S_star(i,0);
-            compartmentResults.E_star(time_idx, i) = previous_E_star(i,0);
-            compartmentResults.I_star(time_idx, i) = previous_I_star(i,0);
-            compartmentResults.R_star(time_idx, i) = previous_R_star(i,0);
+            I_lag.push(p_se_cache);
         }
-    }
+        previous_S = current_S;
+        previous_E = current_E;
+        previous_I = current_I;
+        previous_R = current_R;
 
-    current_S = previous_S + previous_S_star - previous_E_star;
-    current_E = previous_E + previous_E_star - previous_I_star;
-    current_I = previous_I + previous_I_star - previous_R_star;
-    current_R = previous_R + previous_R_star - previous_S_star;
-
-    if (transitionMode != "exponential")
-    {
-        for (w = 0; w < m; w++)
+        if (results.minCoeff() >= threshold)
         {
-            E_paths[w].row(0) = previous_E_star.col(w);
-            I_paths[w].row(0) = previous_I_star.col(w);
+            break;
         }
     }
 
-    previous_S = current_S;
-    previous_E = current_E;
-    previous_I = current_I;
-    previous_R = current_R;
+    results = results.array().pow(1.0/lpow);
 
-    // Simulation: iterative case
-    //printDMatrix(p_se_components, "p_se_components");
-    int lag;
+    compartmentResults.result = results;
+    return(compartmentResults);
+}
+
+int SEIR_sim_node::pathSteps(int time_idx) const
+{
+    // Bins are ageing steps of one time unit
+    return((int) std::ceil(offset(time_idx)));
+}
+
+template<int transitionType, int dataModel, bool isCumulative, 
+         bool hasReinfection>
+void SEIR_sim_node::stepKernelImpl(int time_idx, 
+                                   const Eigen::MatrixXi& comparison_compartment)
+{
+    const int nLoc = Y.cols();
+    const int nSteps = (transitionType == TRANSITION_EXPONENTIAL ? 0 :
+                        pathSteps(time_idx));
+    int i, w, observed;
+    double distance;
     for (w = 0; w < m; w++)
     {
-        for (time_idx = 1; time_idx < Y.rows(); time_idx++)
+        generator = &(replicate_generators[w]);
+        for (i = 0; i < nLoc; i++)
         {
-            p_se_cache = ((previous_I.cast<double>().array().col(w)).array()
-                /N.cast<double>().array()*
-                p_se_components.row(time_idx).transpose().array()
-                ).unaryExpr([](double e){
-                    // Protect against overflow in components
-                    return(e == e ? e : 0);
-                });
-
-            p_se = 1*p_se_cache; 
-            if (has_spatial)
+            previous_S_star(i, w) = (hasReinfection ? 
+                    rs_sampler(previous_R(i, w), *generator) : 0);
+            se_sampler.setProb(p_se(i, w));
+            previous_E_star(i, w) = se_sampler(previous_S(i, w), *generator);
+
+            if (transitionType == TRANSITION_EXPONENTIAL)
             {
-                for (idx = 0; idx < DM_vec.size(); idx++)
-                {
-                    p_se += rho[idx]*(DM_vec[idx] * p_se_cache);
-                }
+                previous_I_star(i, w) = ei_sampler(previous_E(i, w), *generator);
+                previous_R_star(i, w) = ir_sampler(previous_I(i, w), *generator);
             }
-
-            if (has_ts_spatial && !TDM_empty[time_idx])
-            {   
-                for (lag = 0; time_idx - lag - 1 >= 0 && lag < (int) TDM_vec[0].size(); lag++)
-                {
-                    p_se_cache = ((I_lag[w].get(lag).cast<double>()).array()
-                        /N.cast<double>().array()*
-                        p_se_components.row(time_idx - lag - 1).transpose().array()
-                        ).unaryExpr([](double e){
-                            // Protect against overflow in components
-                            return(e == e ? e : 0);}
-                        );
-                    p_se += rho[DM_vec.size() + lag]*(TDM_vec[time_idx-lag - 1][lag] * p_se_cache);
-                }
+            else
+            {
+                previous_I_star(i, w) = E_paths[w].advance(i, nSteps,
+                        EI_path_samplers, *generator);
+                previous_R_star(i, w) = I_paths[w].advance(i, nSteps,
+                        IR_path_samplers, *generator);
             }
 
-
-            //Rcpp::Rcout << "offset(" << time_idx << "): " << offset(time_idx) << "\n";
-            p_se = ((-1.0*p_se.array() * offset(time_idx)).matrix()
-                    ).unaryExpr([](double e){return(1-std::exp(e));});
-     
-            for (i = 0; i < Y.cols(); i++)
+            if (isCumulative)
             {
-                previous_S_star(i,w) = std::binomial_distribution<int>(previous_R(i,w), p_rs(time_idx))(*generator);
-                previous_E_star(i,w) = std::binomial_distribution<int>(previous_S(i,w), p_se(i,0))(*generator);
+                cumulative_compartment(i, w) += comparison_compartment(i, w);
+                observed = cumulative_compartment(i, w);
+            }
+            else
+            {
+                observed = comparison_compartment(i, w);
+            }
 
-                if (transitionMode == "exponential")
-                {
-                    previous_I_star(i,w) = std::binomial_distribution<int>(previous_E(i,w), p_ei(time_idx))(*generator);
-                    previous_R_star(i,w) = std::binomial_distribution<int>(previous_I(i,w), p_ir(time_idx))(*generator);
-                }
-                else if (transitionMode == "path_specific")
-                {
-                    // Updating E_paths and I_paths is repetative - factor out into a function?
-                    // That might be costly, unless it's inlined...
-                    previous_I_star(i,w) = E_paths[w](E_paths[w].rows() - 1, i); // could take outside loop
-                    E_paths[w](E_paths[w].rows() -1, i) = 0;
-                    for (j = 0; j < offset(time_idx); j++)
-                    {
-                        // TODO: stop early when possible
-                        // idea: cache previous max?
-                        for (k = E_paths[w].rows() - 2; 
-                                k >= 0; k--)
-                        {
-                            if (E_paths[w](k,i) > 0)
-                            {
-                                tmpDraw = std::binomial_distribution<int>(E_paths[w](k,i), E_to_I_prior(k,5))(*generator);
-                                previous_I_star(i,w) += tmpDraw;
-                                E_paths[w](k,i) -= tmpDraw;
-                                E_paths[w](k+1, i) = E_paths[w](k,i);
-                                E_paths[w](k,i) = 0; // not needed?
-                            }
-                        }
-                    }
-                    previous_R_star(i,w) = I_paths[w](I_paths[w].rows() - 1, i); // could take outside loop
-                    I_paths[w](I_paths[w].rows() -1, i) = 0;
-                    for (j = 0; j < offset(time_idx); j++)
-                    {
-                        // TODO: stop early when possible
-                        // idea: cache previous max?
-                        for (k = I_paths[w].rows() - 2; 
-                                k >= 0; k--)
-                        {
-                            if (I_paths[w](k,i) > 0)
-                            {
-                                tmpDraw = std::binomial_distribution<int>(I_paths[w](k,i), I_to_R_prior(k,5))(*generator);
-                                previous_R_star(i,w) += tmpDraw;
-                                I_paths[w](k,i) -= tmpDraw;
-                                I_paths[w](k+1, i) = I_paths[w](k,i);
-                                I_paths[w](k,i) = 0; // not needed?
-                            }
-                        }
-                    }
-                }
-                else
+            if (!na_mask(time_idx, i))
+            {
+                if (dataModel == 1)
                 {
-                    // Updating E_paths and I_paths is repetative - factor out into a function?
-                    // That might be costly, unless it's inlined...
-                    previous_I_star(i,w) = E_paths[w](E_paths[w].rows() - 1, i); // could take outside loop
-                    E_paths[w](E_paths[w].rows() - 1, i) = 0;
-                    for (j = 0; j < offset(time_idx); j++)
-                    {
-                        // TODO: stop early when possible
-                        // idea: cache previous max?
-                        for (k = E_paths[w].rows() - 2; 
-                                k >= 0; k--)
-                        {
-                            if (E_paths[w](k,i) > 0)
-                            {
-                                tmpDraw = std::binomial_distribution<int>(
-                                        E_paths[w](k,i), 
-                                        EI_transition_dist -> getTransitionProb(k, k+1))(*generator); 
-                                previous_I_star(i,w) += tmpDraw;
-                                E_paths[w](k,i) -= tmpDraw;
-                                E_paths[w](k+1, i) = E_paths[w](k,i);
-                                E_paths[w](k,i) = 0; // not needed?
-                            }
-                        }
-                    }
-                    previous_R_star(i,w) = I_paths[w](I_paths[w].rows() - 1, i); // could take outside loop
-                    I_paths[w](I_paths[w].rows() -1, i) = 0;
-                    for (j = 0; j < offset(time_idx); j++)
-                    {
-                        // TODO: stop early when possible
-                        // idea: cache previous max?
-                        for (k = I_paths[w].rows() - 2; 
-                                k >= 0; k--)
-                        {
-                            if (I_paths[w](k,i) > 0)
-                            {
-                                tmpDraw = std::binomial_distribution<int>(
-                                        I_paths[w](k,i), 
-                                        IR_transition_dist -> getTransitionProb(k,k+1)
-                                        )(*generator); 
-                                previous_R_star(i,w) += tmpDraw;
-                                I_paths[w](k,i) -= tmpDraw;
-                                I_paths[w](k+1, i) = I_paths[w](k,i);
-                                I_paths[w](k,i) = 0; // not needed?
-                            }
-                        }
-                    }
-
+                    distance = observed + std::floor(
+                            overdispersion_distributions[w](*generator)) - 
+                        Y(time_idx, i);
                 }
-                if (cumulative)
+                else if (dataModel == 2)
                 {
-                    cumulative_compartment(i,w) += (*comparison_compartment)(i,w); 
-
-                    if (!na_mask(time_idx,i))
-                    {
-                        if (dataModelType == 1){
-                            results(w) += std::pow(std::abs((cumulative_compartment)(i,w) + 
-                                std::floor(overdispersion_distribution(*generator)) -
-                                Y(time_idx, i)), lpow);
-                        }
-                        else if (dataModelType == 2){
-                            results(w) += std::pow(std::abs(std::binomial_distribution<int>(
-                                        (cumulative_compartment)(i,w),
-                                    report_fraction)(*generator) - Y(time_idx,i)), lpow);
-                        }
-                        else{
-                            results(w) += std::pow(std::abs((cumulative_compartment)(i,w) -
-                                                   Y(time_idx, i)), lpow);
-                        }
-                    }
+                    distance = report_sampler(observed, *generator) - 
+                        Y(time_idx, i);
                 }
                 else
                 {
-                    if (!na_mask(time_idx,i))
-                    {
-                        if (dataModelType == 1){
-                            results(w) += std::pow(std::abs((*comparison_compartment)(i,w) + 
-                                std::floor(overdispersion_distribution(*generator)) -
-                                Y(time_idx, i)), lpow);
-                        }
-                        else if (dataModelType == 2){
-                            results(w) += std::pow(std::abs(std::binomial_distribution<int>(
-                                        (*comparison_compartment)(i,w),
-                                    report_fraction)(*generator) - Y(time_idx,i)), lpow);
-                        }
-                        else{
-                            results(w) += std::pow(std::abs((*comparison_compartment)(i,w) -
-                                Y(time_idx, i)), lpow);
-                        }
-                    }
-                }
-            }
-
-            if (keepCompartments)
-            {
-                for (i = 0; i < S0.size(); i++)
-                {
-                    compartmentResults.S(time_idx, i) = previous_S(i,0);
-                    compartmentResults.E(time_idx, i) = previous_E(i,0);
-                    compartmentResults.I(time_idx, i) = previous_I(i,0);
-                    compartmentResults.R(time_idx, i) = previous_R(i,0);
-
-                    compartmentResults.S_star(time_idx, i) = previous_S_star(i,0);
-                    compartmentResults.E_star(time_idx, i) = previous_E_star(i,0);
-                    compartmentResults.I_star(time_idx, i) = previous_I_star(i,0);
-                    compartmentResults.R_star(time_idx, i) = previous_R_star(i,0);
-
-                    compartmentResults.p_se.row(time_idx) = p_se.col(0);
+                    distance = observed - Y(time_idx, i);
                 }
+                results(w) += std::pow(std::abs(distance), lpow);
             }
+        }
+    }
+}
 
-            current_S.col(w) = previous_S.col(w) + previous_S_star.col(w) - previous_E_star.col(w);
-            current_E.col(w) = previous_E.col(w) + previous_E_star.col(w) - previous_I_star.col(w);
-            current_I.col(w) = previous_I.col(w) + previous_I_star.col(w) - previous_R_star.col(w);
-            current_R.col(w) = previous_R.col(w) + previous_R_star.col(w) - previous_S_star.col(w);
-
-            if (transitionMode != "exponential")
-            {
-                E_paths[w].row(0) = previous_E_star.col(w);
-                I_paths[w].row(0) = previous_I_star.col(w);
-            }
+template<int transitionType, int dataModel, bool isCumulative>
+SEIR_sim_node::stepKernel SEIR_sim_node::selectByReinfection(bool reinfection)
+{
+    return(reinfection ? 
+           &SEIR_sim_node::stepKernelImpl<transitionType, dataModel, 
+                                          isCumulative, true> :
+           &SEIR_sim_node::stepKernelImpl<transitionType, dataModel, 
+                                          isCumulative, false>);
+}
 
-            if (has_ts_spatial)
-            {
-                I_lag[w].push(previous_I.col(w));
-            }
-            previous_S.col(w) = current_S.col(w);
-            previous_E.col(w) = current_E.col(w);
-            previous_I.col(w) = current_I.col(w);
-            previous_R.col(w) = current_R.col(w);
+template<int transitionType, int dataModel>
+SEIR_sim_node::stepKernel SEIR_sim_node::selectByCumulative(bool cumulative,
+                                                            bool reinfection)
+{
+    return(cumulative ? 
+           selectByReinfection<transitionType, dataModel, true>(reinfection) :
+           selectByReinfection<transitionType, dataModel, false>(reinfection));
+}
 
-        }
-        
-        results(w) = std::pow(results(w), 1.0/lpow);
-        
+template<int transitionType>
+SEIR_sim_node::stepKernel SEIR_sim_node::selectByDataModel(int dataModel,
+                                                           bool cumulative,
+                                                           bool reinfection)
+{
+    if (dataModel == 1)
+    {
+        return(selectByCumulative<transitionType, 1>(cumulative, reinfection));
     }
-
-    compartmentResults.result = results;
-    return(compartmentResults);
+    else if (dataModel == 2)
+    {
+        return(selectByCumulative<transitionType, 2>(cumulative, reinfection));
+    }
+    return(selectByCumulative<transitionType, 0>(cumulative, reinfection));
 }
 
 void SEIR_sim_node::nodeMessage(std::string msg)
@@ -1186,6 +1274,5 @@ void SEIR_sim_node::nodeMessage(std::string msg)
 
 SEIR_sim_node::~SEIR_sim_node()
 {
-    delete generator;
 }
 
@@ -0,0 +1,481 @@
+#include <Eigen/Core>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <math.h>
+#include <abcSampler.hpp>
+#include <mpiBackend.hpp>
+#include <cudaBackend.hpp>
+
+abcSampler::abcSampler(std::shared_ptr<const simulationContext> ctx,
+                       const samplerSettings& sttngs)
+    : context(ctx), settings(sttngs), prior(ctx)
+{
+    // Set up random number provider 
+    std::minstd_rand0 lc_generator(settings.random_seed + 1);
+    std::uint_least32_t seed_data[std::mt19937::state_size];
+    std::generate_n(seed_data, std::mt19937::state_size, std::ref(lc_generator));
+    std::seed_seq q(std::begin(seed_data), std::end(seed_data));
+    generator = new std::mt19937{q};   
+
+    // Parameters are not initialized
+    is_initialized = false;
+    proposal_counter = 0;
+    start_epoch = 0;
+    start_terminated = false;
+    start_batch_accepted = 0;
+    start_batch_examined = 0;
+
+    results_double = Eigen::MatrixXd::Zero(settings.init_batch_size, 
+                                               settings.m); 
+    param_matrix = Eigen::MatrixXd::Zero(settings.init_batch_size, 
+                                            prior.nParams());
+
+    // Create the worker pool
+    worker_pool = std::unique_ptr<NodePool>(
+                new NodePool(&results_double,
+                     &results_complete,
+                     (unsigned int) settings.CPU_cores,
+                     context,
+                     settings.chunk_size,
+                     placeWorkers(settings.affinity, settings.affinity_cores,
+                                  settings.CPU_cores)
+                ));
+#ifdef ABSEIR_USE_MPI
+    if (mpiBackend::workerCount() > 0)
+    {
+        backend = std::unique_ptr<simulationBackend>(
+                new mpiBackend(context, worker_pool.get(), 
+                               settings.CPU_cores, settings.chunk_size));
+    }
+#endif
+#ifdef ABSEIR_USE_CUDA
+    if (!backend && cudaBackend::available())
+    {
+        backend = std::unique_ptr<simulationBackend>(
+                new cudaBackend(context, worker_pool.get()));
+    }
+#endif
+    if (!backend)
+    {
+        backend = std::unique_ptr<simulationBackend>(
+                new localBackend(worker_pool.get()));
+    }
+}
+
+Eigen::MatrixXd abcSampler::generateParamsPrior(int nParticles)
+{
+    Eigen::MatrixXd outParams = Eigen::MatrixXd::Zero(nParticles, 
+                                                      prior.nParams());
+    const unsigned int seed = settings.random_seed;
+    const unsigned int proposal_id = PROPOSAL_STREAM_KEY | (proposal_counter++);
+    std::vector<int> validRho(nParticles, 1);
+
+    worker_pool -> parallelFor(nParticles, [&](int start, int end){
+        philox4x32 prior_generator;
+        for (int i = start; i < end; i++)
+        {
+            // As for proposals, each particle has its own stream
+            prior_generator.seed(seed, proposal_id, i, 0);
+            validRho[i] = prior.draw(prior_generator, outParams, i);
+        }
+    });
+    for (int i = 0; i < nParticles; i++)
+    {
+        if (!validRho[i])
+        {
+            coreLog() << "Error, valid rho value not obtained\n";
+        }
+    }
+    return(outParams);
+}
+
+samplerResult abcSampler::sample(int N, simulationAction sim_type_atom,
+                                 int V)
+{
+    if (settings.algorithm == ALG_BasicABC)
+    {
+        return(sample_basic(N, V, sim_type_atom));
+    }
+    else if (settings.algorithm == ALG_ModifiedBeaumont2009)
+    {
+        return(sample_Beaumont2009(N, V, sim_type_atom));
+    }
+    else if (settings.algorithm == ALG_DelMoral2012)
+    {
+        return(sample_DelMoral2012(N, V, sim_type_atom));
+    }
+    else 
+    {
+	    if (settings.algorithm != ALG_Simulate)
+    	{
+            throw abseirError("Unknown algorithm.");
+    	}
+        if (!is_initialized)
+        {
+            throw abseirError("Model must be initialized before simulating.");
+        }
+        return(sample_Simulate(N, 0, V));
+    }
+}
+
+samplerResult abcSampler::simulate(const Eigen::MatrixXd& params, 
+                                   int replicates,
+                                   simulationAction sim_type_atom)
+{
+    if (params.cols() != param_matrix.cols())
+    {
+        throw abseirError("Number of supplied parameters does not match model specification.\n");
+    }
+    if (replicates < 1)
+    {
+        throw abseirError("At least one replicate is required.\n");
+    }
+    const int nSim = params.rows()*replicates;
+    results_double.resize(nSim, context -> m);
+    if (sim_type_atom == sim_result_atom)
+    {
+        results_complete.allocate((context -> Y).rows(),
+                                  (context -> Y).cols(),
+                                  nSim);
+    }
+    backend -> run(params, replicates, sim_type_atom, &results_double,
+                   &results_complete, std::numeric_limits<double>::infinity(),
+                   0, nullptr);
+    samplerResult out;
+    out.has_result = true;
+    out.result = results_double;
+    out.params = params;
+    if (sim_type_atom == sim_result_atom)
+    {
+        out.compartment_slots = nSim;
+    }
+    return(out);
+}
+
+void abcSampler::setCapture(int flags, bool compact)
+{
+    results_complete.setCapture(flags, compact);
+    proposed_results_complete.setCapture(flags, compact);
+}
+
+const compartmentStore& abcSampler::compartments() const
+{
+    return(results_complete);
+}
+
+const std::vector<epochTelemetry>& abcSampler::getEpochTelemetry() const
+{
+    return(epoch_telemetry);
+}
+
+std::vector<workerTelemetry> abcSampler::getWorkerTelemetry() const
+{
+    return(worker_pool -> getTelemetry());
+}
+
+double abcSampler::telemetrySeconds() const
+{
+    return(worker_pool -> telemetrySeconds());
+}
+
+int abcSampler::nextBatchSize(int needed, int accepted, int examined,
+                              long remaining) const
+{
+    const int Nsim = settings.batch_size;
+    if (!settings.adaptive_batch || examined <= 0)
+    {
+        return(Nsim);
+    }
+    // Count an empty batch as half an acceptance, so the rate stays
+    // positive, and aim a fifth over the rate so that one batch usually
+    // suffices
+    const double rate = std::max((double) accepted, 0.5)/examined;
+    double target = 1.2*needed/rate;
+    target = std::min(target, (double) (std::numeric_limits<int>::max()/2));
+    target = std::max(target, (double) Nsim);
+    const int cores = std::max(settings.CPU_cores, 1);
+    long size = ((long) std::ceil(target/cores))*cores;
+    // The batch may not run past the proposals left in the epoch, so
+    // round down instead, or run just those left if that gives none
+    if (size > remaining)
+    {
+        size = (remaining/cores)*cores;
+        if (size == 0)
+        {
+            size = remaining;
+        }
+    }
+    return((int) size);
+}
+
+void abcSampler::resetTelemetry()
+{
+    epoch_telemetry = resumed_telemetry;
+    backend -> resetTelemetry();
+}
+
+void abcSampler::recordEpoch(epochTelemetry epoch, 
+                             const phaseTimer& timer)
+{
+    long recorded = 0;
+    for (unsigned int i = resumed_telemetry.size(); 
+         i < epoch_telemetry.size(); i++)
+    {
+        recorded += epoch_telemetry[i].simulations;
+    }
+    epoch.total_seconds = timer.total();
+    epoch.simulations = (backend -> totalSimulations()) - recorded;
+    epoch_telemetry.push_back(epoch);
+}
+
+bool abcSampler::setParameters(Eigen::MatrixXd params, 
+        Eigen::VectorXd weights, Eigen::MatrixXd results, double eps)
+{
+    const bool hasReinfection = (context -> reinfection_precision)(0) > 0; 
+    const bool hasSpatial = (context -> Y).cols() > 1;                
+    std::string transitionMode = context -> transitionMode;
+    const bool estimateIVC = context -> ivc_type == 2;
+    
+    const int nBeta = (context -> X).cols();
+    const int nBetaRS = (context -> X_rs).cols()*hasReinfection;
+    const int nRho = ((context -> DM_vec).size() + 
+                      (context -> TDM_vec)[0].size())*hasSpatial;
+
+    const int nTrans = (transitionMode == "exponential" ? 2 :
+                       (transitionMode == "weibull" ? 4 : 0));
+    const int nReport = (context -> dataModelType == 2 ? 1 : 0);
+    const int nIVC = (context -> S0).size()*4;
+    const int nParams = nBeta + nBetaRS + nRho + nTrans + nReport + nIVC;
+    
+    if (params.cols() != nParams)
+    {
+        throw abseirError("Number of supplied parameters does not match model specification.\n");
+    }
+    if (params.rows() != weights.size())
+    {
+        throw abseirError("Number of weights not equal to number of particles.\n");
+    }
+
+    init_eps = eps;
+
+    init_param_matrix = params; 
+    param_matrix = params;
+
+    init_results_double = results;
+    results_double = results;
+
+    init_weights = weights;
+    is_initialized = true;
+    start_epoch = 0;
+    start_terminated = false;
+    start_batch_accepted = 0;
+    start_batch_examined = 0;
+    resumed_telemetry.clear();
+    return(true);
+}
+
+void abcSampler::writeCheckpoint(int completed_epochs, double eps,
+                                 const Eigen::VectorXd& weights,
+                                 int batch_accepted, int batch_examined,
+                                 bool terminated)
+{
+    if (settings.checkpoint_file.empty())
+    {
+        return;
+    }
+    samplerCheckpoint checkpoint;
+    checkpoint.algorithm = settings.algorithm;
+    checkpoint.completed_epochs = completed_epochs;
+    checkpoint.terminated = terminated;
+    checkpoint.proposal_counter = proposal_counter;
+    checkpoint.batch_counter = worker_pool -> batchCount();
+    checkpoint.batch_accepted = batch_accepted;
+    checkpoint.batch_examined = batch_examined;
+    checkpoint.eps = eps;
+    checkpoint.params = param_matrix;
+    checkpoint.weights = weights;
+    checkpoint.results = results_double;
+    std::ostringstream state;
+    state << *generator;
+    checkpoint.generator_state = state.str();
+    checkpoint.epochs = epoch_telemetry;
+    writeSamplerCheckpoint(settings.checkpoint_file, checkpoint);
+}
+
+int abcSampler::loadCheckpoint(const std::string& path)
+{
+    const samplerCheckpoint checkpoint = readSamplerCheckpoint(path);
+    if (checkpoint.algorithm != settings.algorithm)
+    {
+        throw abseirError("checkpoint was written by a different algorithm.\n");
+    }
+    if (checkpoint.results.cols() != settings.m)
+    {
+        throw abseirError("checkpoint does not match the m of the sampling control.\n");
+    }
+    setParameters(checkpoint.params, checkpoint.weights, 
+                  checkpoint.results, checkpoint.eps);
+    std::istringstream state(checkpoint.generator_state);
+    state >> *generator;
+    if (!state)
+    {
+        throw abseirError("checkpoint random number state is corrupt.\n");
+    }
+    proposal_counter = checkpoint.proposal_counter;
+    worker_pool -> setBatchCount(checkpoint.batch_counter);
+    start_epoch = checkpoint.completed_epochs;
+    start_terminated = checkpoint.terminated;
+    start_batch_accepted = checkpoint.batch_accepted;
+    start_batch_examined = checkpoint.batch_examined;
+    resumed_telemetry = checkpoint.epochs;
+    return(start_epoch);
+}
+
+double abcSampler::evalPrior(Eigen::VectorXd param_vector)
+{
+    const Eigen::MatrixXd params = param_vector.transpose();
+    Eigen::VectorXd logPrior(1);
+    prior.logDensity(params, 0, 1, logPrior);
+    return(std::exp(logPrior(0)));
+}
+
+Eigen::VectorXd abcSampler::evalLogPrior(const Eigen::MatrixXd& params)
+{
+    Eigen::VectorXd out(params.rows());
+    worker_pool -> parallelFor(params.rows(), [&](int start, int end){
+        prior.logDensity(params, start, end, out);
+    });
+    return(out);
+}
+
+/** Whether a Gamma density with this shape is positive at x*/
+static bool inGammaSupport(double x, double shape)
+{
+    return(std::isfinite(x) && (x > 0 || (x == 0 && shape <= 1)));
+}
+
+/** Whether a Beta(a, b) density is positive at x*/
+static bool inBetaSupport(double x, double a, double b)
+{
+    return((x > 0 && x < 1) || (x == 0 && a <= 1) || (x == 1 && b <= 1));
+}
+
+bool abcSampler::inPriorSupport(const Eigen::MatrixXd& params, 
+                                int row) const
+{
+    const bool hasReinfection = (context -> reinfection_precision)(0) > 0;
+    const bool hasSpatial = (context -> Y).cols() > 1;
+    const std::string& transitionMode = context -> transitionMode;
+    const int nBeta = (context -> X).cols();
+    const int nBetaRS = (context -> X_rs).cols()*hasReinfection;
+    const int nRho = ((context -> DM_vec).size() + 
+                      (context -> TDM_vec)[0].size())*hasSpatial;
+    int i;
+    int paramIdx = 0;
+    for (i = 0; i < nBeta + nBetaRS; i++)
+    {
+        if (!std::isfinite(params(row, paramIdx)))
+        {
+            return(false);
+        }
+        paramIdx++;
+    }
+
+    double constr = 0.0;
+    for (i = 0; i < nRho; i++)
+    {
+        constr += params(row, paramIdx);
+        if (!inBetaSupport(params(row, paramIdx), 
+                           (context -> spatial_prior)(0),
+                           (context -> spatial_prior)(1)))
+        {
+            return(false);
+        }
+        paramIdx++;
+    }
+    if (constr > 1)
+    {
+        return(false);
+    }
+
+    if (transitionMode == "exponential")
+    {
+        if (!inGammaSupport(params(row, paramIdx), 
+                    (context -> E_to_I_prior)(0,0)) ||
+            !inGammaSupport(params(row, paramIdx + 1), 
+                    (context -> I_to_R_prior)(0,0)))
+        {
+            return(false);
+        }
+        paramIdx += 2;
+    }
+    else if (transitionMode == "weibull")
+    {
+        for (i = 0; i < 4; i++)
+        {
+            // The Weibull hyperpriors are zero at zero
+            if (!(std::isfinite(params(row, paramIdx)) && 
+                  params(row, paramIdx) > 0))
+            {
+                return(false);
+            }
+            paramIdx++;
+        }
+    }
+    if (context -> dataModelType == 2)
+    {
+        const double ess = context -> report_fraction_ess;
+        const double rf = context -> report_fraction;
+        if (!inBetaSupport(params(row, paramIdx), rf*ess, (1.0 - rf)*ess))
+        {
+            return(false);
+        }
+        paramIdx++;
+    }
+
+    int sz = (context -> S0).size();
+    for (int j = 0; j < sz; j++){
+        int S = params(row, paramIdx+j);
+        int E = params(row, paramIdx+j+sz);
+        int I = params(row, paramIdx+j+2*sz);
+        int R = params(row, paramIdx+j+3*sz);
+    
+        bool validIVC = ((S >= 0 && S <= context -> S0_max(j)) &&
+                         (E >= 0 && E <= context -> E0_max(j)) &&
+                         (I >= 0 && I <= context -> I0_max(j)) &&
+                         (R >= 0 && R <= context -> R0_max(j)));
+        if (!validIVC){
+            return(false);
+        }
+    }
+    return(true);
+}
+
+void abcSampler::run_simulations(const Eigen::MatrixXd& params, 
+                                 simulationAction sim_type_atom,
+                                 Eigen::MatrixXd* results_dest,
+                                 compartmentStore* results_c_dest,
+                                 double eps_threshold,
+                                 int accept_needed,
+                                 const std::function<bool(int)>* accept)
+{
+    if (sim_type_atom == sim_result_atom)
+    {
+        results_c_dest -> allocate((context -> Y).rows(),
+                                   (context -> Y).cols(),
+                                   params.rows());
+    }
+    // The simulator accumulates distances before taking the 1/lpow root
+    const double threshold = std::pow(eps_threshold, 
+                                      settings.lpow);
+    backend -> run(params, 1, sim_type_atom, results_dest, results_c_dest,
+                   threshold, accept_needed, accept);
+}
+
+abcSampler::~abcSampler()
+{   
+    delete generator;
+}
+
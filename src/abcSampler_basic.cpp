@@ -0,0 +1,103 @@
+#include <Eigen/Core>
+#include <cmath>
+#include <math.h>
+#include <abcSampler.hpp>
+
+
+                                                                                
+std::vector<size_t> sort_indexes_eigen(Eigen::MatrixXd inMat);
+std::vector<size_t> sort_indexes_eigen_vec(Eigen::VectorXd inVec);
+
+samplerResult abcSampler::sample_basic(int nSample, int vb, 
+                                       simulationAction sim_type_atom)
+{
+    // This is set by constructor
+    const int nParams = param_matrix.cols();
+
+    // Accepted params/results are nSample size
+    results_complete.allocate((context -> Y).rows(),
+                              (context -> Y).cols(), 0);
+    results_double = Eigen::MatrixXd::Zero(nSample, 
+                                           settings.m); 
+    param_matrix = Eigen::MatrixXd::Zero(nSample, 
+                                            nParams);
+    prev_param_matrix = param_matrix;
+    // Proposals matrices are batch size
+    proposed_results_double = Eigen::MatrixXd::Zero(nSample,
+                                               settings.m); 
+    proposed_param_matrix = Eigen::MatrixXd::Zero(nSample,
+                                                  nParams);
+
+    preproposal_params = Eigen::MatrixXd::Zero(settings.init_batch_size, 
+                                               nParams);
+    preproposal_results = Eigen::MatrixXd::Zero(settings.init_batch_size, 
+                                                settings.m); 
+ 
+
+
+
+
+ 
+    const int verbose = vb;
+    if (verbose > 1)
+    {
+        coreLog() << "Starting sampler\n";
+    }
+    std::vector<size_t> reweight_idx;
+
+    int i;
+
+    if (verbose > 1)
+    {
+        if (summary_function)
+        {
+            summary_function();
+        }
+    }
+    resetTelemetry();
+    if (!is_initialized)
+    {
+        if (verbose > 1){coreLog() << "Generating starting parameters from prior\n";}
+        epochTelemetry epoch("prior");
+        phaseTimer timer;
+        // Sample parameters from their prior
+
+        preproposal_params = generateParamsPrior(settings.init_batch_size);
+        epoch.proposal_seconds += timer.lap();
+        run_simulations(preproposal_params, sim_type_atom, &preproposal_results, 
+                        &proposed_results_complete,
+                        std::numeric_limits<double>::infinity());
+        epoch.simulation_seconds += timer.lap();
+
+        std::vector<size_t> currentIndex = sort_indexes_eigen(preproposal_results); 
+        if (sim_type_atom == sim_result_atom)
+        {
+            results_complete.allocate((context -> Y).rows(),
+                                      (context -> Y).cols(),
+                                      param_matrix.rows());
+        }
+        for (i = 0; i < param_matrix.rows(); i++)
+        {
+            param_matrix.row(i) = preproposal_params.row(currentIndex[i]);
+            results_double.row(i) = preproposal_results.row(currentIndex[i]); 
+            if (sim_type_atom == sim_result_atom)
+            {
+                results_complete.copySlot(i, proposed_results_complete,
+                                          currentIndex[i]);
+            } 
+        }
+        epoch.epsilon_seconds += timer.lap();
+        epoch.accepted = param_matrix.rows();
+        recordEpoch(epoch, timer);
+    }
+    samplerResult out;
+    if (sim_type_atom == sim_result_atom)
+    {
+        out.compartment_slots = results_complete.slots();
+    }
+    out.has_result = true;
+    out.result = results_double;
+    out.params = param_matrix;
+    out.current_eps = results_double.maxCoeff() + 1.0;
+    return(out);
+}
@@ -0,0 +1,689 @@
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <math.h>
+#include <abcSampler.hpp>
+#include <particleKernelDensity.hpp>
+#include <aliasTable.hpp>
+
+
+                                                                                
+std::vector<size_t> sort_indexes_eigen(Eigen::MatrixXd inMat)                     
+{                                                                               
+        vector<size_t> idx(inMat.rows());                                           
+        for (size_t i = 0; i < idx.size(); i++)                                     
+        {                                                                           
+            idx[i] = i;                                                             
+        }                                                                           
+        std::sort(idx.begin(), idx.end(),                                           
+                         [&inMat](size_t i1, size_t i2){return(inMat(i1,0) < inMat(i2,0));});       
+        return(idx);                                                                
+}                                                                               
+
+std::vector<size_t> sort_indexes_eigen_vec(Eigen::VectorXd inVec)                     
+{                                                                               
+        vector<size_t> idx(inVec.size());                                           
+        for (size_t i = 0; i < idx.size(); i++)                                     
+        {                                                                           
+            idx[i] = i;                                                             
+        }                                                                           
+        std::sort(idx.begin(), idx.end(),                                           
+                         [&inVec](size_t i1, size_t i2){return(inVec(i1) < inVec(i2));});       
+        return(idx);                                                                
+}                                                                               
+ 
+   
+
+Eigen::MatrixXd abcSampler::perturbationCholesky(const Eigen::MatrixXd& params,
+                                                 const Eigen::VectorXd& tau,
+                                                 const Eigen::VectorXi& fixed)
+{
+    if (!settings.multivariatePerturbation)
+    {
+        return(Eigen::MatrixXd());
+    }
+    std::vector<int> free_dims;
+    for (int j = 0; j < params.cols(); j++)
+    {
+        if (!fixed(j))
+        {
+            free_dims.push_back(j);
+        }
+    }
+    const int nFree = free_dims.size();
+    Eigen::MatrixXd centred(params.rows(), nFree);
+    for (int j = 0; j < nFree; j++)
+    {
+        centred.col(j) = params.col(free_dims[j]).array() - 
+                         params.col(free_dims[j]).mean();
+    }
+    Eigen::MatrixXd cov = 2.0*(centred.transpose()*centred)/
+                          ((double) params.rows() - 1.0);
+    // Parameters with no spread perturb independently at the scale chosen
+    // for them by the sampler
+    for (int j = 0; j < nFree; j++)
+    {
+        if (cov(j,j) == 0)
+        {
+            cov.row(j).setZero();
+            cov.col(j).setZero();
+            cov(j,j) = tau(free_dims[j])*tau(free_dims[j]);
+        }
+    }
+    const Eigen::LLT<Eigen::MatrixXd> llt(cov);
+    if (llt.info() != Eigen::Success)
+    {
+        coreWarning("Singular particle covariance, using independent perturbations.");
+        return(Eigen::MatrixXd());
+    }
+    return(llt.matrixL());
+}
+
+void abcSampler::proposeParams_beaumont(Eigen::MatrixXd* outParams,
+                                        const Eigen::MatrixXd& inParams,
+                                        const aliasTable& ancestors,
+                                        const Eigen::VectorXd& tau,
+                                        const Eigen::MatrixXd& chol,
+                                        const Eigen::VectorXi& fixed)
+{
+    const int p = outParams -> cols();
+    std::vector<int> free_dims;
+    for (int j = 0; j < p; j++)
+    {
+        if (!fixed(j))
+        {
+            free_dims.push_back(j);
+        }
+    }
+    const int nFree = free_dims.size();
+    const bool correlated = chol.size() > 0;
+    const int N = outParams -> rows();
+    const unsigned int seed = settings.random_seed;
+    const unsigned int proposal_id = PROPOSAL_STREAM_KEY | (proposal_counter++);
+    // 0: valid, 1: ancestor outside the prior support, 2: no valid 
+    // perturbation found
+    std::vector<int> status(N, 0);
+    std::vector<int> ancestor(N, 0);
+
+    worker_pool -> parallelFor(N, [&](int start, int end){
+        philox4x32 proposal_generator;
+        Eigen::VectorXd z(nFree);
+        bool hasValid;
+        int i, j, itrs;
+        for (i = start; i < end; i++)
+        {
+            // Each proposal has its own stream, so proposals do not depend
+            // on how rows are split between threads.
+            proposal_generator.seed(seed, proposal_id, i, 0);
+            std::normal_distribution<double> perturbation(0.0, 1.0);
+            hasValid = false;
+            for (itrs = 0; itrs < 1000 && !hasValid; itrs++)
+            { 
+                ancestor[i] = ancestors(proposal_generator);
+                if (!inPriorSupport(inParams, ancestor[i]))
+                {
+                    status[i] = 1;
+                    break;
+                }
+                outParams -> row(i) = inParams.row(ancestor[i]); 
+                for (j = 0; j < nFree; j++)
+                {
+                    z(j) = perturbation(proposal_generator);
+                }
+                if (correlated)
+                {
+                    z = chol.triangularView<Eigen::Lower>()*z;
+                }
+                else
+                {
+                    for (j = 0; j < nFree; j++)
+                    {
+                        z(j) *= tau(free_dims[j]);
+                    }
+                }
+                for (j = 0; j < nFree; j++)
+                {
+                    (*outParams)(i,free_dims[j]) += z(j);
+                }
+                hasValid = inPriorSupport(*outParams, i);
+            }
+            if (status[i] == 0 && !hasValid)
+            {
+                status[i] = 2;
+            }
+        }
+    });
+
+    for (int i = 0; i < N; i++)
+    {
+        if (status[i] == 1)
+        {
+            coreLog() << "Starting from parameter with zero probability.\n";
+            coreLog() << "  Param: \n" << inParams.row(ancestor[i]) << "\n";
+            throw abseirError("Not a valid parameter.");
+        }
+        else if (status[i] == 2)
+        {
+            coreLog() << "Unable to generate parameters with nonzero probability.\n";
+            coreLog() << "  Param " << i << " of " << N << "\n"; 
+            coreLog() << "  Pror prob: " << (evalPrior(outParams -> row(i)));
+            coreLog() << "  Param: \n" << outParams -> row(i) << "\n";
+            throw abseirError("No parameters");
+        }
+    }
+}
+
+void abcSampler::computeImportanceWeights(
+        const Eigen::MatrixXd& proposed_params,
+        const Eigen::MatrixXd& prev_params,
+        const Eigen::VectorXd& prev_weights,
+        const Eigen::VectorXd& tau,
+        const Eigen::MatrixXd& chol,
+        const Eigen::VectorXi& fixed,
+        Eigen::VectorXd* out_weights)
+{
+    const int N = proposed_params.rows();
+    const particleKernelDensity kernel = (chol.size() > 0 ?
+        particleKernelDensity(prev_params, prev_weights, chol, fixed,
+                              settings.weight_cutoff) :
+        particleKernelDensity(prev_params, prev_weights, tau, fixed,
+                              settings.weight_cutoff));
+    Eigen::VectorXd densities(N);
+    Eigen::VectorXd logPrior(N);
+    worker_pool -> parallelFor(N, [&](int start, int end){
+        kernel.evaluate(proposed_params, start, end, densities);
+        prior.logDensity(proposed_params, start, end, logPrior);
+    });
+
+    // Weights are formed on the log scale relative to the largest, so
+    // priors too small to represent as doubles do not zero them all
+    double maxLogWeight = -std::numeric_limits<double>::infinity();
+    int i;
+    for (i = 0; i < N; i++)
+    {
+        (*out_weights)(i) = logPrior(i) - std::log(densities(i));
+        if (std::isnan((*out_weights)(i)))
+        {
+            throw abseirError("nan weights encountered.");
+        }
+        maxLogWeight = std::max(maxLogWeight, (*out_weights)(i));
+    }
+    if (!std::isfinite(maxLogWeight))
+    {
+        throw abseirError("importance weights are all zero or infinite.");
+    }
+    double wtTot = 0.0;
+    for (i = 0; i < N; i++)
+    {
+        (*out_weights)(i) = std::exp((*out_weights)(i) - maxLogWeight);
+        wtTot += (*out_weights)(i);
+    }
+    out_weights -> array() /= wtTot;
+}
+
+int abcSampler::proposeEpoch_beaumont(int Npart, double e1, 
+                                      double eps_threshold,
+                                      simulationAction sim_type_atom,
+                                      bool bounded, long maxProposals,
+                                      const Eigen::VectorXd& tau,
+                                      const Eigen::MatrixXd& chol,
+                                      const Eigen::VectorXi& fixed,
+                                      Eigen::VectorXd* w0, Eigen::VectorXd* w1,
+                                      int* batch_accepted, int* batch_examined,
+                                      int* n_batches, epochTelemetry* epoch,
+                                      phaseTimer* timer, int verbose)
+{
+    const int nParams = param_matrix.cols();
+    const bool capture = (sim_type_atom == sim_result_atom);
+    int i;
+
+    // Reorder parameters by weight. The last batch of an epoch may
+    // have fewer rows than there are particles, so the population is
+    // copied rather than staged in preproposal_params.
+    std::vector<size_t> reweight_idx = sort_indexes_eigen_vec(*w0); 
+    const Eigen::MatrixXd unordered_params = param_matrix;
+    for (i = w0 -> size()-1; i >= 0; i--){
+        (*w1)(i) = (*w0)(reweight_idx[i]);
+        param_matrix.row(i) = unordered_params.row(reweight_idx[i]);
+    }
+    *w0 = *w1;
+
+    Eigen::VectorXd cum_weights(w1 -> size());
+    cum_weights(0) = (*w1)(0);
+    for (i = 1; i < w1 -> size(); i++)
+    {
+        cum_weights(i) = (*w1)(i) + cum_weights(i-1);
+    }
+    if (std::abs(cum_weights.maxCoeff() - 1) > 1e-10)
+    {
+        coreLog() << "cumulative weight: " << cum_weights.maxCoeff() << "\n";
+        throw abseirError("particle weights do not sum to one\n");
+    }
+    const aliasTable ancestors(*w0);
+    epoch -> proposal_seconds += timer -> lap();
+
+    // Propose params and run simulations
+    int currentIdx = 0;
+    long nProposed = 0;
+    *n_batches = 0;
+
+    auto Nvec = (context -> S0) + 
+                (context -> E0) + 
+                (context -> I0) + 
+                (context -> R0); 
+    int sz = (context -> S0).size();
+
+    while (currentIdx < Npart && 
+           (!bounded || nProposed < maxProposals))
+    {
+        const int batchSize = nextBatchSize(Npart - currentIdx,
+                *batch_accepted, *batch_examined, 
+                (bounded ? maxProposals - nProposed : maxProposals));
+        if (preproposal_params.rows() != batchSize)
+        {
+            preproposal_params.resize(batchSize, nParams);
+            preproposal_results.resize(batchSize, settings.m);
+        }
+
+        // perturb parameters
+        proposeParams_beaumont(&preproposal_params, 
+                               param_matrix,
+                               ancestors,
+                               tau,
+                               chol,
+                               fixed);
+        // Hack - fix S0, which is subject to constraints
+        int startIVC = preproposal_params.cols() - sz*4;
+        for (int loc = 0; loc < sz; loc ++ ){
+            for (i = 0; i < preproposal_params.rows(); i++){
+                preproposal_params(i,startIVC + loc) = Nvec(loc) - 
+                    preproposal_params(i,startIVC + loc+sz) -
+                    preproposal_params(i,startIVC + loc+2*sz) - 
+                    preproposal_params(i,startIVC + loc+3*sz);
+            }
+        }
+        epoch -> proposal_seconds += timer -> lap();
+
+        // run simulations, abandoning those which can't reach 
+        // eps_threshold, and stopping once enough proposals have been 
+        // accepted
+        const std::function<bool(int)> accepted = [this, e1](int row){
+            return(preproposal_results(row, 0) < e1);};
+        run_simulations(preproposal_params,
+                        sim_type_atom,
+                        &preproposal_results, 
+                        (capture ? &proposed_results_complete : 
+                         &results_complete),
+                        eps_threshold,
+                        Npart - currentIdx,
+                        &accepted);
+
+       const int batchStart = currentIdx;
+       for (i = 0; i < batchSize && currentIdx < Npart; i++)
+       {
+           if (preproposal_results(i,0) < e1)
+           {
+               proposed_param_matrix.row(currentIdx) = 
+                   preproposal_params.row(i);
+               proposed_results_double.row(currentIdx) = 
+                   preproposal_results.row(i);
+               if (capture)
+               {
+                   results_complete.copySlot(currentIdx, 
+                           proposed_results_complete, i);
+               }
+               currentIdx++;
+           }
+       }
+       *batch_accepted = currentIdx - batchStart;
+       *batch_examined = i;
+       epoch -> batch_sizes.push_back(batchSize);
+       epoch -> batch_accepted.push_back(*batch_accepted);
+       if (currentIdx < Npart && verbose > 1)
+       {
+            coreLog() << "  batch " << *n_batches << ", " << currentIdx << 
+                "/" << Npart << " accepted\n";
+       }
+       (*n_batches) ++;
+       nProposed += batchSize;
+       epoch -> simulation_seconds += timer -> lap();
+    }
+    return(currentIdx);
+}
+
+samplerResult abcSampler::sample_Beaumont2009(int nSample, int vb, 
+                                              simulationAction sim_type_atom)
+{
+    // This is set by constructor
+    const int nParams = param_matrix.cols();
+
+    // Accepted params/results are nSample size
+    results_double = Eigen::MatrixXd::Zero(nSample, 
+                                           settings.m); 
+    param_matrix = Eigen::MatrixXd::Zero(nSample, 
+                                            nParams);
+    prev_param_matrix = param_matrix;
+    // Proposals matrices are batch size
+    proposed_results_double = Eigen::MatrixXd::Zero(nSample,
+                                               settings.m); 
+    proposed_param_matrix = Eigen::MatrixXd::Zero(nSample,
+                                                  nParams);
+    proposal_cache = Eigen::MatrixXd::Zero(settings.batch_size, 
+                                           nParams);
+    preproposal_params = Eigen::MatrixXd::Zero(settings.init_batch_size, 
+                                               nParams);
+    preproposal_results = Eigen::MatrixXd::Zero(settings.init_batch_size, 
+                                                settings.m); 
+ 
+    bool terminate = false;
+    const int verbose = vb;
+    if (verbose > 1)
+    {
+        coreLog() << "Starting sampler\n";
+    }
+    const int num_iterations = settings.epochs;
+    const int Nsim = settings.batch_size;
+    const int Npart = nSample;
+
+    const int maxBatches= settings.max_batches;
+    const long maxProposals = ((long) maxBatches)*Nsim;
+    // Acceptance of the last batch, from which adaptive batches are sized
+    int batch_accepted = 0;
+    int batch_examined = 0;
+
+    double e0 = std::numeric_limits<double>::infinity();
+    double e1 = std::numeric_limits<double>::infinity();
+    const bool early_rejection = settings.early_rejection;
+
+    int i;
+    int iteration;
+
+    if (verbose > 1)
+    {
+        coreLog() << "Number of iterations requested: " 
+                    << num_iterations << "\n";
+
+        if (summary_function)
+        {
+            summary_function();
+        }
+    }
+    // Step 0b: set weights to 1/N
+    Eigen::VectorXd w0 = Eigen::VectorXd::Zero(Npart).array() + 1.0/((double) Npart);
+    Eigen::VectorXd w1 = Eigen::VectorXd::Zero(Npart).array() + 1.0/((double) Npart);
+ 
+    resetTelemetry();
+    if (!is_initialized)
+    {
+        if (verbose > 1){coreLog() << "Generating starting parameters from prior\n";}
+        epochTelemetry epoch("prior");
+        phaseTimer timer;
+        // Sample parameters from their prior
+        /*
+        preproposal_params = generateParamsPrior(Nsim);
+        param_matrix = Eigen::MatrixXd::Zero(Npart, preproposal_params.cols());
+        */
+        preproposal_params = generateParamsPrior(settings.init_batch_size);
+        param_matrix = Eigen::MatrixXd::Zero(Npart, preproposal_params.cols());
+        epoch.proposal_seconds += timer.lap();
+
+        run_simulations(preproposal_params, sim_atom, &preproposal_results, 
+                        &results_complete, 
+                        std::numeric_limits<double>::infinity());
+        epoch.simulation_seconds += timer.lap();
+
+        std::vector<size_t> currentIndex = sort_indexes_eigen(preproposal_results); 
+        for (i = 0; i < param_matrix.rows(); i++)
+        {
+            param_matrix.row(i) = preproposal_params.row(currentIndex[i]);
+            results_double.row(i) = preproposal_results.row(currentIndex[i]); 
+        }
+        preproposal_params = Eigen::MatrixXd::Zero(Nsim, preproposal_params.cols());
+        preproposal_results = Eigen::MatrixXd::Zero(Nsim, 
+                                                settings.m); 
+ 
+
+        e0 = results_double.maxCoeff() + 1.0;
+        epoch.epsilon_seconds += timer.lap();
+        epoch.accepted = Npart;
+        recordEpoch(epoch, timer);
+        writeCheckpoint(0, e0, w0, batch_accepted, batch_examined, false);
+    }
+    else
+    {
+        if (verbose > 1){coreLog() << "Starting parameters provided\n";}
+        e0 = init_eps;
+        e1 = e0;
+        w0 = init_weights;
+        w1 = w0;
+        param_matrix = init_param_matrix;
+        results_double = init_results_double;
+        batch_accepted = start_batch_accepted;
+        batch_examined = start_batch_examined;
+        terminate = start_terminated;
+    }
+    // Calculate current parameter SD's
+    Eigen::VectorXd tau = 1.41421*(param_matrix.rowwise() - 
+                      (param_matrix.colwise()).mean()
+                      ).colwise().norm()/std::sqrt((double) 
+                        (param_matrix.rows())-1.0);
+
+    // Determine fixed parameters
+    Eigen::VectorXi fixed = Eigen::VectorXi::Zero(tau.size());
+    int sz = (context -> S0).size();
+    if (context -> ivc_type == 1){
+        // In this case, we have all constant parameters for IVC
+        for (i = tau.size()-1; i >= (tau.size()-sz*4); i--){
+            fixed(i) = 1;
+        }
+    } else {
+        // In this case, we need to just "fix" S0 which is deterministically
+        // related to the other compartments
+        for (i = tau.size()-sz*3-1; i >= (tau.size()-sz*4); i--){
+            fixed(i) = 1;
+        }
+
+    }
+
+    for (iteration = start_epoch; iteration < num_iterations && !terminate; 
+         iteration++)
+    {   
+
+        // Todo: figure out how to return results even if user interrupt
+        coreCheckInterrupt();       
+        epochTelemetry epoch("epoch");
+        phaseTimer timer;
+        if (verbose > 0){coreLog() << "Iteration " << iteration << " [" << 
+            results_double.minCoeff() << ", " << results_double.maxCoeff() <<
+                "]  eps: " << e0 << "\n";
+        }
+
+        // Calculating tau
+
+        tau = 1.41421*(param_matrix.rowwise() - 
+              (param_matrix.colwise()).mean()
+                ).colwise().norm()/std::sqrt((double) 
+                        (param_matrix.rows())-1.0);
+
+        for (i = 0; i < tau.size(); i++){
+            if ((tau)(i) == 0){
+                // Is this expected?
+                if (!(i >= tau.size()- (context -> S0.size())*4)){
+                    coreWarning("Degenerate particles detected!");
+                    (tau)(i) = 0.1;
+                } else if (context -> ivc_type == 1){
+                    // No pasa nada, tudo bem
+                } else {
+                    // Not worth warning about, discrete parameters be like that
+                    (tau)(i) = 1; 
+                }
+            }
+        }
+ 
+
+        if (verbose > 2)
+        {
+            coreLog() << "tau inverse: \n" << tau << "\n";
+        }
+        const Eigen::MatrixXd chol = perturbationCholesky(param_matrix, tau,
+                                                          fixed);
+        epoch.proposal_seconds += timer.lap();
+
+
+        e1 = (settings.shrinkage)*e0;
+        epoch.epsilon_seconds += timer.lap();
+
+        if (verbose > 2)
+        {
+            coreLog() << "   e1 = " << e1 << "\n";
+            coreLog() << "   w0, 1-10: ";
+            for (i = 0; i < std::min(10, (int) w1.size()); i++)
+            {
+                coreLog() << w0(i) << ", ";
+            }
+            coreLog() << "\n";
+        }
+
+        int nBatches;
+        const int currentIdx = proposeEpoch_beaumont(Npart, e1,
+                (early_rejection ? e1 : 
+                 std::numeric_limits<double>::infinity()),
+                sim_atom, true, maxProposals, tau, chol, fixed, &w0, &w1,
+                &batch_accepted, &batch_examined, &nBatches, &epoch, &timer,
+                verbose);
+        e0 = e1;
+        w0 = w1;
+        if (currentIdx + 1 < Npart)
+        {
+            if (verbose > 1)
+            {
+                coreLog() << "\n";
+                coreLog() << "Maximum batches exceeded: " << currentIdx + 1 << "/" 
+                    << Npart << " acceptances in " << nBatches << " batches of max " <<
+                    maxBatches << "\n";
+                coreLog() << "Returning last params\n";
+            }
+            proposed_param_matrix = param_matrix;
+            proposed_results_double = results_double;
+            terminate = 1;
+        }
+        else
+        {
+            computeImportanceWeights(proposed_param_matrix, param_matrix,
+                                     w0, tau, chol, fixed, &w1);
+        }
+
+        w0 = w1;
+        param_matrix = proposed_param_matrix;
+        results_double = proposed_results_double;
+        epoch.weight_seconds += timer.lap();
+        epoch.accepted = currentIdx;
+        recordEpoch(epoch, timer);
+        writeCheckpoint(iteration + 1, e0, w0, batch_accepted, 
+                        batch_examined, terminate);
+    }
+
+    samplerResult out;
+    if (sim_type_atom == sim_result_atom)
+    {
+        // Need to do an extra iteration to generate compartment data.  
+        
+        // Proposals are made as in the main loop, by proposeEpoch_beaumont,
+        // but every batch is simulated in full to fill results_complete
+        
+        coreCheckInterrupt();       
+        epochTelemetry epoch("compartments");
+        phaseTimer timer;
+        if (verbose > 0){
+            coreLog() << "Running additional iteration to capture compartments";
+        }
+
+        // Calculating tau
+        tau = 1.41421*(param_matrix.rowwise() - 
+              (param_matrix.colwise()).mean()
+                ).colwise().norm()/std::sqrt((double) 
+                        (param_matrix.rows())-1.0);
+
+        for (i = 0; i < tau.size(); i++){
+            if ((tau)(i) == 0){
+                // Is this expected?
+                if (!(i >= tau.size()- (context -> S0.size())*4)){
+                    coreWarning("Degenerate particles detected!");
+                    (tau)(i) = 0.1;
+                } else if (context -> ivc_type == 1){
+                    // No pasa nada, tudo bem
+                } else {
+                    // Not worth warning about, discrete parameters be like that
+                    coreLog() << "error!\n";
+                    (tau)(i) = 1; 
+                }
+            }
+        }
+
+        if (verbose > 2)
+        {
+            coreLog() << "tau inverse: \n" << tau << "\n";
+        }
+        const Eigen::MatrixXd chol = perturbationCholesky(param_matrix, tau,
+                                                          fixed);
+        epoch.proposal_seconds += timer.lap();
+
+        // Back off the shrinkage
+        e1 = e0/std::pow((settings.shrinkage), 2);
+        epoch.epsilon_seconds += timer.lap();
+        if (verbose > 2)
+        {
+            coreLog() << "   e1 = " << e1 << "\n";
+            coreLog() << "   w0, 1-10: ";
+            for (i = 0; i < std::min(10, (int) w1.size()); i++)
+            {
+                coreLog() << w0(i) << ", ";
+            }
+            coreLog() << "\n";
+        }
+
+        results_complete.allocate((context -> Y).rows(),
+                                  (context -> Y).cols(), Npart);
+        int nBatches;
+        const int currentIdx = proposeEpoch_beaumont(Npart, e1,
+                std::numeric_limits<double>::infinity(), sim_type_atom,
+                false, maxProposals, tau, chol, fixed, &w0, &w1,
+                &batch_accepted, &batch_examined, &nBatches, &epoch, &timer,
+                verbose);
+        e0 = e1;
+        w0 = w1;
+        if (currentIdx + 1 < Npart)
+        {
+            if (verbose > 1)
+            {
+                throw abseirError("Maximum batches exceeded, which should not occur for complete results setting. ");
+            }
+            terminate = 1;
+        }
+        else
+        {
+            computeImportanceWeights(proposed_param_matrix, param_matrix,
+                                     w0, tau, chol, fixed, &w1);
+        }
+
+
+        w0 = w1;
+        param_matrix = proposed_param_matrix;
+        results_double = proposed_results_double;
+        epoch.weight_seconds += timer.lap();
+        epoch.accepted = currentIdx;
+        recordEpoch(epoch, timer);
+        out.compartment_slots = currentIdx;
+    }
+    out.has_result = true;
+    out.result = results_double;
+    out.params = param_matrix;
+    out.has_epochs = true;
+    out.completed_epochs = iteration;
+    out.has_weights = true;
+    out.weights = w1;
+    out.current_eps = e1;
+    return(out);
+}
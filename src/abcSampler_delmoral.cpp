@@ -1,18 +1,10 @@
-#include <Rcpp.h>
 #include <Eigen/Core>
-#include <RcppEigen.h>
 #include <cmath>
 #include <math.h>
-#include <spatialSEIRModel.hpp>
-#include <dataModel.hpp>
-#include <exposureModel.hpp>
-#include <reinfectionModel.hpp>
-#include <distanceModel.hpp>
-#include <transitionPriors.hpp>
-#include <initialValueContainer.hpp>
-#include <samplingControl.hpp>
-#include <util.hpp>
-#include <SEIRSimNodes.hpp>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <abcSampler.hpp>
 
 void printMaxMin(Eigen::MatrixXd in)
 {
@@ -39,10 +31,10 @@ void printMaxMin(Eigen::MatrixXd in)
         }
         if (subMin > maxMin) maxMin = subMin;
     }
-    Rcpp::Rcout << "Max-min over m: " << maxMin << "\n";
-    Rcpp::Rcout << "Overall max:" << overallMax << "\n";
-    Rcpp::Rcout << "Overall min:" << overallMin << "\n";
-    Rcpp::Rcout << "Num NAN:" << nNan << "\n";
+    coreLog() << "Max-min over m: " << maxMin << "\n";
+    coreLog() << "Overall max:" << overallMax << "\n";
+    coreLog() << "Overall min:" << overallMin << "\n";
+    coreLog() << "Num NAN:" << nNan << "\n";
 
 }
 
@@ -72,29 +64,29 @@ Eigen::VectorXd calculate_weights_DM(double cur_e,
     }
     if (!std::isfinite(tot))
     {
-        Rcpp::Rcout << "non-finite weights encountered, rerunning calculation with debug info.\n";
-        Rcpp::Rcout << "Calculating weights at " << cur_e << " vs. " << prev_e << "\n";
+        coreLog() << "non-finite weights encountered, rerunning calculation with debug info.\n";
+        coreLog() << "Calculating weights at " << cur_e << " vs. " << prev_e << "\n";
         tot = 0.0;
 
         for (i = 0; i < eps.rows(); i++)
         {
-            Rcpp::Rcout << "i = " << i << "\n";
+            coreLog() << "i = " << i << "\n";
             num = 0.0;
             denom = 0.0;
             for (j = 0; j < M; j++)
             {
                 num += eps(i,j) < cur_e;
                 denom += eps(i,j) < prev_e;
-                Rcpp::Rcout << "eps(i,j) = " << eps(i,j) << "\n";
-                Rcpp::Rcout << " (n/d) = (" << num << "/" << denom << ")\n";
+                coreLog() << "eps(i,j) = " << eps(i,j) << "\n";
+                coreLog() << " (n/d) = (" << num << "/" << denom << ")\n";
             } 
             out_wts(i) = (num/denom*prev_wts(i));
-            Rcpp::Rcout << "out_wts(" << i << ") = " << out_wts(i) << "\n"; 
+            coreLog() << "out_wts(" << i << ") = " << out_wts(i) << "\n"; 
             tot += out_wts(i);
-            Rcpp::Rcout << "tot = " << tot << "\n";
+            coreLog() << "tot = " << tot << "\n";
         }
 
-        Rcpp::stop("non-finite weights encountered.");
+        throw abseirError("non-finite weights encountered.");
     }
     out_wts.array() /= tot;
     return(out_wts);
@@ -110,18 +102,11 @@ double ESS(Eigen::VectorXd wts)
     return(1.0/out); 
 }
 
-double eps_f(double rhs,
-             double cur_e,
-             double prev_e, 
-             Eigen::MatrixXd eps,
-             Eigen::VectorXd prev_wts)
-{
-    return(std::pow(rhs - ESS(calculate_weights_DM(cur_e, 
-                                                prev_e, 
-                                                eps, 
-                                                prev_wts)), 2.0));
-}
-
+/** Epsilon in [LB, UB] whose DelMoral2012 weights have the effective sample
+ * size closest to alpha times that of prev_wts. The weights only change as
+ * epsilon passes a distance in eps, so the distances are sorted once and
+ * swept in order, keeping running sums of the weights and their squares.
+ * Returns the middle of the best interval between distances.*/
 // [[Rcpp::export]]
 double solve_for_epsilon(double LB,
                        double UB,
@@ -130,70 +115,70 @@ double solve_for_epsilon(double LB,
                        Eigen::MatrixXd eps,
                        Eigen::VectorXd prev_wts)
 {
-    double phi = (1.0 + std::sqrt(5))/2.0; 
-    double a,b,c,d,fc,fd;
-    //double a,b,c,d,fa,fb,fc,fd;
-
-    //double proposed_e = proposed_e; 
-    /*double rhs = ESS(calculate_weights_DM(proposed_e,
-                                         prev_e, 
-                                         eps,
-                                         prev_wts))*alpha;*/
-    double rhs = ESS(prev_wts)*alpha;
-
-    a = LB;
-    c = LB;
-    b = UB;
-    d = UB;
-    //fa = eps_f(rhs, a, prev_e, eps, prev_wts);
-    //fb = eps_f(rhs, b, prev_e, eps, prev_wts);
-    bool mvLB = true;
-    bool mvUB = true;
-    int itrs = 0;
-    double diff = 100.0;
-    while (itrs < 10000 && diff > 0.5)
+    const int N = eps.rows();
+    const int M = eps.cols();
+    const double rhs = ESS(prev_wts)*alpha;
+    int i, j;
+
+    // Each replicate below epsilon adds unit_wts(i) to the weight of row i,
+    // as in calculate_weights_DM
+    Eigen::VectorXd unit_wts(N);
+    std::vector<std::pair<double, int> > sorted;
+    sorted.reserve(N*M);
+    for (i = 0; i < N; i++)
     {
-       if (mvLB)
-       {
-           c = b + (a - b)/phi; 
-           mvLB = false;
-       }
-       if (mvUB)
-       {
-           d = a + (b - a)/phi;
-           mvUB = false;
-       }
-       fc = eps_f(rhs, c, prev_e, eps, prev_wts);
-       fd = eps_f(rhs, d, prev_e, eps, prev_wts);
-
-       if (fc < fd)
-       {
-         b = d;
-         //fb = fd;
-         d = c;
-         fd = fc;
-         mvLB = true;
-       }
-       else
-       {
-         a = c;
-         //fa = fc;
-         c = d;
-         fc = fd;
-         mvUB = true;
-       }
-       diff = b-a;
-       itrs++;
+        double denom = 0.0;
+        for (j = 0; j < M; j++)
+        {
+            denom += eps(i,j) < prev_e;
+            // NaN distances are never below epsilon
+            if (!std::isnan(eps(i,j)))
+            {
+                sorted.push_back(std::make_pair(eps(i,j), i));
+            }
+        }
+        unit_wts(i) = prev_wts(i)/denom;
     }
-    /*
-    if (diff > 1e-4)
+    std::sort(sorted.begin(), sorted.end());
+
+    Eigen::VectorXi counts = Eigen::VectorXi::Zero(N);
+    double S1 = 0.0;
+    double S2 = 0.0;
+    double best = std::numeric_limits<double>::infinity();
+    double best_e = (LB + UB)/2.0;
+    double lower = -std::numeric_limits<double>::infinity();
+    unsigned int k = 0;
+    while (lower < UB)
     {
-       Rcpp::Rcout << "Warning: optimization didn't converge.\n";
-       Rcpp::Rcout << "Diff: " << diff << "\n";
+        // Weights are constant for epsilon in (lower, upper]
+        const double upper = (k < sorted.size() ? sorted[k].first : 
+                              std::numeric_limits<double>::infinity());
+        const double lo = std::max(lower, LB);
+        const double hi = std::min(upper, UB);
+        if (S2 > 0 && hi >= LB && hi > lower)
+        {
+            const double f = std::pow(rhs - S1*S1/S2, 2.0);
+            if (f < best)
+            {
+                best = f;
+                best_e = (std::isfinite(hi) ? (lo + hi)/2.0 : lo + 1.0);
+            }
+        }
+        if (k == sorted.size())
+        {
+            break;
+        }
+        for (; k < sorted.size() && sorted[k].first == upper; k++)
+        {
+            const int row = sorted[k].second;
+            const double u = unit_wts(row);
+            S1 += u;
+            S2 += u*u*(2.0*counts(row) + 1.0);
+            counts(row)++;
+        }
+        lower = upper;
     }
-    */
-    return((a+b)/2.0);
-
+    return(best_e);
 }
 
 void proposeParams(Eigen::MatrixXd* params,
@@ -214,52 +199,52 @@ void proposeParams(Eigen::MatrixXd* params,
     }
 }
 
-Rcpp::List spatialSEIRModel::sample_DelMoral2012(int nSample, int vb, 
-                                                 std::string sim_type_atom)
+samplerResult abcSampler::sample_DelMoral2012(int nSample, int vb, 
+                                              simulationAction sim_type_atom)
 {
     // This is set by constructor
     const int nParams = param_matrix.cols();
 
     // Accepted params/results are nSample size
-    results_complete = std::vector<simulationResultSet>();
     results_double = Eigen::MatrixXd::Zero(nSample, 
-                                           samplingControlInstance -> m); 
+                                           settings.m); 
     param_matrix = Eigen::MatrixXd::Zero(nSample, 
                                             nParams);
     prev_param_matrix = param_matrix;
     // Proposals matrices are batch size
-    proposed_results_double = Eigen::MatrixXd::Zero(samplingControlInstance -> batch_size, 
-                                               samplingControlInstance -> m); 
-    proposed_param_matrix = Eigen::MatrixXd::Zero(samplingControlInstance -> batch_size, 
+    proposed_results_double = Eigen::MatrixXd::Zero(settings.batch_size, 
+                                               settings.m); 
+    proposed_param_matrix = Eigen::MatrixXd::Zero(settings.batch_size, 
                                             nParams);
-    proposal_cache = Eigen::MatrixXd::Zero(samplingControlInstance -> batch_size, 
+    proposal_cache = Eigen::MatrixXd::Zero(settings.batch_size, 
                                             nParams);
-    preproposal_params = Eigen::MatrixXd::Zero(samplingControlInstance -> batch_size, 
+    preproposal_params = Eigen::MatrixXd::Zero(settings.batch_size, 
                                             nParams);
-    preproposal_results = Eigen::MatrixXd::Zero(samplingControlInstance -> batch_size, 
-                                               samplingControlInstance -> m); 
+    preproposal_results = Eigen::MatrixXd::Zero(settings.batch_size, 
+                                               settings.m); 
  
     const int verbose = vb;
     if (verbose > 1)
     {
-        Rcpp::Rcout << "Starting sampler\n";
+        coreLog() << "Starting sampler\n";
     }
-    const int num_iterations = samplingControlInstance -> epochs;
-    const int Nsim = samplingControlInstance -> batch_size;
+    const int num_iterations = settings.epochs;
+    const int Nsim = settings.batch_size;
     const int Npart = nSample;
     if (Npart != Nsim)
     {
-        Rcpp::stop("Disparate simulation and particle size temporarily disabled\n");
+        throw abseirError("Disparate simulation and particle size temporarily disabled\n");
     }
-    const int maxBatches= samplingControlInstance -> max_batches;
-    const bool hasReinfection = (reinfectionModelInstance -> 
-            betaPriorPrecision)(0) > 0;
-    const bool hasSpatial = (dataModelInstance -> Y).cols() > 1;
-
-    std::string transitionMode = transitionPriorsInstance -> mode;   
+    const int maxBatches= settings.max_batches;
+    const long maxProposals = ((long) maxBatches)*Nsim;
+    // Acceptance of the last batch, from which adaptive batches are sized
+    int batch_accepted = 0;
+    int batch_examined = 0;
 
     double e0 = std::numeric_limits<double>::infinity();
     double e1 = std::numeric_limits<double>::infinity();
+    double e_UB;
+    const bool early_rejection = settings.early_rejection;
 
     int i,j;
     int iteration;
@@ -269,31 +254,56 @@ Rcpp::List spatialSEIRModel::sample_DelMoral2012(int nSample, int vb,
 
     if (verbose > 1)
     {
-        Rcpp::Rcout << "Number of iterations requested: " 
+        coreLog() << "Number of iterations requested: " 
                     << num_iterations << "\n";
 
-        dataModelInstance -> summary();
-        exposureModelInstance -> summary();
-        reinfectionModelInstance -> summary();
-        distanceModelInstance -> summary();
-        initialValueContainerInstance -> summary();
-        samplingControlInstance -> summary();
+        if (summary_function)
+
+        {
+
+            summary_function();
+
+        }
 
     }
     
+    // Step 0b: set weights to 1/N
+    Eigen::VectorXd w0 = Eigen::VectorXd::Zero(Npart).array() + 1.0/((double) Npart);
+    Eigen::VectorXd w1 = Eigen::VectorXd::Zero(Npart).array() + 1.0/((double) Npart);
+    Eigen::VectorXd cum_weights = Eigen::VectorXd::Zero(Npart).array() + 1.0/((double) Npart);
+
+    resetTelemetry();
     if (!is_initialized)
     {
-        if (verbose > 1){Rcpp::Rcout << "Generating starting parameters from prior\n";}
+        if (verbose > 1){coreLog() << "Generating starting parameters from prior\n";}
+        epochTelemetry epoch("prior");
+        phaseTimer timer;
         // Sample parameters from their prior
         param_matrix = generateParamsPrior(Npart);
-        run_simulations(param_matrix, sim_atom, &results_double, &results_complete);
+        epoch.proposal_seconds += timer.lap();
+        run_simulations(param_matrix, sim_atom, &results_double, &results_complete,
+                        std::numeric_limits<double>::infinity());
+        epoch.simulation_seconds += timer.lap();
+        epoch.accepted = Npart;
+        recordEpoch(epoch, timer);
+        writeCheckpoint(0, e0, w0, batch_accepted, batch_examined, false);
     }
     else
     {
-        if (verbose > 1){Rcpp::Rcout << "Starting parameters provided\n";}
+        if (verbose > 1){coreLog() << "Starting parameters provided\n";}
 
         // The data in "param_matrix" is already accepted
-        // To-do: finish this clause
+        e0 = init_eps;
+        e1 = e0;
+        w0 = init_weights;
+        w1 = w0;
+        param_matrix = init_param_matrix;
+        results_double = init_results_double;
+        // Epochs which skip resampling carry these forward
+        proposed_param_matrix = param_matrix;
+        proposed_results_double = results_double;
+        batch_accepted = start_batch_accepted;
+        batch_examined = start_batch_examined;
     }
     // Calculate current parameter SD's
     Eigen::VectorXd tau = (param_matrix.rowwise() - 
@@ -301,17 +311,12 @@ Rcpp::List spatialSEIRModel::sample_DelMoral2012(int nSample, int vb,
                       ).colwise().norm()/std::sqrt((double) 
                         (param_matrix.rows())-1.0);
 
-
-
-    // Step 0b: set weights to 1/N
-    Eigen::VectorXd w0 = Eigen::VectorXd::Zero(Npart).array() + 1.0/((double) Npart);
-    Eigen::VectorXd w1 = Eigen::VectorXd::Zero(Npart).array() + 1.0/((double) Npart);
-    Eigen::VectorXd cum_weights = Eigen::VectorXd::Zero(Npart).array() + 1.0/((double) Npart);
-
-    for (iteration = 0; iteration < num_iterations; iteration++)
+    for (iteration = start_epoch; iteration < num_iterations; iteration++)
     {   
-        Rcpp::checkUserInterrupt();       
-        if (verbose > 0){Rcpp::Rcout << "Iteration " << iteration << ". e0: " << e0 << "\n";}
+        coreCheckInterrupt();       
+        epochTelemetry epoch("epoch");
+        phaseTimer timer;
+        if (verbose > 0){coreLog() << "Iteration " << iteration << ". e0: " << e0 << "\n";}
 
         // Calculating tau
 
@@ -319,34 +324,43 @@ Rcpp::List spatialSEIRModel::sample_DelMoral2012(int nSample, int vb,
               (param_matrix.colwise()).mean()
                 ).colwise().norm()/std::sqrt((double) 
                         (param_matrix.rows())-1.0);
+        epoch.proposal_seconds += timer.lap();
 
+        // With early rejection, distances at or above the previous epsilon
+        // are only lower bounds, so epsilon must not increase.
+        e_UB = results_double.maxCoeff();
+        if (early_rejection)
+        {
+            e_UB = std::max(std::min(e_UB, e0), results_double.minCoeff() + 1.0);
+        }
         e1 = solve_for_epsilon(results_double.minCoeff() + 1.0,
-                                     results_double.maxCoeff(),
+                                     e_UB,
                                      //(results_double.rowwise().minCoeff()).maxCoeff(), // Add 1?
                                      e0,
-                                     samplingControlInstance -> shrinkage,
+                                     settings.shrinkage,
                                      results_double,
                                      w0);
         w1 = calculate_weights_DM(e1,
                                e0, 
                                results_double,
                                w0);
+        epoch.epsilon_seconds += timer.lap();
         if (verbose > 2)
         {
-            Rcpp::Rcout << "   e1 = " << e1 << "\n";
-            Rcpp::Rcout << "   w0, 1-10: ";
+            coreLog() << "   e1 = " << e1 << "\n";
+            coreLog() << "   w0, 1-10: ";
             for (i = 0; i < std::min(10, (int) w1.size()); i++)
             {
-                Rcpp::Rcout << w0(i) << ", ";
+                coreLog() << w0(i) << ", ";
             }
-            Rcpp::Rcout << "\n";
+            coreLog() << "\n";
 
-            Rcpp::Rcout << "   w1 1-10:";
+            coreLog() << "   w1 1-10:";
             for (i = 0; i < std::min(10, (int) w1.size()); i++)
             {
-                Rcpp::Rcout << w1(i) << ", ";
+                coreLog() << w1(i) << ", ";
             }
-            Rcpp::Rcout << "\n";
+            coreLog() << "\n";
         }
         
         if (ESS(w1) < Npart)
@@ -380,7 +394,7 @@ Rcpp::List spatialSEIRModel::sample_DelMoral2012(int nSample, int vb,
         }
         else
         {
-            Rcpp::Rcout << "Not Resampling, ESS sufficient.\n";
+            coreLog() << "Not Resampling, ESS sufficient.\n";
             // Do nothing
         }
 
@@ -388,7 +402,7 @@ Rcpp::List spatialSEIRModel::sample_DelMoral2012(int nSample, int vb,
         {
             if (proposed_results_double.row(i).minCoeff() > e1)
             {
-                Rcpp::Rcout << "Problem: " << i << " e1=" << e1 << ", eps=" <<
+                coreLog() << "Problem: " << i << " e1=" << e1 << ", eps=" <<
                     proposed_results_double.row(i).minCoeff() << "\n";
 
             }
@@ -401,6 +415,7 @@ Rcpp::List spatialSEIRModel::sample_DelMoral2012(int nSample, int vb,
         proposal_cache = proposed_param_matrix;
         preproposal_params = proposed_param_matrix;
         preproposal_results = proposed_results_double;
+        epoch.epsilon_seconds += timer.lap();
 
         /*
         run_simulations(proposed_param_matrix, 
@@ -414,19 +429,38 @@ Rcpp::List spatialSEIRModel::sample_DelMoral2012(int nSample, int vb,
         // Until all < eps
         int currentIdx = 0;
         int nBatches = 0;
+        long nProposed = 0;
         while (currentIdx < Npart && 
-               nBatches < maxBatches)
+               nProposed < maxProposals)
         {
-           preproposal_params = proposal_cache;
+           // Batches larger than the population perturb each particle
+           // several times
+           const int batchSize = nextBatchSize(Npart - currentIdx,
+                   batch_accepted, batch_examined, maxProposals - nProposed);
+           if (preproposal_params.rows() != batchSize)
+           {
+               preproposal_params.resize(batchSize, nParams);
+               preproposal_results.resize(batchSize, settings.m);
+           }
+           for (i = 0; i < batchSize; i++)
+           {
+               preproposal_params.row(i) = proposal_cache.row(i % Npart);
+           }
            proposeParams(&preproposal_params, 
                          &tau,
                          generator);     
+           epoch.proposal_seconds += timer.lap();
 
+           const std::function<bool(int)> accepted = [this, e1](int row){
+               return(preproposal_results.row(row).minCoeff() < e1);};
            run_simulations(preproposal_params, sim_atom, &preproposal_results, 
-                   &results_complete);
+                   &results_complete, 
+                   (early_rejection ? e1 : std::numeric_limits<double>::infinity()),
+                   Npart - currentIdx, &accepted);
            auto mins = preproposal_results.rowwise().minCoeff();
 
-           for (i = 0; i < Nsim && currentIdx < Npart; i++)
+           const int batchStart = currentIdx;
+           for (i = 0; i < batchSize && currentIdx < Npart; i++)
            {
                if (mins(i) < e1)
                {
@@ -437,19 +471,27 @@ Rcpp::List spatialSEIRModel::sample_DelMoral2012(int nSample, int vb,
                    currentIdx++;
                }
            }
+           batch_accepted = currentIdx - batchStart;
+           batch_examined = i;
+           epoch.batch_sizes.push_back(batchSize);
+           epoch.batch_accepted.push_back(batch_accepted);
            if (currentIdx < Npart && verbose > 1)
            {
-                Rcpp::Rcout << "  batch " << nBatches << ", " << currentIdx << 
+                coreLog() << "  batch " << nBatches << ", " << currentIdx << 
                     "/" << Npart << " accepted\n";
            }
            nBatches ++;
+           nProposed += batchSize;
+           epoch.simulation_seconds += timer.lap();
         }
         if (currentIdx + 1 < results_double.rows())
         {
-            Rcpp::Rcout << "  " << currentIdx + 1 << "/" 
+            coreLog() << "  " << currentIdx + 1 << "/" 
                 << Npart << " acceptances in " << nBatches << " batches\n";
-            // Fill in rest of matrix
-            for (i = currentIdx; i < Npart; i++)
+            // Fill in rest of matrix. Rows past the last batch, which
+            // may be smaller than the population, keep their particles.
+            for (i = currentIdx; i < Npart && 
+                 i < preproposal_params.rows(); i++)
             {
                 proposed_results_double.row(i) = preproposal_results.row(i);
                 proposed_param_matrix.row(i) = preproposal_params.row(i);
@@ -458,12 +500,14 @@ Rcpp::List spatialSEIRModel::sample_DelMoral2012(int nSample, int vb,
 
         int numAccept = 0;
         int numNan = 0;
-        double acc_ratio, num, denom, pn, pd;
+        double acc_ratio, num, denom;
+        // Prior ratios are taken on the log scale, so that they stay
+        // defined when both priors underflow
+        const Eigen::VectorXd lpn = evalLogPrior(proposed_param_matrix);
+        const Eigen::VectorXd lpd = evalLogPrior(param_matrix);
         // Nsim == Npart for following code
         for (i = 0; i < Nsim; i++)
         {
-            pn = evalPrior(proposed_param_matrix.row(i));
-            pd = evalPrior(param_matrix.row(i));
             num = 0.0;
             denom = 0.0;
 
@@ -472,13 +516,7 @@ Rcpp::List spatialSEIRModel::sample_DelMoral2012(int nSample, int vb,
                 num += (proposed_results_double(i,j) < e1);
                 denom += (results_double(i,j) < e1);
             }
-            num = num;
-            denom = denom;
-
-            num *= pn;
-            denom *= pd;
-
-            acc_ratio = num/denom;
+            acc_ratio = num*std::exp(lpn(i) - lpd(i))/denom;
             drw = U(*generator);
             if (std::isnan(acc_ratio))
             {
@@ -499,63 +537,28 @@ Rcpp::List spatialSEIRModel::sample_DelMoral2012(int nSample, int vb,
 
         if (numAccept == 0)
         {
-            Rcpp::Rcout << "WARNING: THE SAMPLER COLLAPSED.\n"; 
+            coreLog() << "WARNING: THE SAMPLER COLLAPSED.\n"; 
         }
         if (verbose > 2)
         {
-            Rcpp::Rcout << "    MCMC Step Complete. " << numAccept << " accepted\n";
+            coreLog() << "    MCMC Step Complete. " << numAccept << " accepted\n";
         }
         e0 = e1;
         w0 = w1;
+        epoch.weight_seconds += timer.lap();
+        epoch.accepted = currentIdx;
+        recordEpoch(epoch, timer);
+        writeCheckpoint(iteration + 1, e0, w0, batch_accepted, 
+                        batch_examined, false);
     }
 
-    // Todo: keep an eye on this object handling. It may have unreasonable
-    // overhead, and is kind of complex.  
-    Rcpp::List outList;
-    if (sim_type_atom == sim_result_atom)
-    {
-        // keep_samples indicates a debug mode, so don't worry if we can't make
-        // a regular data frame from the list.
-        for (i = 0; i < (int) results_complete.size(); i++)
-        {
-            Rcpp::List subList;
-            subList["S"] = Rcpp::wrap(results_complete[i].S);
-            subList["E"] = Rcpp::wrap(results_complete[i].E);
-            subList["I"] = Rcpp::wrap(results_complete[i].I);
-            subList["R"] = Rcpp::wrap(results_complete[i].R);
-
-            subList["S_star"] = Rcpp::wrap(results_complete[i].S_star);
-            subList["E_star"] = Rcpp::wrap(results_complete[i].E_star);
-            subList["I_star"] = Rcpp::wrap(results_complete[i].I_star);
-            subList["R_star"] = Rcpp::wrap(results_complete[i].R_star);
-            subList["p_se"] = Rcpp::wrap(results_complete[i].p_se);
-            // We p_ei and p_ir not generally defined in non-exponential case.  
-            if (transitionMode == "exponential")
-            {
-                subList["p_ei"] = Rcpp::wrap(results_complete[i].p_ei);
-                subList["p_ir"] = Rcpp::wrap(results_complete[i].p_ir);
-            }
-
-            if (hasSpatial)
-            {
-                subList["rho"] = Rcpp::wrap(results_complete[i].rho);
-            }
-            subList["beta"] = Rcpp::wrap(results_complete[i].beta);
-            subList["X"] = Rcpp::wrap(results_complete[i].X);
-            if (hasReinfection)
-            {
-                // TODO: output reinfection info
-            }
-            subList["result"] = Rcpp::wrap(results_complete[i].result);
-            outList[std::to_string(i)] = subList;
-        }
-    }
-    else if (sim_type_atom == sim_atom)
-    {
-        outList["result"] = Rcpp::wrap(results_double);
-    }
-    outList["params"] = Rcpp::wrap(param_matrix);
-    outList["completedEpochs"] = iteration;
-    outList["currentEps"] = e1;
-    return(outList);
+    // Only sim_atom batches are run, so there are no compartments to return
+    samplerResult out;
+    out.has_result = (sim_type_atom == sim_atom);
+    out.result = results_double;
+    out.params = param_matrix;
+    out.has_epochs = true;
+    out.completed_epochs = iteration;
+    out.current_eps = e1;
+    return(out);
 }
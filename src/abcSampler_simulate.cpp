@@ -0,0 +1,43 @@
+#include <Eigen/Core>
+#include <cmath>
+#include <math.h>
+#include <abcSampler.hpp>
+
+samplerResult abcSampler::sample_Simulate(int nSample, 
+                                          int enforceEps,
+                                          int verbose) 
+{
+
+    double eps = init_eps;
+    if (!is_initialized)
+    {
+        throw abseirError("Simulation requires initialized parameters");
+    }
+
+    int Naccept = 0;
+    int batch;
+    int i;
+    settings.m = 1;
+    results_double = Eigen::MatrixXd::Zero(param_matrix.rows(), 1);
+
+    for (batch = 0; batch < settings.max_batches &&
+            Naccept < nSample; batch ++)
+    {
+        run_simulations(param_matrix, 
+                        sim_result_atom,
+                        &results_double,
+                        &results_complete,
+                        std::numeric_limits<double>::infinity()); 
+        // Compartments of row i are in slot i
+        for (i = 0; i < results_double.rows() && Naccept < nSample; i++)
+        {
+            Naccept += (enforceEps == 0 || results_double(i,0) < eps);
+        }
+    }
+
+    // keep_samples indicates a debug mode, so don't worry if we can't make
+    // a regular data frame from the list.
+    samplerResult out;
+    out.compartment_slots = results_complete.slots();
+    return(out);
+}
@@ -0,0 +1,51 @@
+#include <aliasTable.hpp>
+
+aliasTable::aliasTable(const Eigen::VectorXd& weights)
+{
+    const int N = weights.size();
+    const double total = weights.sum();
+    int i, s, l;
+    prob = std::vector<double>(N, 1.0);
+    alias = std::vector<int>(N);
+    std::vector<double> scaled(N);
+    std::vector<int> small, large;
+    for (i = 0; i < N; i++)
+    {
+        alias[i] = i;
+        scaled[i] = weights(i)*N/total;
+        if (scaled[i] < 1.0)
+        {
+            small.push_back(i);
+        }
+        else
+        {
+            large.push_back(i);
+        }
+    }
+    while (!small.empty() && !large.empty())
+    {
+        s = small.back();
+        small.pop_back();
+        l = large.back();
+        prob[s] = scaled[s];
+        alias[s] = l;
+        scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+        if (scaled[l] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Whatever remains is one up to rounding error, and keeps prob = 1
+}
+
+int aliasTable::operator()(philox4x32& generator) const
+{
+    // 53 bit uniform on [0, 1)
+    const double hi = (generator() >> 5);
+    const double lo = (generator() >> 6);
+    const double u = (hi*67108864.0 + lo)*(1.0/9007199254740992.0);
+    const double x = u*prob.size();
+    const int i = (int) x;
+    return((x - i) < prob[i] ? i : alias[i]);
+}
@@ -0,0 +1,90 @@
+#include <batchSimulation.hpp>
+
+bool batchModelData::supports(const simulationContext& context)
+{
+    for (unsigned int i = 0; i < context.DM_vec.size(); i++)
+    {
+        if (context.DM_vec[i].isSingle())
+        {
+            return(false);
+        }
+    }
+    return((context.transitionMode == "exponential" ||
+            context.transitionMode == "weibull") &&
+           (context.dataModelType == 0 || context.dataModelType == 2) &&
+           context.TDM_vec[0].size() == 0);
+}
+
+batchModelData::batchModelData(const simulationContext& context)
+{
+    const int nTpt = context.Y.rows();
+    const int nLoc = context.Y.cols();
+    const bool weibull = (context.transitionMode == "weibull");
+    int i, j, k;
+
+    model.nTpt = nTpt;
+    model.nLoc = nLoc;
+    model.m = context.m;
+    model.transition_type = (weibull ? TRANSITION_WEIBULL :
+                             TRANSITION_EXPONENTIAL);
+    model.data_model = context.dataModelType;
+    model.data_compartment = context.data_compartment;
+    model.cumulative = context.cumulative;
+    model.has_reinfection = (context.reinfection_precision(0) > 0);
+    model.has_spatial = (nLoc > 1);
+    model.nBeta = context.X.cols();
+    model.nReinf = (model.has_reinfection ? context.X_rs.cols() : 0);
+    model.nRho = (model.has_spatial ? context.DM_vec.size() : 0);
+    model.nTrans = (weibull ? 4 : 2);
+    model.nReport = (context.dataModelType == 2 ? 1 : 0);
+    model.EI_bins = (weibull ? (int) context.E_to_I_prior(4, 0) : 0);
+    model.IR_bins = (weibull ? (int) context.I_to_R_prior(4, 0) : 0);
+    model.random_seed = context.random_seed;
+    model.lpow = context.lpow;
+    model.approx_threshold = context.binomial_approx_threshold;
+
+    offset.assign(context.offset.data(),
+                  context.offset.data() + context.offset.size());
+    Y.assign(context.Y.data(), context.Y.data() + context.Y.size());
+    na_mask.resize(context.na_mask.size());
+    for (i = 0; i < (int) na_mask.size(); i++)
+    {
+        na_mask[i] = context.na_mask.data()[i];
+    }
+    X.assign(context.X.data(), context.X.data() + context.X.size());
+    X_rs.assign(context.X_rs.data(),
+                context.X_rs.data() + context.X_rs.size());
+
+    // Distance matrices in compressed sparse row form, with the non-zero
+    // entries of a row in column order
+    dm_row_start.clear();
+    dm_cols.clear();
+    dm_values.clear();
+    for (k = 0; k < model.nRho; k++)
+    {
+        const Eigen::MatrixXd dense = context.DM_vec[k].toDense();
+        for (i = 0; i < nLoc; i++)
+        {
+            dm_row_start.push_back(dm_cols.size());
+            for (j = 0; j < nLoc; j++)
+            {
+                if (dense(i, j) != 0)
+                {
+                    dm_cols.push_back(j);
+                    dm_values.push_back(dense(i, j));
+                }
+            }
+        }
+        dm_row_start.push_back(dm_cols.size());
+    }
+
+    model.offset = offset.data();
+    model.Y = Y.data();
+    model.na_mask = na_mask.data();
+    model.X = X.data();
+    model.X_rs = X_rs.data();
+    model.X_rs_rows = context.X_rs.rows();
+    model.dm_row_start = dm_row_start.data();
+    model.dm_cols = dm_cols.data();
+    model.dm_values = dm_values.data();
+}
@@ -0,0 +1,213 @@
+#include <compartmentStore.hpp>
+#include <SEIRSimNodes.hpp>
+#include <algorithm>
+#include <limits>
+
+/** Integer compartment c of a result, in CAPTURE_* order*/
+static const Eigen::MatrixXi& compartmentOf(const simulationResultSet& result,
+                                            int c)
+{
+    switch (c)
+    {
+        case 0: return(result.S);
+        case 1: return(result.E);
+        case 2: return(result.I);
+        case 3: return(result.R);
+        case 4: return(result.S_star);
+        case 5: return(result.E_star);
+        case 6: return(result.I_star);
+        default: return(result.R_star);
+    }
+}
+
+compartmentStore::compartmentStore() : overflow(false)
+{
+    capture_flags = CAPTURE_ALL;
+    compact = false;
+    nTpt = 0;
+    nLoc = 0;
+    nSim = 0;
+    wide = std::vector<std::vector<int> >(CAPTURE_N_COMPARTMENTS);
+    narrow = std::vector<std::vector<int16_t> >(CAPTURE_N_COMPARTMENTS);
+}
+
+void compartmentStore::setCapture(int flags, bool cmpct)
+{
+    capture_flags = flags;
+    compact = cmpct;
+    for (int c = 0; c < CAPTURE_N_COMPARTMENTS; c++)
+    {
+        std::vector<int>().swap(wide[c]);
+        std::vector<int16_t>().swap(narrow[c]);
+    }
+    std::vector<double>().swap(p_se);
+    nSim = 0;
+}
+
+void compartmentStore::allocate(int tpt, int loc, int sims)
+{
+    nTpt = tpt;
+    nLoc = loc;
+    nSim = sims;
+    overflow = false;
+    const size_t blockSize = ((size_t) nTpt)*nLoc*nSim;
+    for (int c = 0; c < CAPTURE_N_COMPARTMENTS; c++)
+    {
+        if (!keeps(1 << c))
+        {
+            continue;
+        }
+        if (compact)
+        {
+            narrow[c].resize(blockSize);
+        }
+        else
+        {
+            wide[c].resize(blockSize);
+        }
+    }
+    if (keeps(CAPTURE_P_SE))
+    {
+        p_se.resize(blockSize);
+    }
+    result.resize(nSim);
+    beta.resize(nSim);
+    rho.resize(nSim);
+    p_ei.resize(nSim);
+    p_ir.resize(nSim);
+}
+
+void compartmentStore::store(int sim_idx, const simulationResultSet& rslt)
+{
+    const size_t slotSize = ((size_t) nTpt)*nLoc;
+    const size_t offset = slotSize*sim_idx;
+    int c;
+    size_t i;
+    for (c = 0; c < CAPTURE_N_COMPARTMENTS; c++)
+    {
+        if (!keeps(1 << c))
+        {
+            continue;
+        }
+        const int* src = compartmentOf(rslt, c).data();
+        if (compact)
+        {
+            int16_t* dest = narrow[c].data() + offset;
+            bool clamped = false;
+            for (i = 0; i < slotSize; i++)
+            {
+                const int value = std::min<int>(std::max<int>(src[i],
+                            std::numeric_limits<int16_t>::min()),
+                            std::numeric_limits<int16_t>::max());
+                clamped = clamped || (value != src[i]);
+                dest[i] = (int16_t) value;
+            }
+            if (clamped)
+            {
+                overflow = true;
+            }
+        }
+        else
+        {
+            std::copy(src, src + slotSize, wide[c].data() + offset);
+        }
+    }
+    if (keeps(CAPTURE_P_SE))
+    {
+        std::copy(rslt.p_se.data(), rslt.p_se.data() + slotSize,
+                  p_se.data() + offset);
+    }
+    result[sim_idx] = rslt.result;
+    beta[sim_idx] = rslt.beta;
+    rho[sim_idx] = rslt.rho;
+    p_ei[sim_idx] = rslt.p_ei;
+    p_ir[sim_idx] = rslt.p_ir;
+}
+
+void compartmentStore::copySlot(int dest_idx,
+                                const compartmentStore& src,
+                                int src_idx)
+{
+    const size_t slotSize = ((size_t) nTpt)*nLoc;
+    const size_t destOffset = slotSize*dest_idx;
+    const size_t srcOffset = slotSize*src_idx;
+    for (int c = 0; c < CAPTURE_N_COMPARTMENTS; c++)
+    {
+        if (!keeps(1 << c))
+        {
+            continue;
+        }
+        if (compact)
+        {
+            std::copy(src.narrow[c].begin() + srcOffset,
+                      src.narrow[c].begin() + srcOffset + slotSize,
+                      narrow[c].begin() + destOffset);
+        }
+        else
+        {
+            std::copy(src.wide[c].begin() + srcOffset,
+                      src.wide[c].begin() + srcOffset + slotSize,
+                      wide[c].begin() + destOffset);
+        }
+    }
+    if (keeps(CAPTURE_P_SE))
+    {
+        std::copy(src.p_se.begin() + srcOffset,
+                  src.p_se.begin() + srcOffset + slotSize,
+                  p_se.begin() + destOffset);
+    }
+    if (src.overflowed())
+    {
+        overflow = true;
+    }
+    result[dest_idx] = src.result[src_idx];
+    beta[dest_idx] = src.beta[src_idx];
+    rho[dest_idx] = src.rho[src_idx];
+    p_ei[dest_idx] = src.p_ei[src_idx];
+    p_ir[dest_idx] = src.p_ir[src_idx];
+}
+
+void compartmentStore::copyCompartment(int c, int first, int n, int* out) const
+{
+    const size_t slotSize = ((size_t) nTpt)*nLoc;
+    const size_t begin = slotSize*first;
+    const size_t end = begin + slotSize*n;
+    if (compact)
+    {
+        std::copy(narrow[c].begin() + begin, narrow[c].begin() + end, out);
+    }
+    else
+    {
+        std::copy(wide[c].begin() + begin, wide[c].begin() + end, out);
+    }
+}
+
+const double* compartmentStore::pSE(int sim_idx) const
+{
+    return(p_se.data() + ((size_t) nTpt)*nLoc*sim_idx);
+}
+
+bool compartmentStore::keeps(int flag) const
+{
+    return((capture_flags & flag) != 0);
+}
+
+bool compartmentStore::overflowed() const
+{
+    return(overflow);
+}
+
+int compartmentStore::slots() const
+{
+    return(nSim);
+}
+
+int compartmentStore::tpt() const
+{
+    return(nTpt);
+}
+
+int compartmentStore::locations() const
+{
+    return(nLoc);
+}
@@ -0,0 +1,42 @@
+#include <coreError.hpp>
+#include <iostream>
+
+static messageHandler log_handler = [](const std::string& msg){
+    std::cout << msg << std::flush;};
+static messageHandler warning_handler = [](const std::string& msg){
+    std::cerr << "Warning: " << msg << "\n";};
+static std::function<void()> interrupt_handler = [](){};
+
+void setLogHandler(const messageHandler& handler)
+{
+    log_handler = handler;
+}
+
+void setWarningHandler(const messageHandler& handler)
+{
+    warning_handler = handler;
+}
+
+void setInterruptHandler(const std::function<void()>& handler)
+{
+    interrupt_handler = handler;
+}
+
+void coreWarning(const std::string& msg)
+{
+    warning_handler(msg);
+}
+
+void coreCheckInterrupt()
+{
+    interrupt_handler();
+}
+
+coreLogStream::~coreLogStream()
+{
+    const std::string msg = buffer.str();
+    if (!msg.empty())
+    {
+        log_handler(msg);
+    }
+}
@@ -0,0 +1,268 @@
+#include <cudaBackend.hpp>
+
+#ifdef ABSEIR_USE_CUDA
+
+#include <algorithm>
+#include <cuda_runtime.h>
+
+/** Threads per block of simulateBatchKernel*/
+#define CUDA_BLOCK_SIZE 128
+
+namespace
+{
+    void cudaCheck(cudaError_t status, const char* what)
+    {
+        if (status != cudaSuccess)
+        {
+            throw abseirError(std::string("CUDA error in ") + what + ": " +
+                              cudaGetErrorString(status));
+        }
+    }
+
+    /** Simulate output rows [first, first + n) of a batch, row i using
+     * parameter row i/replicates and the random streams of particle i.
+     * Each of the nThreads threads has its own workspace and takes every
+     * nThreads-th row.*/
+    __global__ void simulateBatchKernel(batchModel model,
+                                        const double* params,
+                                        int nParams,
+                                        int first,
+                                        int n,
+                                        int replicates,
+                                        double threshold,
+                                        unsigned int batch_id,
+                                        batchWorkspace workspace,
+                                        int nThreads,
+                                        double* results,
+                                        int nOut)
+    {
+        const int thread = blockIdx.x*blockDim.x + threadIdx.x;
+        if (thread >= nThreads)
+        {
+            return;
+        }
+        batchWorkspace ws;
+        ws.ints = workspace.ints + ((size_t) thread)*batchIntWorkspace(model);
+        ws.doubles = workspace.doubles +
+            ((size_t) thread)*batchDoubleWorkspace(model);
+        ws.samplers = workspace.samplers +
+            ((size_t) thread)*batchSamplerWorkspace(model);
+        ws.generators = workspace.generators + ((size_t) thread)*model.m;
+        for (int row = thread; row < n; row += nThreads)
+        {
+            const int i = first + row;
+            simulateParticle(model, params + ((size_t) (i/replicates))*nParams,
+                             threshold, batch_id, i, ws, results + i, nOut);
+        }
+    }
+}
+
+cudaBackend::cudaBackend(std::shared_ptr<const simulationContext> context,
+                         NodePool* pl)
+    : pool(pl), local(pl), supported(batchModelData::supports(*context)),
+      host_data(*context), device_model(host_data.model),
+      nParams(0), device_params(nullptr), params_capacity(0),
+      device_results(nullptr), results_capacity(0), workspace_threads(0),
+      max_threads(0), device_simulations(0)
+{
+    device_workspace.ints = nullptr;
+    device_workspace.doubles = nullptr;
+    device_workspace.samplers = nullptr;
+    device_workspace.generators = nullptr;
+    if (!supported)
+    {
+        return;
+    }
+    device_model.offset = (const double*) upload(host_data.offset.data(),
+            host_data.offset.size()*sizeof(double));
+    device_model.Y = (const int*) upload(host_data.Y.data(),
+            host_data.Y.size()*sizeof(int));
+    device_model.na_mask = (const unsigned char*) upload(
+            host_data.na_mask.data(), host_data.na_mask.size());
+    device_model.X = (const double*) upload(host_data.X.data(),
+            host_data.X.size()*sizeof(double));
+    device_model.X_rs = (const double*) upload(host_data.X_rs.data(),
+            host_data.X_rs.size()*sizeof(double));
+    device_model.dm_row_start = (const int*) upload(
+            host_data.dm_row_start.data(),
+            host_data.dm_row_start.size()*sizeof(int));
+    device_model.dm_cols = (const int*) upload(host_data.dm_cols.data(),
+            host_data.dm_cols.size()*sizeof(int));
+    device_model.dm_values = (const double*) upload(
+            host_data.dm_values.data(),
+            host_data.dm_values.size()*sizeof(double));
+
+    // Run as many threads as the device holds at once, unless their
+    // workspaces would take more than half of the free memory
+    int device;
+    cudaDeviceProp properties;
+    size_t free_bytes, total_bytes;
+    cudaCheck(cudaGetDevice(&device), "cudaGetDevice");
+    cudaCheck(cudaGetDeviceProperties(&properties, device),
+              "cudaGetDeviceProperties");
+    cudaCheck(cudaMemGetInfo(&free_bytes, &total_bytes), "cudaMemGetInfo");
+    const size_t thread_bytes =
+        batchIntWorkspace(device_model)*sizeof(int) +
+        batchDoubleWorkspace(device_model)*sizeof(double) +
+        batchSamplerWorkspace(device_model)*sizeof(binomialSampler) +
+        device_model.m*sizeof(philox4x32);
+    const size_t resident = ((size_t) properties.multiProcessorCount)*
+        properties.maxThreadsPerMultiProcessor;
+    max_threads = (int) std::max((size_t) 1,
+            std::min(resident, free_bytes/2/thread_bytes));
+
+    workspace_threads = max_threads;
+    cudaCheck(cudaMalloc((void**) &(device_workspace.ints),
+                ((size_t) workspace_threads)*
+                batchIntWorkspace(device_model)*sizeof(int)), "cudaMalloc");
+    cudaCheck(cudaMalloc((void**) &(device_workspace.doubles),
+                ((size_t) workspace_threads)*
+                batchDoubleWorkspace(device_model)*sizeof(double)),
+              "cudaMalloc");
+    cudaCheck(cudaMalloc((void**) &(device_workspace.samplers),
+                ((size_t) workspace_threads)*
+                batchSamplerWorkspace(device_model)*sizeof(binomialSampler)),
+              "cudaMalloc");
+    cudaCheck(cudaMalloc((void**) &(device_workspace.generators),
+                ((size_t) workspace_threads)*
+                device_model.m*sizeof(philox4x32)), "cudaMalloc");
+}
+
+cudaBackend::~cudaBackend()
+{
+    for (unsigned int i = 0; i < device_arrays.size(); i++)
+    {
+        cudaFree(device_arrays[i]);
+    }
+    cudaFree(device_params);
+    cudaFree(device_results);
+    cudaFree(device_workspace.ints);
+    cudaFree(device_workspace.doubles);
+    cudaFree(device_workspace.samplers);
+    cudaFree(device_workspace.generators);
+}
+
+bool cudaBackend::available()
+{
+    int count;
+    return(cudaGetDeviceCount(&count) == cudaSuccess && count > 0);
+}
+
+void* cudaBackend::upload(const void* data, size_t n)
+{
+    if (n == 0)
+    {
+        return(nullptr);
+    }
+    void* out;
+    cudaCheck(cudaMalloc(&out, n), "cudaMalloc");
+    device_arrays.push_back(out);
+    cudaCheck(cudaMemcpy(out, data, n, cudaMemcpyHostToDevice),
+              "cudaMemcpy");
+    return(out);
+}
+
+void cudaBackend::reserve(int nParamRows, int nOut)
+{
+    const size_t param_size = ((size_t) nParamRows)*nParams;
+    const size_t result_size = ((size_t) nOut)*device_model.m;
+    if (param_size > params_capacity)
+    {
+        cudaFree(device_params);
+        device_params = nullptr;
+        cudaCheck(cudaMalloc((void**) &device_params,
+                             param_size*sizeof(double)), "cudaMalloc");
+        params_capacity = param_size;
+    }
+    if (result_size > results_capacity)
+    {
+        cudaFree(device_results);
+        device_results = nullptr;
+        cudaCheck(cudaMalloc((void**) &device_results,
+                             result_size*sizeof(double)), "cudaMalloc");
+        results_capacity = result_size;
+    }
+}
+
+void cudaBackend::launch(int first, int n, int nOut, int replicates,
+                         double threshold, unsigned int batch_id)
+{
+    const int nThreads = std::min(n, max_threads);
+    const int nBlocks = (nThreads + CUDA_BLOCK_SIZE - 1)/CUDA_BLOCK_SIZE;
+    simulateBatchKernel<<<nBlocks, CUDA_BLOCK_SIZE>>>(device_model,
+            device_params, nParams, first, n, replicates, threshold,
+            batch_id, device_workspace, nThreads, device_results, nOut);
+    cudaCheck(cudaGetLastError(), "simulateBatchKernel");
+    cudaCheck(cudaDeviceSynchronize(), "simulateBatchKernel");
+}
+
+void cudaBackend::run(const Eigen::MatrixXd& params,
+                      int replicates,
+                      simulationAction sim_type_atom,
+                      Eigen::MatrixXd* results_dest,
+                      compartmentStore* results_c_dest,
+                      double threshold,
+                      int accept_needed,
+                      const std::function<bool(int)>* accept)
+{
+    if (sim_type_atom == sim_result_atom || !supported)
+    {
+        local.run(params, replicates, sim_type_atom, results_dest,
+                  results_c_dest, threshold, accept_needed, accept);
+        return;
+    }
+    const int nOut = params.rows()*replicates;
+    if (nOut == 0)
+    {
+        return;
+    }
+    const unsigned int batch_id = pool -> reserveBatch();
+    nParams = params.cols();
+    reserve(params.rows(), nOut);
+    // Each device thread reads whole parameter rows
+    const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic,
+          Eigen::RowMajor> row_params = params;
+    cudaCheck(cudaMemcpy(device_params, row_params.data(),
+                         row_params.size()*sizeof(double),
+                         cudaMemcpyHostToDevice), "cudaMemcpy");
+
+    // Without an acceptance test the batch is a single launch. Otherwise
+    // rows are simulated in waves which fill the device, as in
+    // NodePool::enqueueUntil stopping once the leading rows hold enough
+    // acceptances.
+    const int wave = (accept == nullptr ? nOut : max_threads);
+    int nAccepted = 0;
+    int first, i, w;
+    for (first = 0; first < nOut &&
+         (accept == nullptr || nAccepted < accept_needed); first += wave)
+    {
+        const int n = std::min(wave, nOut - first);
+        launch(first, n, nOut, replicates, threshold, batch_id);
+        for (w = 0; w < device_model.m; w++)
+        {
+            cudaCheck(cudaMemcpy(results_dest -> data() +
+                                 ((size_t) w)*(results_dest -> rows()) + first,
+                                 device_results + ((size_t) w)*nOut + first,
+                                 n*sizeof(double), cudaMemcpyDeviceToHost),
+                      "cudaMemcpy");
+        }
+        device_simulations += n;
+        for (i = first; accept != nullptr && i < first + n; i++)
+        {
+            nAccepted += (*accept)(i);
+        }
+    }
+}
+
+void cudaBackend::resetTelemetry()
+{
+    device_simulations = 0;
+    pool -> resetTelemetry();
+}
+
+long cudaBackend::totalSimulations() const
+{
+    return(device_simulations + pool -> totalSimulations());
+}
+
+#endif
@@ -0,0 +1,104 @@
+#include <distanceMatrix.hpp>
+
+distanceMatrix::distanceMatrix(const Eigen::MatrixXd& inMat, int storageMode,
+                               int precision)
+{
+    nnz = (inMat.array() != 0.0).count();
+    const double density = (inMat.size() > 0 ?
+            ((double) nnz)/inMat.size() : 0.0);
+    sparse_storage = (storageMode == DM_STORAGE_SPARSE ||
+            (storageMode == DM_STORAGE_AUTO && density < DM_SPARSE_DENSITY));
+    single_precision = (precision == DM_PRECISION_SINGLE);
+    if (single_precision && sparse_storage)
+    {
+        sparse_single = inMat.cast<float>().sparseView();
+        sparse_single.makeCompressed();
+    }
+    else if (single_precision)
+    {
+        dense_single = inMat.cast<float>();
+    }
+    else if (sparse_storage)
+    {
+        sparse = inMat.sparseView();
+        sparse.makeCompressed();
+    }
+    else
+    {
+        dense = inMat;
+    }
+}
+
+void distanceMatrix::multiplyAdd(double scale,
+                                 const Eigen::MatrixXd& x,
+                                 Eigen::MatrixXd& out) const
+{
+    if (single_precision)
+    {
+        Eigen::MatrixXf work(x.rows(), x.cols());
+        multiplyAddSingle(scale, x.cast<float>(), work, out);
+    }
+    else if (sparse_storage)
+    {
+        out.noalias() += scale*(sparse*x);
+    }
+    else
+    {
+        out.noalias() += scale*(dense*x);
+    }
+}
+
+void distanceMatrix::multiplyAddSingle(double scale,
+                                       const Eigen::MatrixXf& x,
+                                       Eigen::MatrixXf& work,
+                                       Eigen::MatrixXd& out) const
+{
+    if (sparse_storage)
+    {
+        work.noalias() = sparse_single*x;
+    }
+    else
+    {
+        work.noalias() = dense_single*x;
+    }
+    out += scale*work.cast<double>();
+}
+
+bool distanceMatrix::isSparse() const
+{
+    return(sparse_storage);
+}
+
+bool distanceMatrix::isSingle() const
+{
+    return(single_precision);
+}
+
+int distanceMatrix::nonZeros() const
+{
+    return(nnz);
+}
+
+int distanceMatrix::rows() const
+{
+    if (single_precision)
+    {
+        return(sparse_storage ? sparse_single.rows() : dense_single.rows());
+    }
+    return(sparse_storage ? sparse.rows() : dense.rows());
+}
+
+Eigen::MatrixXd distanceMatrix::toDense() const
+{
+    if (single_precision)
+    {
+        return(sparse_storage ? 
+               Eigen::MatrixXd(Eigen::MatrixXf(sparse_single).cast<double>()) :
+               Eigen::MatrixXd(dense_single.cast<double>()));
+    }
+    if (sparse_storage)
+    {
+        return(Eigen::MatrixXd(sparse));
+    }
+    return(dense);
+}
@@ -8,10 +8,12 @@ distanceModel::distanceModel()
 {
     numLocations=-1;
     spatial_prior = Eigen::VectorXd(2);
-    dm_list = std::vector<Eigen::MatrixXd>();
-    tdm_list = std::vector<std::vector<Eigen::MatrixXd> >();
+    dm_list = std::vector<distanceMatrix>();
+    tdm_list = std::vector<std::vector<distanceMatrix> >();
     tdm_empty = std::vector<int>();
     currentTDistIdx = 0;
+    storageMode = DM_STORAGE_AUTO;
+    precision = DM_PRECISION_DOUBLE;
 }
 
 int distanceModel::getModelComponentType()
@@ -29,7 +31,7 @@ void distanceModel::setupTemporalDistanceMatrices(int nTpt)
 {
     for (int i = 0; i < nTpt; i++)
     {
-        tdm_list.push_back(std::vector<Eigen::MatrixXd>());
+        tdm_list.push_back(std::vector<distanceMatrix>());
         tdm_empty.push_back(1);
     }
 }
@@ -54,7 +56,7 @@ void distanceModel::addTDistanceMatrix(int tpt, NumericMatrix distMat)
             new_mat(i,j) = distMat(i,j);
         }
     }
-    tdm_list[tpt].push_back(new_mat);
+    tdm_list[tpt].push_back(distanceMatrix(new_mat, storageMode, precision));
     if (!empty)
     {
         tdm_empty[tpt + tdm_list[tpt].size()] = 0;
@@ -81,11 +83,47 @@ void distanceModel::addDistanceMatrix(NumericMatrix distMat)
         }
     }
 
-    dm_list.push_back(new_mat);
+    dm_list.push_back(distanceMatrix(new_mat, storageMode, precision));
     numLocations = distMat.nrow();
 
 }
 
+void distanceModel::setStorageMode(std::string mode)
+{
+    if (mode == "auto")
+    {
+        storageMode = DM_STORAGE_AUTO;
+    }
+    else if (mode == "dense")
+    {
+        storageMode = DM_STORAGE_DENSE;
+    }
+    else if (mode == "sparse")
+    {
+        storageMode = DM_STORAGE_SPARSE;
+    }
+    else
+    {
+        Rcpp::stop("Distance matrix storage must be one of: auto, dense, sparse\n");
+    }
+}
+
+void distanceModel::setPrecision(std::string mode)
+{
+    if (mode == "double")
+    {
+        precision = DM_PRECISION_DOUBLE;
+    }
+    else if (mode == "single")
+    {
+        precision = DM_PRECISION_SINGLE;
+    }
+    else
+    {
+        Rcpp::stop("Distance matrix precision must be one of: double, single\n");
+    }
+}
+
 void distanceModel::summary()
 {
     Rcpp::Rcout << "Distance Model Summary\n" <<
@@ -94,6 +132,13 @@ void distanceModel::summary()
     {
         Rcpp::Rcout << "Number of locations: " << numLocations << "\n";
         Rcpp::Rcout << "Number of distance structures: " << (dm_list.size()) << "\n";
+        for (unsigned int i = 0; i < dm_list.size(); i++)
+        {
+            Rcpp::Rcout << "    matrix " << (i+1) << ": " 
+                << dm_list[i].nonZeros() << " non-zero entries, stored "
+                << (dm_list[i].isSparse() ? "sparse" : "dense") 
+                << (dm_list[i].isSingle() ? ", single precision" : "") << "\n";
+        }
         Rcpp::Rcout << "Number of time varying distance structures: " 
             << (tdm_list.size()) << "\n";
         if (tdm_list.size() > 0)
@@ -132,6 +177,8 @@ RCPP_MODULE(mod_distanceModel)
             &distanceModel::setupTemporalDistanceMatrices)
     .method("summary", &distanceModel::summary)
     .method("setPriorParameters", &distanceModel::setPriorParameters)
+    .method("setStorageMode", &distanceModel::setStorageMode)
+    .method("setPrecision", &distanceModel::setPrecision)
     .property("numMatrices", &distanceModel::getNumDistanceMatrices, "Number of distict distance matrices.");
 }
 
@@ -1,7 +1,18 @@
 #ifndef ABSEIR_STRING_CONST_HDR
 #define ABSEIR_STRING_CONST_HDR
 
-static const std::string sim_atom = "sim";
-static const std::string sim_result_atom = "sim_rslt";
+/** Build the simulation core without worker threads*/
+//#define SPATIALSEIR_SINGLETHREAD
+
+/** Actions understood by the NodePool workers */
+enum simulationAction
+{
+    /** Simulate and store only the distance to the observed data */
+    sim_atom = 0,
+    /** Simulate and additionally capture the compartment values */
+    sim_result_atom = 1,
+    /** Run the function passed to NodePool::parallelFor over the rows*/
+    range_atom = 2
+};
 
 #endif
@@ -2,22 +2,38 @@
 #define ACTOR_SEIRSIM_HEADER
 
 #include <map>
+#include <deque>
 #include <vector>
 #include <random>
 #include <sstream>
 #include <iostream>
 #include <Eigen/Core>
 #include <ABSEIR_constants.hpp>
-#include <samplingControl.hpp>
-#include <dataModel.hpp>
+#include <philox.hpp>
+#include <binomialSampler.hpp>
+#include <distanceMatrix.hpp>
+#include <pathCompartment.hpp>
+#include <compartmentStore.hpp>
+#include <telemetry.hpp>
+#include <threadAffinity.hpp>
+#include <util.hpp>
+#include <coreError.hpp>
 #include <thread>
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
+#include <exception>
 #include <memory>
+#include <functional>
 
 using namespace std;
 
+/** Transition mechanisms, resolved from the transitionMode string once per 
+ * node*/
+#define TRANSITION_EXPONENTIAL 0
+#define TRANSITION_PATH_SPECIFIC 1
+#define TRANSITION_WEIBULL 2
+
 /*
 using sim_atom = "sim";
 using sim_result_atom = "sim_rslt";
@@ -26,86 +42,153 @@ using wakeup_atom = "wakeup";
 using exit_atom = "exit";
 */
 
-struct simulationResultSet;
 class transitionDistribution;
 class NodePool;
 class NodeWorker;
 
+struct simulationResultSet
+{
+    Eigen::MatrixXi S;
+    Eigen::MatrixXi E;
+    Eigen::MatrixXi I;
+    Eigen::MatrixXi R;
+    Eigen::MatrixXi S_star;
+    Eigen::MatrixXi E_star;
+    Eigen::MatrixXi I_star;
+    Eigen::MatrixXi R_star;
+    Eigen::MatrixXd p_se;
+    Eigen::MatrixXd p_ei;
+    Eigen::MatrixXd p_ir;
+    Eigen::MatrixXd rho;
+    Eigen::MatrixXd beta;
+    Eigen::MatrixXd result; 
+};
+
+/** A contiguous block of rows [start_idx, end_idx) of the parameter matrix
+ * currently registered with the NodePool. */
 struct instruction{
-   int param_idx; 
-   std::string action_type;
-   Eigen::VectorXd params;
+   simulationAction action_type;
+   int chunk_idx;
+   int start_idx;
+   int end_idx;
+   double threshold;
+   unsigned int batch_id;
+   /** When the task was queued, for worker telemetry*/
+   telemetryClock::time_point queued_at;
+};
+
+/** Per-worker task deque. The owning worker pops from the front, idle workers
+ * steal from the back. */
+struct workerQueue{
+    std::mutex queue_mutex;
+    std::deque<instruction> tasks;
+};
+
+/** Model data needed to run simulations. It is built once by the model and
+ * shared read-only by every SEIR_sim_node, so threads do not hold private
+ * copies of the (potentially large) data and distance matrices. */
+struct simulationContext{
+    int random_seed;
+    Eigen::VectorXi S0;
+    Eigen::VectorXi E0;
+    Eigen::VectorXi I0;
+    Eigen::VectorXi R0;
+    Eigen::VectorXd offset;
+    Eigen::MatrixXi Y;
+    MatrixXb na_mask;
+    int dataModelType;
+    std::vector<distanceMatrix> DM_vec;
+    std::vector<std::vector<distanceMatrix> > TDM_vec;
+    std::vector<int> TDM_empty;
+    Eigen::MatrixXd X;
+    Eigen::MatrixXd X_rs;
+    std::string transitionMode;
+    Eigen::MatrixXd E_to_I_prior;
+    Eigen::MatrixXd I_to_R_prior;
+    double inf_mean;
+    Eigen::VectorXd spatial_prior;
+    Eigen::VectorXd exposure_precision;
+    Eigen::VectorXd reinfection_precision;
+    Eigen::VectorXd exposure_mean;
+    Eigen::VectorXd reinfection_mean;
+    double phi;
+    int data_compartment;
+    bool cumulative;
+    int m;
+    double lpow;
+    /** Transition draws whose binomial variance reaches this use a normal
+     * approximation, see binomialSampler. Zero for exact draws.*/
+    double binomial_approx_threshold;
+    // Only read by the samplers, for the prior
+    double report_fraction;
+    double report_fraction_ess;
+    /** 1 for fixed initial values, 2 for estimated ones*/
+    int ivc_type;
+    Eigen::VectorXi S0_max;
+    Eigen::VectorXi E0_max;
+    Eigen::VectorXi I0_max;
+    Eigen::VectorXi R0_max;
 };
 
 class SEIR_sim_node {
     public:
         SEIR_sim_node(NodeWorker* worker,
-                      int random_seed,
-                      Eigen::VectorXi S0,
-                      Eigen::VectorXi E0,
-                      Eigen::VectorXi I0,
-                      Eigen::VectorXi R0,
-                      Eigen::VectorXd offset,
-                      Eigen::MatrixXi Y,
-                      MatrixXb na_mask,
-                      int dataModelType,
-                      std::vector<Eigen::MatrixXd> DM_vec,
-                      std::vector<std::vector<Eigen::MatrixXd> > tdm_vec,
-                      std::vector<int> tdm_empty,
-                      Eigen::MatrixXd X, 
-                      Eigen::MatrixXd X_rs,
-                      std::string transitionMode,
-                      Eigen::MatrixXd ei_prior,
-                      Eigen::MatrixXd ir_prior,
-                      double avgI,
-                      Eigen::VectorXd sp_prior,
-                      Eigen::VectorXd se_prec,
-                      Eigen::VectorXd rs_prec,
-                      Eigen::VectorXd se_mean,
-                      Eigen::VectorXd rs_mean,
-                      double phi,
-                      int data_compartment,
-                      bool cumulative,
-                      int m, 
-					  double lpow);
+                      std::shared_ptr<const simulationContext> context);
         ~SEIR_sim_node();
         std::deque<std::string> messages;
-        simulationResultSet simulate(Eigen::VectorXd param_vals, bool keepCompartments);
+        /** Simulate m epidemics from param_vals. A replicate is abandoned
+         * once its accumulated distance (before taking the 1/lpow root) 
+         * reaches threshold; pass infinity to always run to completion.
+         * Replicate w draws from the random stream keyed on (random_seed,
+         * batch_id, particle_idx, w), so the result does not depend on 
+         * which node runs the simulation. The returned results are 
+         * overwritten by the next call.*/
+        const simulationResultSet& simulate(const Eigen::VectorXd& param_vals, 
+                                     bool keepCompartments,
+                                     double threshold,
+                                     unsigned int batch_id,
+                                     unsigned int particle_idx);
 
     private: 
         NodeWorker* parent;
+        std::shared_ptr<const simulationContext> context;
         unsigned int random_seed;
+        /** Initial compartments, overwritten from the parameters of each
+         * simulation*/
         Eigen::VectorXi S0;
         Eigen::VectorXi E0;
         Eigen::VectorXi I0;
         Eigen::VectorXi R0;
-        Eigen::VectorXd offset;
-        Eigen::MatrixXi Y;
-        MatrixXb na_mask;
-        int dataModelType;
-        std::vector<Eigen::MatrixXd> DM_vec;
-        std::vector<std::vector<Eigen::MatrixXd> > TDM_vec;
-        std::vector<int> TDM_empty;
-
-        Eigen::MatrixXd X;
-        Eigen::MatrixXd X_rs;
-        std::string transitionMode;
-        Eigen::MatrixXd E_to_I_prior;
-        Eigen::MatrixXd I_to_R_prior;
-        double inf_mean;
-        Eigen::VectorXd spatial_prior;
-        Eigen::VectorXd exposure_precision;
-        Eigen::VectorXd reinfection_precision;
-        Eigen::VectorXd exposure_mean;
-        Eigen::VectorXd reinfection_mean;
-        double phi;
-        int data_compartment;
-        bool cumulative;
-        int m;
-		double lpow;
-
-        std::vector<Eigen::MatrixXi> E_paths;
-        std::vector<Eigen::MatrixXi> I_paths;
+
+        // Read-only views of the shared context
+        const Eigen::VectorXd& offset;
+        const Eigen::MatrixXi& Y;
+        const MatrixXb& na_mask;
+        const int dataModelType;
+        const std::vector<distanceMatrix>& DM_vec;
+        const std::vector<std::vector<distanceMatrix> >& TDM_vec;
+        const std::vector<int>& TDM_empty;
+
+        const Eigen::MatrixXd& X;
+        const Eigen::MatrixXd& X_rs;
+        const std::string& transitionMode;
+        const Eigen::MatrixXd& E_to_I_prior;
+        const Eigen::MatrixXd& I_to_R_prior;
+        const double inf_mean;
+        const Eigen::VectorXd& spatial_prior;
+        const Eigen::VectorXd& exposure_precision;
+        const Eigen::VectorXd& reinfection_precision;
+        const Eigen::VectorXd& exposure_mean;
+        const Eigen::VectorXd& reinfection_mean;
+        const double phi;
+        const int data_compartment;
+        const bool cumulative;
+        const int m;
+        const double lpow;
+
+        /** Residence times in E and I, one per replicate*/
+        std::vector<pathCompartment> E_paths;
+        std::vector<pathCompartment> I_paths;
 
         /** General E to I transition Distribution*/
         std::unique_ptr<transitionDistribution> EI_transition_dist;
@@ -113,6 +196,31 @@ class SEIR_sim_node {
         std::unique_ptr<transitionDistribution> IR_transition_dist;
         void nodeMessage(std::string);
 
+        /** One of TRANSITION_EXPONENTIAL, TRANSITION_PATH_SPECIFIC or 
+         * TRANSITION_WEIBULL*/
+        int transition_type;
+        /** Draw one time step of transitions for every replicate and 
+         * location, and add the distances to the data to results */
+        typedef void (SEIR_sim_node::*stepKernel)(int time_idx,
+                const Eigen::MatrixXi& comparison_compartment);
+        /** Step kernel specialized for this model, chosen in the 
+         * constructor so the location loop carries no mode checks*/
+        stepKernel step_kernel;
+        template<int transitionType, int dataModel, bool isCumulative,
+                 bool hasReinfection>
+        void stepKernelImpl(int time_idx, 
+                            const Eigen::MatrixXi& comparison_compartment);
+        template<int transitionType, int dataModel, bool isCumulative>
+        static stepKernel selectByReinfection(bool reinfection);
+        template<int transitionType, int dataModel>
+        static stepKernel selectByCumulative(bool cumulative, 
+                                             bool reinfection);
+        template<int transitionType>
+        static stepKernel selectByDataModel(int dataModel, bool cumulative,
+                                            bool reinfection);
+        /** Number of bins path compartments age by at a time point*/
+        int pathSteps(int time_idx) const;
+
         int seed;
         double value;
         bool has_spatial;
@@ -122,113 +230,250 @@ class SEIR_sim_node {
         int total_size;
 
         int sim_width;
-        mt19937* generator;
-        std::normal_distribution<double> overdispersion_distribution;
+        /** One random stream per replicate*/
+        std::vector<philox4x32> replicate_generators;
+        /** Stream of the replicate currently being simulated*/
+        philox4x32* generator;
+
+        /** Binomial samplers, one per distinct transition probability, so 
+         * their setup can be reused between draws*/
+        std::vector<binomialSampler> EI_path_samplers;
+        std::vector<binomialSampler> IR_path_samplers;
+        binomialSampler rs_sampler;
+        binomialSampler se_sampler;
+        binomialSampler ei_sampler;
+        binomialSampler ir_sampler;
+        binomialSampler report_sampler;
+        /** Observation noise, one per replicate as the distribution caches
+         * draws from the generator*/
+        std::vector<std::normal_distribution<double> > overdispersion_distributions;
+
+        // Working storage, sized in the constructor and reused by every 
+        // call to simulate so that simulation does not allocate.
+        simulationResultSet compartmentResults;
+        Eigen::VectorXd results;
+        Eigen::VectorXd beta;
+        Eigen::VectorXd beta_rs;
+        Eigen::VectorXd rho;
+        Eigen::VectorXd EI_params;
+        Eigen::VectorXd IR_params;
+        Eigen::VectorXi N;
+        Eigen::VectorXd N_double;
+        Eigen::VectorXd eta;
+        /** Exposure pressure and probability, one column per replicate*/
+        Eigen::MatrixXd p_se_cache;
+        Eigen::MatrixXd p_se;
+        /** Pressure rounded to float, and its product with a matrix, for 
+         * single precision distance matrices*/
+        Eigen::MatrixXf pressure_single;
+        Eigen::MatrixXf product_single;
+        Eigen::VectorXd p_ei;
+        Eigen::VectorXd p_ir;
+        Eigen::VectorXd p_rs;
+        Eigen::MatrixXi current_S;
+        Eigen::MatrixXi current_E;
+        Eigen::MatrixXi current_I;
+        Eigen::MatrixXi current_R;
+        Eigen::MatrixXi previous_S;
+        Eigen::MatrixXi previous_E;
+        Eigen::MatrixXi previous_I;
+        Eigen::MatrixXi previous_R;
+        Eigen::MatrixXi previous_S_star;
+        Eigen::MatrixXi previous_E_star;
+        Eigen::MatrixXi previous_I_star;
+        Eigen::MatrixXi previous_R_star;
+        Eigen::MatrixXi cumulative_compartment;
+        /** Lagged, normalized infection pressure (p_se_cache) of all 
+         * replicates*/
+        compartment_tap I_lag;
 };
 
 
 
 class NodeWorker{
     public:
+        /** The simulation node is built by the worker thread in
+         * NodePool::startWorker, except in single thread mode*/
         NodeWorker(NodePool* pl, 
-                   int random_seed,
-                   Eigen::VectorXi S0,
-                   Eigen::VectorXi E0,
-                   Eigen::VectorXi I0,
-                   Eigen::VectorXi R0,
-                   Eigen::VectorXd offset,
-                   Eigen::MatrixXi Y,
-                   MatrixXb na_mask,
-                   int dataModelType,
-                   std::vector<Eigen::MatrixXd> DM_vec,
-                   std::vector<std::vector<Eigen::MatrixXd> > TDM_vec,
-                   std::vector<int> TDM_empty,
-                   Eigen::MatrixXd X, 
-                   Eigen::MatrixXd X_rs,
-                   std::string transitionMode,
-                   Eigen::MatrixXd ei_prior,
-                   Eigen::MatrixXd ir_prior,
-                   double avgI,
-                   Eigen::VectorXd sp_prior,
-                   Eigen::VectorXd se_prec,
-                   Eigen::VectorXd rs_prec,
-                   Eigen::VectorXd se_mean,
-                   Eigen::VectorXd rs_mean,
-                   double phi,
-                   int data_compartment,
-                   bool cumulative,
-                   int m, 
-				   double lpow);
+                   int worker_idx,
+                   std::shared_ptr<const simulationContext> context);
         void operator()();
         void addMessage(std::string);
 
     private:
         friend class SEIR_sim_node;
+        friend class NodePool;
+        /** Take a task from this worker's queue, or steal one from another*/
+        bool nextTask(instruction* task);
+        /** Run all simulations described by a task*/
+        void runTask(const instruction& task);
         NodePool* pool;
+        int worker_idx;
+        /** Reused copy of the parameter row being simulated*/
+        Eigen::VectorXd param_buffer;
         std::unique_ptr<SEIR_sim_node> node;
+        /** Written only by this worker, read while it is idle*/
+        workerTelemetry stats;
 };
 
 class NodePool{
     public:
+        /** Start threads workers. If placement is given, worker i is 
+         * restricted to the CPU of placement[i], see placeWorkers. Each
+         * worker allocates its own simulation storage, so that it is 
+         * placed in the memory of the worker's NUMA node, and when the
+         * workers span several nodes the first worker on each node makes
+         * a copy of context to be shared by the workers of that node.
+         * Returns once every worker is ready.*/
         NodePool(Eigen::MatrixXd* result_pointer,
-                 std::vector<simulationResultSet>* result_complete_pointer,
-                 std::vector<int>* index_pointer,
+                 compartmentStore* compartment_pointer,
                  int threads,
-                 int random_seed,
-                 Eigen::VectorXi S0,
-                 Eigen::VectorXi E0,
-                 Eigen::VectorXi I0,
-                 Eigen::VectorXi R0,
-                 Eigen::VectorXd offset,
-                 Eigen::MatrixXi Y,
-                 MatrixXb na_mask,
-                 int dataModelType,
-                 std::vector<Eigen::MatrixXd> DM_vec,
-                 std::vector<std::vector<Eigen::MatrixXd> > TDM_vec,
-                 std::vector<int> TDM_empty,
-                 Eigen::MatrixXd X, 
-                 Eigen::MatrixXd X_rs,
-                 std::string transitionMode,
-                 Eigen::MatrixXd ei_prior,
-                 Eigen::MatrixXd ir_prior,
-                 double avgI,
-                 Eigen::VectorXd sp_prior,
-                 Eigen::VectorXd se_prec,
-                 Eigen::VectorXd rs_prec,
-                 Eigen::VectorXd se_mean,
-                 Eigen::VectorXd rs_mean,
-                 double phi,
-                 int data_compartment,
-                 bool cumulative,
-                 int m, 
-				 double lpow
-              );
+                 std::shared_ptr<const simulationContext> context,
+                 int chunk_size,
+                 const std::vector<cpuSlot>& placement = 
+                    std::vector<cpuSlot>());
+        /** Set where distances and, for sim_result_atom, compartments of
+         * the next batches are written. The compartment store must be 
+         * allocated for every row of the batch params.*/
         void setResultsDest(Eigen::MatrixXd* result_pointer,
-                            std::vector<simulationResultSet>* result_complete_pointer,
-                            std::vector<int>* rslt_idx_pointer);
+                            compartmentStore* compartment_pointer);
         void awaitFinished();
         void resolveMessages();
-        void enqueue(std::string action_type, int param_idx, Eigen::VectorXd params);
+        /** Queue simulations for every row of params, split into chunks of
+         * contiguous rows which are dealt out across the worker queues. 
+         * params must stay alive and unchanged until awaitFinished returns; 
+         * row i of params is written to row i of result_pointer. With 
+         * replicates > 1, rows i*replicates to (i + 1)*replicates - 1 of
+         * result_pointer are instead simulations of row i of params, each
+         * with its own random streams, as if the row had been repeated.*/
+        void enqueue(simulationAction action_type, 
+                     const Eigen::MatrixXd* params, 
+                     double threshold,
+                     int replicates = 1);
+        /** As enqueue, but only until the leading rows of params hold 
+         * needed rows for which accept(row) is true. Once a run of 
+         * finished chunks from row 0 holds enough acceptances, remaining
+         * tasks are dropped and running ones stop at the next particle. 
+         * Every row before the cutoff is simulated, so the first needed
+         * accepted rows are the same as for a full batch. accept is called
+         * on the worker threads and must stay alive until awaitFinished 
+         * returns.*/
+        void enqueueUntil(simulationAction action_type,
+                          const Eigen::MatrixXd* params,
+                          double threshold,
+                          int needed,
+                          const std::function<bool(int)>* accept);
+        /** Reserve a batch id for simulations run with enqueueRows*/
+        unsigned int reserveBatch();
+        /** Number of batch ids handed out so far, and setting it, so that
+         * a resumed run continues the random streams of the original*/
+        unsigned int batchCount() const;
+        void setBatchCount(unsigned int count);
+        /** As enqueue, but rows of params are simulated with the random
+         * streams of rows first_particle onwards of batch batch_id, so a
+         * batch split into blocks gives the same results as when it is
+         * enqueued whole.*/
+        void enqueueRows(simulationAction action_type,
+                         const Eigen::MatrixXd* params,
+                         double threshold,
+                         unsigned int batch_id,
+                         int first_particle);
+        /** Call fn(start, end) on the worker threads for disjoint ranges 
+         * covering [0, nRows), and wait for all of them to finish. Must 
+         * not be called while simulations are queued.*/
+        void parallelFor(int nRows, const std::function<void(int, int)>& fn);
+        /** Zero the worker counters and restart the telemetry clock*/
+        void resetTelemetry();
+        /** Counters of each worker since the last reset. Workers must be 
+         * idle.*/
+        std::vector<workerTelemetry> getTelemetry() const;
+        /** Wall time since the last reset*/
+        double telemetrySeconds() const;
+        /** Simulations run by all workers since the last reset*/
+        long totalSimulations() const;
         Eigen::MatrixXd* result_pointer;
         std::deque<std::string> messages;
-        std::vector<simulationResultSet>* result_complete_pointer;
-        std::vector<int>* index_pointer;
+        compartmentStore* compartment_pointer;
         ~NodePool();
 
     private:
         friend class NodeWorker;
+
+        /** Run on the thread of worker worker_idx before it takes any
+         * tasks: pin it to its CPU and build its simulation node*/
+        void startWorker(int worker_idx,
+                         std::shared_ptr<const simulationContext> context);
+        /** Model data for workers on NUMA node numa_node, copied from
+         * context by the first worker to ask for it*/
+        std::shared_ptr<const simulationContext> nodeContext(int numa_node,
+                std::shared_ptr<const simulationContext> context);
+        /** CPU of each worker, or empty if workers are not placed*/
+        std::vector<cpuSlot> placement;
+        /** Whether workers use a copy of the model data per NUMA node*/
+        bool replicate_context;
+        std::map<int, std::shared_ptr<const simulationContext> > node_contexts;
+        /** Guards startup of the workers*/
+        std::mutex startup_mutex;
+        std::condition_variable started;
+        /** Workers started so far, and those which could not be pinned*/
+        int nStarted;
+        int nUnpinned;
+        /** First error raised while starting a worker*/
+        std::exception_ptr startup_error;
         
+        /** Deal nRows rows out to the worker queues in chunks, either as 
+         * one contiguous block per queue or interleaved across queues*/
+        void queueTasks(simulationAction action_type, 
+                        int nRows, 
+                        int chunk,
+                        double threshold,
+                        unsigned int batch_id,
+                        bool interleave);
+        /** Parameter matrix for the tasks currently queued*/
+        const Eigen::MatrixXd* params_pointer;
+        /** Particle index of row 0 of params_pointer*/
+        int particle_offset;
+        /** Simulations per row of params_pointer*/
+        int row_replicates;
+        /** Function run by range_atom tasks*/
+        const std::function<void(int, int)>* range_function;
+
+        /** Acceptance test for enqueueUntil, or nullptr*/
+        const std::function<bool(int)>* accept_function;
+        /** Record that a chunk finished with nAccepted acceptances, and 
+         * move row_cutoff forward once enough have been seen*/
+        void chunkFinished(int chunk_idx, int nAccepted);
+        /** Acceptances still needed by enqueueUntil*/
+        int accept_needed;
+        /** Rows per chunk of the current batch*/
+        int batch_chunk;
+        /** Acceptances per finished chunk, -1 for unfinished ones*/
+        std::vector<int> chunk_accepted;
+        /** First chunk not yet known to be finished*/
+        int frontier_chunk;
+        /** Acceptances in the chunks before frontier_chunk*/
+        int frontier_accepted;
+        std::mutex stream_mutex;
+        /** Rows from this one on are not needed by the current batch*/
+        std::atomic_int row_cutoff;
+        /** Rows per task, or 0 to pick based on the batch size*/
+        int chunk_size;
+        /** Number of batches enqueued so far, used to key random streams*/
+        unsigned int batch_counter;
+        telemetryClock::time_point telemetry_reset;
 
-#ifdef SPATIALSEIR_SINGLETHREAD
-        std::vector<NodeWorker> nodes;
-#else
+        std::vector<std::unique_ptr<NodeWorker> > workers;
+        std::vector<std::unique_ptr<workerQueue> > queues;
+#ifndef SPATIALSEIR_SINGLETHREAD
         std::vector<std::thread> nodes;
 #endif
-        std::deque<instruction>  tasks;
-        std::atomic_int nBusy;
+        /** Tasks queued but not yet picked up by a worker*/
+        std::atomic_int nAvailable;
+        /** Tasks queued or running*/
+        std::atomic_int nPending;
 
+        /** Guards sleeping and waking of workers and the master thread*/
         std::mutex queue_mutex;
-        std::mutex result_mutex;
         std::condition_variable condition;
         std::condition_variable finished;
         bool exit; 
@@ -0,0 +1,303 @@
+#ifndef SPATIALSEIR_ABC_SAMPLER
+#define SPATIALSEIR_ABC_SAMPLER
+
+#include <memory>
+#include <random>
+#include <vector>
+#include <functional>
+#include <Eigen/Core>
+#include <ABSEIR_constants.hpp>
+#include <SEIRSimNodes.hpp>
+#include <simulationBackend.hpp>
+#include <samplerSettings.hpp>
+#include <samplerCheckpoint.hpp>
+#include <priorDistribution.hpp>
+#include <compartmentStore.hpp>
+#include <aliasTable.hpp>
+#include <telemetry.hpp>
+#include <coreError.hpp>
+
+/** Set in the high bit of the second Philox key word for proposal streams,
+ * which SEIR_sim_node batch ids never reach*/
+#define PROPOSAL_STREAM_KEY 0x80000000u
+
+/** What a sampler run produced. Only the parts used by the algorithm are
+ * filled in, as flagged below.*/
+struct samplerResult
+{
+    samplerResult() : has_result(false), has_weights(false),
+                      has_epochs(false), current_eps(0.0),
+                      completed_epochs(0), compartment_slots(-1) {}
+    bool has_result;
+    bool has_weights;
+    bool has_epochs;
+    /** Distances of the accepted particles*/
+    Eigen::MatrixXd result;
+    Eigen::MatrixXd params;
+    Eigen::VectorXd weights;
+    double current_eps;
+    int completed_epochs;
+    /** Number of leading slots of abcSampler::compartments() holding the
+     * compartments of the particles, or -1 if none were captured*/
+    int compartment_slots;
+};
+
+/** The ABC algorithms. They only depend on the simulation core, so they
+ * can be driven without R; errors are raised as abseirError. */
+class abcSampler
+{
+    public:
+        abcSampler(std::shared_ptr<const simulationContext> context,
+                   const samplerSettings& settings);
+        ~abcSampler();
+        /** Draw nSample samples from the approximated posterior with the
+         * algorithm chosen in the settings, capturing compartments if
+         * sim_type_atom is sim_result_atom. verbose may be 0 to 3.*/
+        samplerResult sample(int nSample, simulationAction sim_type_atom,
+                             int verbose);
+        /** Simulate every row of params replicates times, in full, and
+         * capture compartments if sim_type_atom is sim_result_atom. The
+         * replicates of row i are rows i*replicates onwards of the result.
+         * Each call draws new random streams, so a sampler may be kept to
+         * run many batches on the same pool.*/
+        samplerResult simulate(const Eigen::MatrixXd& params, int replicates,
+                               simulationAction sim_type_atom);
+        /** Evaluate the prior distribution of a particular set of parameters*/
+        double evalPrior(Eigen::VectorXd param_values);
+        /** Log prior density of each row of params, evaluated on the
+         * worker threads. Unlike the log of evalPrior, densities too small
+         * to represent as doubles stay finite.*/
+        Eigen::VectorXd evalLogPrior(const Eigen::MatrixXd& params);
+        /** Whether the prior density of row row of params is positive. Only
+         * reads model data, so it may be called from the worker threads.
+         * Unlike evalPrior > 0, a density which underflows to zero counts
+         * as in the support.*/
+        bool inPriorSupport(const Eigen::MatrixXd& params, int row) const;
+        /** Choose the captured compartments (CAPTURE_* flags) and whether
+         * integer compartments are stored in 16 bits*/
+        void setCapture(int flags, bool compact);
+        /** Assign the parameter values manually */
+        bool setParameters(Eigen::MatrixXd param_values,
+                           Eigen::VectorXd weights,
+                           Eigen::MatrixXd results,
+                           double eps);
+        /** Continue the run saved to the checkpoint file at path, so that
+         * the next call to sample carries on from its last completed epoch
+         * up to the epochs of the settings, drawing the same random
+         * numbers as the original run would have. The settings should
+         * match those of the original run. Returns the number of epochs
+         * already completed.*/
+        int loadCheckpoint(const std::string& path);
+        /** Compartments captured by the last run*/
+        const compartmentStore& compartments() const;
+        /** Timings of the epochs of the last run*/
+        const std::vector<epochTelemetry>& getEpochTelemetry() const;
+        /** Worker counters and wall time since the last run started*/
+        std::vector<workerTelemetry> getWorkerTelemetry() const;
+        double telemetrySeconds() const;
+
+        /** Called by the samplers at verbose > 1 to describe the model*/
+        std::function<void()> summary_function;
+
+    private:
+        /** Draw N parameter sets from the prior distribution on the worker
+         * threads. Each row has its own proposal stream, so the draws do
+         * not depend on the number of threads.*/
+        Eigen::MatrixXd generateParamsPrior(int N);
+
+        /** Simulate epidemics based on parameters. Replicates whose
+         * distance reaches eps_threshold may be stopped early; pass
+         * infinity to simulate every replicate in full. If accept is
+         * given, simulation stops once the leading rows of params hold
+         * accept_needed rows passing it, and only those leading rows are
+         * guaranteed to be simulated. */
+        void run_simulations(const Eigen::MatrixXd& params,
+                             simulationAction sim_type_atom,
+                             Eigen::MatrixXd* result_recip,
+                             compartmentStore* result_c_recip,
+                             double eps_threshold,
+                             int accept_needed = 0,
+                             const std::function<bool(int)>* accept = nullptr);
+
+        /** For multivariate perturbation, the lower Cholesky factor of 
+         * twice the covariance of the free parameters of params, so that 
+         * its diagonal matches tau. Parameters with no spread keep their 
+         * tau. Empty for independent perturbations, or if the covariance 
+         * is singular.*/
+        Eigen::MatrixXd perturbationCholesky(const Eigen::MatrixXd& params,
+                                             const Eigen::VectorXd& tau,
+                                             const Eigen::VectorXi& fixed);
+
+        /** Propose new parameters by resampling ancestors from inParams and
+         * perturbing them with independent normals of scale tau, or with
+         * correlated normals if chol is not empty, retrying perturbations
+         * which fall outside the prior support. Runs on the worker 
+         * threads. */
+        void proposeParams_beaumont(Eigen::MatrixXd* outParams,
+                                    const Eigen::MatrixXd& inParams,
+                                    const aliasTable& ancestors,
+                                    const Eigen::VectorXd& tau,
+                                    const Eigen::MatrixXd& chol,
+                                    const Eigen::VectorXi& fixed);
+
+        /** Beaumont et al. (2009) importance weights of the proposed
+         * particles given the previous population and the kernel used by
+         * proposeParams_beaumont, normalized to sum to one and written to
+         * out_weights. Kernel and prior densities are evaluated on the
+         * worker threads, and weights are formed on the log scale. Raises
+         * abseirError if a weight is nan or none is positive and finite.*/
+        void computeImportanceWeights(const Eigen::MatrixXd& proposed_params,
+                                      const Eigen::MatrixXd& prev_params,
+                                      const Eigen::VectorXd& prev_weights,
+                                      const Eigen::VectorXd& tau,
+                                      const Eigen::MatrixXd& chol,
+                                      const Eigen::VectorXi& fixed,
+                                      Eigen::VectorXd* out_weights);
+
+        /** One Beaumont et al. (2009) epoch of proposals, shared by the
+         * main loop and the compartment pass. Sorts param_matrix and w0
+         * by weight, copying the sorted weights to w1, then simulates
+         * batches of proposals from it with sim_type_atom, stopping
+         * replicates early at eps_threshold. Proposals closer than e1
+         * fill the leading rows of proposed_param_matrix and
+         * proposed_results_double, and for sim_result_atom the same slots
+         * of results_complete. Batches stop once Npart are accepted or,
+         * if bounded, once maxProposals have been run. Returns the number
+         * accepted and writes the number of batches to n_batches.*/
+        int proposeEpoch_beaumont(int Npart, double e1, double eps_threshold,
+                                  simulationAction sim_type_atom,
+                                  bool bounded, long maxProposals,
+                                  const Eigen::VectorXd& tau,
+                                  const Eigen::MatrixXd& chol,
+                                  const Eigen::VectorXi& fixed,
+                                  Eigen::VectorXd* w0, Eigen::VectorXd* w1,
+                                  int* batch_accepted, int* batch_examined,
+                                  int* n_batches, epochTelemetry* epoch,
+                                  phaseTimer* timer, int verbose);
+
+        /** Run simulation using basic ABC algorithm */
+        samplerResult sample_basic(int nSample, int verbose,
+                                   simulationAction sim_type_atom);
+
+        /** Run simulation using Beaumont 2009 algorithm */
+        samplerResult sample_Beaumont2009(int nSample, int verbose,
+                                          simulationAction sim_type_atom);
+
+        /** Run simulation using Del Moral 2012 algorithm */
+        samplerResult sample_DelMoral2012(int nSample, int verbose,
+                                          simulationAction sim_type_atom);
+
+        /** Use current parameters to simulate epidemics*/
+        samplerResult sample_Simulate(int nSample, int enforceEps, int verbose);
+
+        /** Rows of the next proposal batch of an epoch, when needed more
+         * acceptances are wanted, the previous batch accepted accepted of
+         * its first examined rows and remaining proposals are left in the
+         * epoch. This is batch_size unless adaptive_batch is set, when the
+         * batch is sized from the acceptance rate, kept at least batch_size
+         * and rounded up to a multiple of CPU_cores. Adaptive batches never
+         * exceed remaining: they are rounded down to a multiple of
+         * CPU_cores instead, or are remaining itself when it is smaller
+         * than CPU_cores.*/
+        int nextBatchSize(int needed, int accepted, int examined,
+                          long remaining) const;
+
+        /** Clear epoch telemetry and the worker counters of the pool*/
+        void resetTelemetry();
+
+        /** Finish epoch, timed by timer, and append it to epoch_telemetry.
+         * Simulations run since the previous epoch are counted towards it.*/
+        void recordEpoch(epochTelemetry epoch, const phaseTimer& timer);
+
+        /** Write the particles, their weights and eps to the checkpoint
+         * file of the settings, if any, along with the random stream
+         * positions and telemetry, after completed_epochs epochs*/
+        void writeCheckpoint(int completed_epochs, double eps,
+                             const Eigen::VectorXd& weights,
+                             int batch_accepted, int batch_examined,
+                             bool terminated);
+
+        /** Model data, shared with the simulation nodes*/
+        std::shared_ptr<const simulationContext> context;
+
+        samplerSettings settings;
+
+        priorDistribution prior;
+
+        /** Number of proposal batches drawn so far, used to key their
+         * random streams*/
+        unsigned int proposal_counter;
+
+        /** Flag for whether params have been initialized*/
+        bool is_initialized;
+
+        /** If simulation is re-started, need initial epsilon stored*/
+        double init_eps;
+
+        /** If simulation is re-started, need initial weights stored*/
+        Eigen::VectorXd init_weights;
+
+        /** If simulation is re-started, need initial params stored */
+        Eigen::MatrixXd init_param_matrix;
+
+        /** If simulation is re-started, need initial results stored */
+        Eigen::MatrixXd init_results_double;
+
+        /** When resuming from a checkpoint, the epoch to start from, 
+         * whether the run had already stopped, the acceptance of its last
+         * batch and the telemetry of its completed epochs*/
+        int start_epoch;
+        bool start_terminated;
+        int start_batch_accepted;
+        int start_batch_examined;
+        std::vector<epochTelemetry> resumed_telemetry;
+
+        /** Matrix of parameters */
+        Eigen::MatrixXd proposed_param_matrix;
+
+        /** Matrix of parameters */
+        Eigen::MatrixXd param_matrix;
+
+        /** Matrix of parameters */
+        Eigen::MatrixXd prev_param_matrix;
+
+        /** Results vector*/
+        Eigen::MatrixXd results_double;
+
+        /** Results vector*/
+        Eigen::MatrixXd prev_results_double;
+
+        /** Results vector*/
+        Eigen::MatrixXd proposed_results_double;
+
+        /** particles - cache*/
+        Eigen::MatrixXd proposal_cache;
+
+        /** particles - cache*/
+        Eigen::MatrixXd preproposal_params;
+
+        /** particles - cache*/
+        Eigen::MatrixXd preproposal_results;
+
+        /** Captured compartments, one slot per particle */
+        compartmentStore results_complete;
+
+        /** Captured compartments, one slot per proposal */
+        compartmentStore proposed_results_complete;
+
+        /** Timings of the epochs of the current sampler run*/
+        std::vector<epochTelemetry> epoch_telemetry;
+
+        /** Thread pool */
+        std::unique_ptr<NodePool> worker_pool;
+
+        /** Runs the batches of run_simulations, on worker_pool or spread
+         * over MPI ranks*/
+        std::unique_ptr<simulationBackend> backend;
+
+        /** A persistant pointer to a properly initialized random
+         * number generator.*/
+        std::mt19937* generator;
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef SPATIALSEIR_ALIAS_TABLE
+#define SPATIALSEIR_ALIAS_TABLE
+
+#include <vector>
+#include <Eigen/Core>
+#include <philox.hpp>
+
+/** Walker's alias method, built with Vose's algorithm, for drawing indices 
+ * in proportion to a fixed set of non-negative weights in constant time. */
+class aliasTable
+{
+    public:
+        aliasTable(const Eigen::VectorXd& weights);
+        /** Draw an index, with probability proportional to its weight*/
+        int operator()(philox4x32& generator) const;
+
+    private:
+        std::vector<double> prob;
+        std::vector<int> alias;
+};
+
+#endif
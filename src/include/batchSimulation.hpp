@@ -0,0 +1,403 @@
+#ifndef SPATIALSEIR_BATCH_SIMULATION
+#define SPATIALSEIR_BATCH_SIMULATION
+
+#include <cmath>
+#include <vector>
+#include <hostDevice.hpp>
+#include <philox.hpp>
+#include <binomialSampler.hpp>
+#include <pathCompartment.hpp>
+#include <SEIRSimNodes.hpp>
+
+/** Model data read by simulateParticle, held in flat arrays so that it can
+ * be copied to a GPU as is. Matrices are column major, as in Eigen, and
+ * distance matrices are in compressed sparse row form.*/
+struct batchModel
+{
+    int nTpt;
+    int nLoc;
+    int m;
+    /** TRANSITION_EXPONENTIAL or TRANSITION_WEIBULL*/
+    int transition_type;
+    /** 0 (identity) or 2 (fractional reporting)*/
+    int data_model;
+    int data_compartment;
+    bool cumulative;
+    bool has_reinfection;
+    bool has_spatial;
+    int nBeta;
+    int nReinf;
+    int nRho;
+    int nTrans;
+    int nReport;
+    /** Residence time bins of E and I, for Weibull transitions*/
+    int EI_bins;
+    int IR_bins;
+    unsigned int random_seed;
+    double lpow;
+    double approx_threshold;
+    const double* offset;
+    const int* Y;
+    const unsigned char* na_mask;
+    const double* X;
+    const double* X_rs;
+    int X_rs_rows;
+    /** nLoc + 1 row starts for each of the nRho distance matrices, into
+     * dm_cols and dm_values*/
+    const int* dm_row_start;
+    const int* dm_cols;
+    const double* dm_values;
+};
+
+/** Working storage of one simulateParticle call, sized by the functions
+ * below*/
+struct batchWorkspace
+{
+    int* ints;
+    double* doubles;
+    binomialSampler* samplers;
+    philox4x32* generators;
+};
+
+ABSEIR_HD inline int batchIntWorkspace(const batchModel& model)
+{
+    return(model.nLoc*(1 + model.m*(11 + model.EI_bins + model.IR_bins)));
+}
+
+ABSEIR_HD inline int batchDoubleWorkspace(const batchModel& model)
+{
+    return(model.m*(2*model.nLoc + 1));
+}
+
+ABSEIR_HD inline int batchSamplerWorkspace(const batchModel& model)
+{
+    return(5 + model.EI_bins + model.IR_bins);
+}
+
+/** Fill bin 0 of each location of replicate paths, as
+ * pathCompartment::setEntrants*/
+ABSEIR_HD inline void batchSetEntrants(int* bins, int* max_bin, int nBins,
+                                       int head, int nLoc,
+                                       const int* entrants)
+{
+    const int idx = pathCompartment::physicalIndex(nBins, head, 0, 0);
+    for (int i = 0; i < nLoc; i++)
+    {
+        bins[i*nBins + idx] = entrants[i];
+        if (entrants[i] > 0 && max_bin[i] < 0)
+        {
+            max_bin[i] = 0;
+        }
+    }
+}
+
+/** Simulate the m replicates of one particle, as SEIR_sim_node::simulate
+ * does without capturing compartments, and write the distance of
+ * replicate w to results[w*result_stride]. The random streams and the
+ * order of the draws are those of SEIR_sim_node. Compiled for the host,
+ * the distances match the CPU simulation, as checked by 
+ * bench/benchSimulation check=1; see cudaBackend for the device.*/
+ABSEIR_HD inline void simulateParticle(const batchModel& model,
+                                       const double* params,
+                                       double threshold,
+                                       unsigned int batch_id,
+                                       unsigned int particle_idx,
+                                       batchWorkspace ws,
+                                       double* results,
+                                       int result_stride)
+{
+    const int nLoc = model.nLoc;
+    const int nTpt = model.nTpt;
+    const int m = model.m;
+    const int size = nLoc*m;
+    const bool exponential = (model.transition_type == TRANSITION_EXPONENTIAL);
+    const int trans_idx = model.nBeta + model.nReinf + model.nRho;
+    const int ivc_idx = trans_idx + model.nTrans + model.nReport;
+    const double* beta = params;
+    const double* beta_rs = params + model.nBeta;
+    const double* rho = params + model.nBeta + model.nReinf;
+    int t, i, j, k, w, d, observed;
+    double distance, value;
+
+    int* S = ws.ints;
+    int* E = S + size;
+    int* I = E + size;
+    int* R = I + size;
+    int* S_star = R + size;
+    int* E_star = S_star + size;
+    int* I_star = E_star + size;
+    int* R_star = I_star + size;
+    int* cumulative_compartment = R_star + size;
+    int* E_max_bin = cumulative_compartment + size;
+    int* I_max_bin = E_max_bin + size;
+    int* N = I_max_bin + size;
+    int* E_bins = N + nLoc;
+    int* I_bins = E_bins + size*model.EI_bins;
+    double* p_se_cache = ws.doubles;
+    double* p_se = p_se_cache + size;
+    double* distances = p_se + size;
+    binomialSampler& rs_sampler = ws.samplers[0];
+    binomialSampler& se_sampler = ws.samplers[1];
+    binomialSampler& ei_sampler = ws.samplers[2];
+    binomialSampler& ir_sampler = ws.samplers[3];
+    binomialSampler& report_sampler = ws.samplers[4];
+    binomialSampler* EI_path_samplers = ws.samplers + 5;
+    binomialSampler* IR_path_samplers = EI_path_samplers + model.EI_bins;
+
+    for (k = 0; k < 5; k++)
+    {
+        ws.samplers[k] = binomialSampler();
+        // Only the transitions of the epidemic are approximated
+        ws.samplers[k].setApproximation(k < 4 ? model.approx_threshold : 0.0);
+    }
+    const double gamma_ei = (exponential ? params[trans_idx] : -1.0);
+    const double gamma_ir = (exponential ? params[trans_idx + 1] : -1.0);
+    if (!exponential)
+    {
+        // Bin transition probabilities from the Weibull cumulative hazard,
+        // as in weibullTransitionDistribution::setCurrentParams
+        for (k = 0; k < model.EI_bins + model.IR_bins; k++)
+        {
+            const bool isEI = (k < model.EI_bins);
+            const int bin = (isEI ? k : k - model.EI_bins);
+            const double shape = params[trans_idx + (isEI ? 0 : 2)];
+            const double scale = params[trans_idx + (isEI ? 1 : 3)];
+            ws.samplers[5 + k] = binomialSampler(1.0 - std::exp(
+                        std::pow(bin/scale, shape)
+                      - std::pow((bin + 1)/scale, shape)));
+            ws.samplers[5 + k].setApproximation(model.approx_threshold);
+        }
+    }
+    report_sampler.setProb(model.data_model == 2 ?
+                           params[trans_idx + model.nTrans] : 0.0);
+
+    for (i = 0; i < nLoc; i++)
+    {
+        S[i] = (int) params[ivc_idx + i];
+        E[i] = (int) params[ivc_idx + nLoc + i];
+        I[i] = (int) params[ivc_idx + 2*nLoc + i];
+        R[i] = (int) params[ivc_idx + 3*nLoc + i];
+        N[i] = S[i] + E[i] + I[i] + R[i];
+    }
+    for (w = 1; w < m; w++)
+    {
+        for (i = 0; i < nLoc; i++)
+        {
+            S[w*nLoc + i] = S[i];
+            E[w*nLoc + i] = E[i];
+            I[w*nLoc + i] = I[i];
+            R[w*nLoc + i] = R[i];
+        }
+    }
+    int E_head = 0;
+    int I_head = 0;
+    if (!exponential)
+    {
+        for (k = 0; k < size*model.EI_bins; k++)
+        {
+            E_bins[k] = 0;
+        }
+        for (k = 0; k < size*model.IR_bins; k++)
+        {
+            I_bins[k] = 0;
+        }
+        for (k = 0; k < size; k++)
+        {
+            E_max_bin[k] = -1;
+            I_max_bin[k] = -1;
+        }
+        for (w = 0; w < m; w++)
+        {
+            batchSetEntrants(E_bins + w*nLoc*model.EI_bins, E_max_bin + w*nLoc,
+                             model.EI_bins, E_head, nLoc, E);
+            batchSetEntrants(I_bins + w*nLoc*model.IR_bins, I_max_bin + w*nLoc,
+                             model.IR_bins, I_head, nLoc, I);
+        }
+    }
+    for (k = 0; k < size; k++)
+    {
+        cumulative_compartment[k] = 0;
+    }
+    for (w = 0; w < m; w++)
+    {
+        distances[w] = 0.0;
+        ws.generators[w].seed(model.random_seed, batch_id, particle_idx, w);
+    }
+
+    const int* comparison_compartment = (model.data_compartment == 0 ?
+                                         I_star :
+                                        (model.data_compartment == 1 ?
+                                         R_star :
+                                        (model.data_compartment == 2 ?
+                                         I : I_star)));
+    for (t = 0; t < nTpt; t++)
+    {
+        // Exposure pressure, as the Eigen expressions of
+        // SEIR_sim_node::simulate
+        for (i = 0; i < nLoc; i++)
+        {
+            value = 0.0;
+            for (j = 0; j < model.nBeta; j++)
+            {
+                value += model.X[(t + nTpt*i) + nTpt*nLoc*j]*beta[j];
+            }
+            value = std::exp(value);
+            for (w = 0; w < m; w++)
+            {
+                const double e = (((double) I[w*nLoc + i])/N[i])*value;
+                p_se_cache[w*nLoc + i] = (e == e ? e : 0);
+            }
+        }
+        for (k = 0; k < size; k++)
+        {
+            p_se[k] = p_se_cache[k];
+        }
+        for (d = 0; model.has_spatial && d < model.nRho; d++)
+        {
+            const int* row_start = model.dm_row_start + d*(nLoc + 1);
+            for (w = 0; w < m; w++)
+            {
+                for (i = 0; i < nLoc; i++)
+                {
+                    value = 0.0;
+                    for (k = row_start[i]; k < row_start[i + 1]; k++)
+                    {
+                        value += model.dm_values[k]*
+                                 p_se_cache[w*nLoc + model.dm_cols[k]];
+                    }
+                    p_se[w*nLoc + i] += rho[d]*value;
+                }
+            }
+        }
+        for (k = 0; k < size; k++)
+        {
+            p_se[k] = 1 - std::exp(-1.0*p_se[k]*model.offset[t]);
+        }
+        if (model.has_reinfection)
+        {
+            value = 0.0;
+            for (j = 0; j < model.nReinf; j++)
+            {
+                value += model.X_rs[t + model.X_rs_rows*j]*beta_rs[j];
+            }
+            rs_sampler.setProb(1 - std::exp(-(std::exp(value)*
+                                              model.offset[0])));
+        }
+        else
+        {
+            rs_sampler.setProb(0.0);
+        }
+        ei_sampler.setProb(1 - std::exp(-1.0*gamma_ei*model.offset[t]));
+        ir_sampler.setProb(1 - std::exp(-1.0*gamma_ir*model.offset[t]));
+        const int nSteps = (exponential ? 0 :
+                            (int) std::ceil(model.offset[t]));
+
+        for (w = 0; w < m; w++)
+        {
+            philox4x32& generator = ws.generators[w];
+            for (i = 0; i < nLoc; i++)
+            {
+                k = w*nLoc + i;
+                S_star[k] = (model.has_reinfection ?
+                             rs_sampler(R[k], generator) : 0);
+                se_sampler.setProb(p_se[k]);
+                E_star[k] = se_sampler(S[k], generator);
+                if (exponential)
+                {
+                    I_star[k] = ei_sampler(E[k], generator);
+                    R_star[k] = ir_sampler(I[k], generator);
+                }
+                else
+                {
+                    I_star[k] = pathCompartment::advanceBins(
+                            E_bins + k*model.EI_bins, E_max_bin + k,
+                            model.EI_bins, E_head, nSteps, EI_path_samplers,
+                            generator);
+                    R_star[k] = pathCompartment::advanceBins(
+                            I_bins + k*model.IR_bins, I_max_bin + k,
+                            model.IR_bins, I_head, nSteps, IR_path_samplers,
+                            generator);
+                }
+                if (model.cumulative)
+                {
+                    cumulative_compartment[k] += comparison_compartment[k];
+                    observed = cumulative_compartment[k];
+                }
+                else
+                {
+                    observed = comparison_compartment[k];
+                }
+                if (!model.na_mask[t + nTpt*i])
+                {
+                    distance = (model.data_model == 2 ?
+                                report_sampler(observed, generator) :
+                                observed) - model.Y[t + nTpt*i];
+                    distances[w] += std::pow(std::fabs(distance), model.lpow);
+                }
+            }
+        }
+
+        for (k = 0; k < size; k++)
+        {
+            S[k] += S_star[k] - E_star[k];
+            E[k] += E_star[k] - I_star[k];
+            I[k] += I_star[k] - R_star[k];
+            R[k] += R_star[k] - S_star[k];
+        }
+        if (!exponential)
+        {
+            E_head = pathCompartment::physicalIndex(model.EI_bins, E_head,
+                                                    0, nSteps);
+            I_head = pathCompartment::physicalIndex(model.IR_bins, I_head,
+                                                    0, nSteps);
+            for (w = 0; w < m; w++)
+            {
+                batchSetEntrants(E_bins + w*nLoc*model.EI_bins,
+                                 E_max_bin + w*nLoc, model.EI_bins, E_head,
+                                 nLoc, E_star + w*nLoc);
+                batchSetEntrants(I_bins + w*nLoc*model.IR_bins,
+                                 I_max_bin + w*nLoc, model.IR_bins, I_head,
+                                 nLoc, I_star + w*nLoc);
+            }
+        }
+
+        // Early rejection once every replicate reaches the threshold
+        value = distances[0];
+        for (w = 1; w < m; w++)
+        {
+            value = (distances[w] < value ? distances[w] : value);
+        }
+        if (value >= threshold)
+        {
+            break;
+        }
+    }
+    for (w = 0; w < m; w++)
+    {
+        results[w*result_stride] = std::pow(distances[w], 1.0/model.lpow);
+    }
+}
+
+/** The model data of a simulationContext flattened for simulateParticle.
+ * model points into the arrays held here.*/
+class batchModelData
+{
+    public:
+        batchModelData(const simulationContext& context);
+        /** Whether simulateParticle covers the model: exponential or
+         * Weibull transitions, the identity or fractional reporting data
+         * models, double precision distance matrices and no lagged (time 
+         * varying) ones. Other models are simulated on the CPU.*/
+        static bool supports(const simulationContext& context);
+        batchModel model;
+        std::vector<double> offset;
+        std::vector<int> Y;
+        std::vector<unsigned char> na_mask;
+        std::vector<double> X;
+        std::vector<double> X_rs;
+        std::vector<int> dm_row_start;
+        std::vector<int> dm_cols;
+        std::vector<double> dm_values;
+};
+
+#endif
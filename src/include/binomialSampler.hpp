@@ -0,0 +1,337 @@
+#ifndef SPATIALSEIR_BINOMIAL_SAMPLER
+#define SPATIALSEIR_BINOMIAL_SAMPLER
+
+#include <cmath>
+#include <cstdlib>
+#include <philox.hpp>
+#include <hostDevice.hpp>
+
+/** Binomial random variate generator for a fixed success probability.
+ * Uses inversion when n*min(p, 1-p) < 30 and the BTPE algorithm of
+ * Kachitvichyanukul and Schmeiser (1988) otherwise. Setup depending on p is
+ * done once in setProb, and setup depending on n is reused for as long as
+ * consecutive draws share the same n. Optionally, draws with a large 
+ * variance come from a rounded normal approximation instead. Defined 
+ * in the header so that the CUDA backend can draw on the device too. */
+class binomialSampler
+{
+    public:
+        ABSEIR_HD binomialSampler();
+        ABSEIR_HD binomialSampler(double p);
+        /** Change the success probability, a no-op if it is unchanged*/
+        ABSEIR_HD void setProb(double p);
+        /** Draw from a normal approximation, rounded and clamped to 
+         * [0, n], whenever n*p*(1-p) is at least threshold. Zero, the 
+         * default, keeps every draw exact.*/
+        ABSEIR_HD void setApproximation(double threshold);
+        /** Draw from Binomial(n, p) */
+        ABSEIR_HD int operator()(int n, philox4x32& generator);
+
+    private:
+        ABSEIR_HD void setSize(int n);
+        ABSEIR_HD int drawInversion(philox4x32& generator);
+        ABSEIR_HD int drawBTPE(philox4x32& generator);
+        ABSEIR_HD int drawNormal(int n, philox4x32& generator);
+
+        /** Uniform draw on the open interval (0,1)*/
+        ABSEIR_HD static double unifOpen(philox4x32& generator);
+        /** Stirling series correction terms used by the BTPE acceptance
+         * test*/
+        ABSEIR_HD static double stirlingCorrection(double x);
+        /** Standard normal quantile of u in (0,1), to a relative error of
+         * about 1e-9, by the rational approximation of P. J. Acklam. Only 
+         * the tails, under 5% of draws, need a logarithm.*/
+        ABSEIR_HD static double normalQuantile(double u);
+
+        double approx_threshold;
+
+        // Probability dependent setup
+        double prob;
+        double pp;
+        double q;
+        double r;
+        bool flip;
+        bool degenerate;
+
+        // Size dependent setup, valid while n == cached_n
+        int cached_n;
+        double g;
+        double npq;
+        // Inversion
+        double qn;
+        // BTPE
+        int mode;
+        double fm;
+        double xm;
+        double xl;
+        double xr;
+        double c;
+        double xll;
+        double xlr;
+        double p1;
+        double p2;
+        double p3;
+        double p4;
+};
+
+ABSEIR_HD inline double binomialSampler::unifOpen(philox4x32& generator)
+{
+    return((generator() + 0.5)*2.3283064365386962890625e-10);
+}
+
+ABSEIR_HD inline double binomialSampler::stirlingCorrection(double x)
+{
+    const double x2 = x*x;
+    return((13860. - (462. - (132. - (99. - 140./x2)/x2)/x2)/x2)/x/166320.);
+}
+
+ABSEIR_HD inline binomialSampler::binomialSampler()
+{
+    prob = -1.0;
+    cached_n = -1;
+    approx_threshold = 0.0;
+    setProb(0.0);
+}
+
+ABSEIR_HD inline binomialSampler::binomialSampler(double p)
+{
+    prob = -1.0;
+    cached_n = -1;
+    approx_threshold = 0.0;
+    setProb(p);
+}
+
+ABSEIR_HD inline void binomialSampler::setProb(double p)
+{
+    if (p == prob)
+    {
+        return;
+    }
+    prob = p;
+    cached_n = -1;
+    // NaN probabilities are treated like zero, as std::binomial_distribution
+    // gives no guarantees for them.
+    degenerate = !(p > 0.0 && p < 1.0);
+    flip = (p > 0.5);
+    pp = (flip ? 1.0 - p : p);
+    q = 1.0 - pp;
+    r = pp/q;
+}
+
+ABSEIR_HD inline void binomialSampler::setSize(int n)
+{
+    cached_n = n;
+    const double np = n*pp;
+    g = r*(n + 1);
+    npq = np*q;
+    if (np < 30.0)
+    {
+        qn = std::pow(q, n);
+        return;
+    }
+    fm = np + pp;
+    mode = (int) fm;
+    p1 = (int)(2.195*std::sqrt(npq) - 4.6*q) + 0.5;
+    xm = mode + 0.5;
+    xl = xm - p1;
+    xr = xm + p1;
+    c = 0.134 + 20.5/(15.3 + mode);
+    double al = (fm - xl)/(fm - xl*pp);
+    xll = al*(1.0 + 0.5*al);
+    al = (xr - fm)/(xr*q);
+    xlr = al*(1.0 + 0.5*al);
+    p2 = p1*(1.0 + c + c);
+    p3 = p2 + c/xll;
+    p4 = p3 + c/xlr;
+}
+
+ABSEIR_HD inline void binomialSampler::setApproximation(
+        double threshold)
+{
+    approx_threshold = threshold;
+}
+
+ABSEIR_HD inline int binomialSampler::operator()(int n, 
+                                                philox4x32& generator)
+{
+    if (n <= 0 || degenerate)
+    {
+        return(prob >= 1.0 && n > 0 ? n : 0);
+    }
+    if (approx_threshold > 0 && n*pp*q >= approx_threshold)
+    {
+        return(drawNormal(n, generator));
+    }
+    if (n != cached_n)
+    {
+        setSize(n);
+    }
+    int ix = (n*pp < 30.0 ? drawInversion(generator) : drawBTPE(generator));
+    return(flip ? n - ix : ix);
+}
+
+ABSEIR_HD inline double binomialSampler::normalQuantile(double u)
+{
+    const double a[6] = {-3.969683028665376e+01, 2.209460984245205e+02,
+        -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01,
+        2.506628277459239e+00};
+    const double b[5] = {-5.447609879822406e+01, 1.615858368580409e+02,
+        -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01};
+    const double c[6] = {-7.784894002430293e-03, -3.223964580411365e-01,
+        -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00,
+        2.938163982698783e+00};
+    const double d[4] = {7.784695709041462e-03, 3.224671290700398e-01,
+        2.445134137142996e+00, 3.754408661907416e+00};
+    double t, r;
+    if (u > 0.02425 && u < 0.97575)
+    {
+        t = u - 0.5;
+        r = t*t;
+        return((((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5])*t/
+               (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1.0));
+    }
+    t = std::sqrt(-2.0*std::log(u < 0.5 ? u : 1.0 - u));
+    r = (((((c[0]*t + c[1])*t + c[2])*t + c[3])*t + c[4])*t + c[5])/
+        ((((d[0]*t + d[1])*t + d[2])*t + d[3])*t + 1.0);
+    return(u < 0.5 ? r : -r);
+}
+
+ABSEIR_HD inline int binomialSampler::drawNormal(int n, 
+                                                 philox4x32& generator)
+{
+    const double z = normalQuantile(unifOpen(generator));
+    const double x = std::floor(n*prob + std::sqrt(n*pp*q)*z + 0.5);
+    return(x < 0 ? 0 : (x > n ? n : (int) x));
+}
+
+ABSEIR_HD inline int binomialSampler::drawInversion(
+        philox4x32& generator)
+{
+    int ix;
+    double f, u;
+    while (true)
+    {
+        ix = 0;
+        f = qn;
+        u = unifOpen(generator);
+        while (true)
+        {
+            if (u < f)
+            {
+                return(ix);
+            }
+            // Restart on the (rare) numerical run off into the tail
+            if (ix > 110)
+            {
+                break;
+            }
+            u -= f;
+            ix++;
+            f *= (g/ix - r);
+        }
+    }
+}
+
+ABSEIR_HD inline int binomialSampler::drawBTPE(
+        philox4x32& generator)
+{
+    const int n = cached_n;
+    int ix, i, k;
+    double u, v, x, f, alv, amaxp, ynorm;
+    double x1, f1, z, w;
+    while (true)
+    {
+        u = unifOpen(generator)*p4;
+        v = unifOpen(generator);
+        // Triangular region
+        if (u <= p1)
+        {
+            return((int)(xm - p1*v + u));
+        }
+        if (u <= p2)
+        {
+            // Parallelogram region
+            x = xl + (u - p1)/c;
+            v = v*c + 1.0 - std::fabs(xm - x)/p1;
+            if (v > 1.0 || v <= 0.0)
+            {
+                continue;
+            }
+            ix = (int) x;
+        }
+        else if (u > p3)
+        {
+            // Right exponential tail
+            ix = (int)(xr - std::log(v)/xlr);
+            if (ix > n)
+            {
+                continue;
+            }
+            v = v*(u - p3)*xlr;
+        }
+        else
+        {
+            // Left exponential tail
+            ix = (int)(xl + std::log(v)/xll);
+            if (ix < 0)
+            {
+                continue;
+            }
+            v = v*(u - p2)*xll;
+        }
+
+        k = std::abs(ix - mode);
+        if (k <= 20 || k >= npq/2 - 1)
+        {
+            // Evaluate f(ix)/f(mode) explicitly
+            f = 1.0;
+            if (mode < ix)
+            {
+                for (i = mode + 1; i <= ix; i++)
+                {
+                    f *= (g/i - r);
+                }
+            }
+            else if (mode > ix)
+            {
+                for (i = ix + 1; i <= mode; i++)
+                {
+                    f /= (g/i - r);
+                }
+            }
+            if (v <= f)
+            {
+                return(ix);
+            }
+        }
+        else
+        {
+            // Squeeze using upper and lower bounds on log(f(ix))
+            amaxp = (k/npq)*((k*(k/3.0 + 0.625) + 0.1666666666666)/npq + 0.5);
+            ynorm = -1.0*k*k/(2.0*npq);
+            alv = std::log(v);
+            if (alv < ynorm - amaxp)
+            {
+                return(ix);
+            }
+            if (alv <= ynorm + amaxp)
+            {
+                // Final acceptance test via Stirling's formula
+                x1 = ix + 1;
+                f1 = fm + 1.0;
+                z = n + 1 - fm;
+                w = n - ix + 1.0;
+                if (alv <= xm*std::log(f1/x1)
+                           + (n - mode + 0.5)*std::log(z/w)
+                           + (ix - mode)*std::log(w*pp/(x1*q))
+                           + stirlingCorrection(f1) + stirlingCorrection(z)
+                           + stirlingCorrection(x1) + stirlingCorrection(w))
+                {
+                    return(ix);
+                }
+            }
+        }
+    }
+}
+
+#endif
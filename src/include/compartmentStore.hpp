@@ -0,0 +1,79 @@
+#ifndef SPATIALSEIR_COMPARTMENT_STORE
+#define SPATIALSEIR_COMPARTMENT_STORE
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <Eigen/Core>
+
+/** Compartments which may be captured by sim_result_atom runs, combined as
+ * bit flags. The first CAPTURE_N_COMPARTMENTS are integer compartments, in
+ * the order used to index them.*/
+#define CAPTURE_S 1
+#define CAPTURE_E 2
+#define CAPTURE_I 4
+#define CAPTURE_R 8
+#define CAPTURE_S_STAR 16
+#define CAPTURE_E_STAR 32
+#define CAPTURE_I_STAR 64
+#define CAPTURE_R_STAR 128
+#define CAPTURE_P_SE 256
+#define CAPTURE_ALL 511
+#define CAPTURE_N_COMPARTMENTS 8
+
+struct simulationResultSet;
+
+/** Captured compartments of a batch of simulations. Each kept compartment
+ * is one contiguous T x L x N column major block, and simulation n is
+ * written to slot n, so workers fill their own slots without locking and
+ * a block can be handed out as a single array. Integer compartments may be
+ * stored in 16 bits; values which do not fit are clamped, and overflowed()
+ * reports that this happened.*/
+class compartmentStore
+{
+    public:
+        compartmentStore();
+        /** Choose the kept compartments (CAPTURE_* flags) and whether
+         * integer compartments are stored in 16 bits*/
+        void setCapture(int flags, bool compact);
+        /** Size storage for nSim simulations of nTpt x nLoc compartments,
+         * reusing existing storage*/
+        void allocate(int nTpt, int nLoc, int nSim);
+        /** Capture the kept parts of result into slot sim_idx*/
+        void store(int sim_idx, const simulationResultSet& result);
+        /** Copy slot src_idx of src, which must have the same capture
+         * settings and dimensions, into slot dest_idx*/
+        void copySlot(int dest_idx, const compartmentStore& src, int src_idx);
+        /** Copy integer compartment c of slots [first, first + n) to out,
+         * as a column major T x L x n block*/
+        void copyCompartment(int c, int first, int n, int* out) const;
+        /** Exposure probabilities of slot sim_idx, a column major T x L
+         * matrix*/
+        const double* pSE(int sim_idx) const;
+        bool keeps(int flag) const;
+        bool overflowed() const;
+        int slots() const;
+        int tpt() const;
+        int locations() const;
+
+        /** Per simulation parameters and distances*/
+        std::vector<Eigen::MatrixXd> result;
+        std::vector<Eigen::MatrixXd> beta;
+        std::vector<Eigen::MatrixXd> rho;
+        std::vector<Eigen::MatrixXd> p_ei;
+        std::vector<Eigen::MatrixXd> p_ir;
+
+    private:
+        int capture_flags;
+        bool compact;
+        int nTpt;
+        int nLoc;
+        int nSim;
+        std::atomic<bool> overflow;
+        /** One block per integer compartment, empty unless kept*/
+        std::vector<std::vector<int> > wide;
+        std::vector<std::vector<int16_t> > narrow;
+        std::vector<double> p_se;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SPATIALSEIR_CORE_ERROR
+#define SPATIALSEIR_CORE_ERROR
+
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <functional>
+
+/** Error raised by the simulation core. It derives from std::exception, so
+ * Rcpp turns it into an R error when it leaves a module method.*/
+class abseirError : public std::runtime_error
+{
+    public:
+        explicit abseirError(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+typedef std::function<void(const std::string&)> messageHandler;
+
+/** Where the core sends log output and warnings, and how it checks for user
+ * interrupts. By default output goes to std::cout and std::cerr and
+ * interrupts are never seen. Handlers are only called from the thread 
+ * driving the sampler.*/
+void setLogHandler(const messageHandler& handler);
+void setWarningHandler(const messageHandler& handler);
+void setInterruptHandler(const std::function<void()>& handler);
+
+void coreWarning(const std::string& msg);
+/** Give the interrupt handler a chance to abort, by throwing*/
+void coreCheckInterrupt();
+
+/** Buffers one log message, which is passed to the log handler when the
+ * stream is destroyed, i.e. coreLog() << "x: " << x << "\n";*/
+class coreLogStream
+{
+    public:
+        coreLogStream() {}
+        coreLogStream(coreLogStream&& other)
+        {
+            buffer << other.buffer.str();
+            other.buffer.str("");
+        }
+        ~coreLogStream();
+        template<typename T> coreLogStream& operator<<(const T& value)
+        {
+            buffer << value;
+            return(*this);
+        }
+
+    private:
+        std::ostringstream buffer;
+};
+
+inline coreLogStream coreLog()
+{
+    return(coreLogStream());
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef SPATIALSEIR_CUDA_BACKEND
+#define SPATIALSEIR_CUDA_BACKEND
+
+#ifdef ABSEIR_USE_CUDA
+
+#include <memory>
+#include <vector>
+#include <simulationBackend.hpp>
+#include <batchSimulation.hpp>
+
+/** Simulates batches on a CUDA device, with one thread per row running
+ * simulateParticle. The model data is copied to the device once, when the
+ * backend is created, after which a batch only carries parameter rows out
+ * and distances back. Random streams and the order of the draws are those
+ * of the CPU simulation, and bench/benchSimulation check=1 verifies that
+ * simulateParticle run on the host gives the CPU distances. On a device,
+ * exp, log and pow come from the CUDA math library and sums may round
+ * differently from Eigen's products, so device distances are statistically
+ * equivalent to the CPU ones rather than identical.
+ * Compartment capture (sim_result_atom) and models not covered by
+ * batchModelData::supports run on the local pool.*/
+class cudaBackend : public simulationBackend
+{
+    public:
+        cudaBackend(std::shared_ptr<const simulationContext> context,
+                    NodePool* pool);
+        ~cudaBackend();
+        void run(const Eigen::MatrixXd& params,
+                 int replicates,
+                 simulationAction sim_type_atom,
+                 Eigen::MatrixXd* results_dest,
+                 compartmentStore* results_c_dest,
+                 double threshold,
+                 int accept_needed,
+                 const std::function<bool(int)>* accept);
+        void resetTelemetry();
+        long totalSimulations() const;
+        /** Whether a CUDA device can be used*/
+        static bool available();
+
+    private:
+        /** Simulate output rows [first, first + n) of the batch whose
+         * parameters are on the device, into device_results*/
+        void launch(int first, int n, int nOut, int replicates,
+                    double threshold, unsigned int batch_id);
+        /** Grow the batch storage on the device to hold nParamRows rows of
+         * parameters and nOut rows of distances*/
+        void reserve(int nParamRows, int nOut);
+        /** Copy n host bytes to a new device allocation, freed with the
+         * backend*/
+        void* upload(const void* data, size_t n);
+        NodePool* pool;
+        localBackend local;
+        bool supported;
+        batchModelData host_data;
+        /** host_data.model, pointing at the device copies of its arrays*/
+        batchModel device_model;
+        std::vector<void*> device_arrays;
+        int nParams;
+        double* device_params;
+        size_t params_capacity;
+        double* device_results;
+        size_t results_capacity;
+        /** Working storage of simulateParticle for each device thread*/
+        batchWorkspace device_workspace;
+        int workspace_threads;
+        /** Most threads to run at once, limited by device memory*/
+        int max_threads;
+        /** Simulations run on the device since the last reset*/
+        long device_simulations;
+};
+
+#endif
+
+#endif
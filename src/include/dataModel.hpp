@@ -3,6 +3,7 @@
 #include <Rcpp.h>
 #include <modelComponent.hpp>
 #include <Eigen/Core>
+#include <util.hpp>
 
 #define COMPARTMENT_I_STAR 0
 #define COMPARTMENT_R_STAR 1
@@ -11,7 +12,6 @@
 
 
 using namespace Rcpp;
-typedef Eigen::Matrix<bool, Eigen::Dynamic, Eigen::Dynamic> MatrixXb;
 RCPP_EXPOSED_CLASS(dataModel)
 class dataModel : public modelComponent
 {
@@ -0,0 +1,56 @@
+#ifndef SPATIALSEIR_DISTANCE_MATRIX
+#define SPATIALSEIR_DISTANCE_MATRIX
+
+#define DM_STORAGE_AUTO 0
+#define DM_STORAGE_DENSE 1
+#define DM_STORAGE_SPARSE 2
+
+#define DM_PRECISION_DOUBLE 0
+#define DM_PRECISION_SINGLE 1
+
+/** Under DM_STORAGE_AUTO, matrices with a smaller fraction of non-zero
+ * entries than this are stored in compressed sparse row form. */
+#define DM_SPARSE_DENSITY 0.1
+
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+
+/** A distance matrix, stored either densely or in compressed sparse row
+ * form depending on the requested storage mode and its density. Entries 
+ * may be held in single precision, halving the memory read by each
+ * product; products with them are then also computed in single precision
+ * and added to the double precision result. */
+class distanceMatrix
+{
+    public:
+        distanceMatrix(const Eigen::MatrixXd& inMat, int storageMode,
+                       int precision = DM_PRECISION_DOUBLE);
+        /** out += scale*(M*x)*/
+        void multiplyAdd(double scale,
+                         const Eigen::MatrixXd& x,
+                         Eigen::MatrixXd& out) const;
+        /** As multiplyAdd, for single precision matrices, with x already
+         * rounded to float. work, sized like x, receives M*x, so that 
+         * nothing is allocated.*/
+        void multiplyAddSingle(double scale,
+                               const Eigen::MatrixXf& x,
+                               Eigen::MatrixXf& work,
+                               Eigen::MatrixXd& out) const;
+        bool isSparse() const;
+        bool isSingle() const;
+        int nonZeros() const;
+        int rows() const;
+        /** The matrix as a dense one, whatever its storage*/
+        Eigen::MatrixXd toDense() const;
+
+    private:
+        bool sparse_storage;
+        bool single_precision;
+        int nnz;
+        Eigen::MatrixXd dense;
+        Eigen::SparseMatrix<double, Eigen::RowMajor> sparse;
+        Eigen::MatrixXf dense_single;
+        Eigen::SparseMatrix<float, Eigen::RowMajor> sparse_single;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define SPATIALSEIR_DISTANCE_MODEL
 #include <Rcpp.h>
 #include<modelComponent.hpp>
+#include<distanceMatrix.hpp>
 
 using namespace Rcpp;
 RCPP_EXPOSED_CLASS(distanceModel)
@@ -16,13 +17,21 @@ class distanceModel : public modelComponent
         virtual void summary();
         virtual void setPriorParameters(double alpha, double beta);
         virtual int getNumDistanceMatrices();
+        /** Set how subsequently added matrices are stored: "auto", 
+         * "dense" or "sparse"*/
+        virtual void setStorageMode(std::string mode);
+        /** Set whether subsequently added matrices are held in "double" 
+         * or "single" precision*/
+        virtual void setPrecision(std::string mode);
 
         int numLocations;
         int currentTDistIdx;
+        int storageMode;
+        int precision;
         Eigen::VectorXd spatial_prior;
-        std::vector<Eigen::MatrixXd> dm_list;
+        std::vector<distanceMatrix> dm_list;
         std::vector<int> tdm_empty; 
-        std::vector<std::vector<Eigen::MatrixXd> > tdm_list;
+        std::vector<std::vector<distanceMatrix> > tdm_list;
 
 
         ~distanceModel();
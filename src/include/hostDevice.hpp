@@ -0,0 +1,12 @@
+#ifndef SPATIALSEIR_HOST_DEVICE
+#define SPATIALSEIR_HOST_DEVICE
+
+/** Marks functions shared by the CPU simulation code and the kernels of
+ * the CUDA backend (see cudaBackend.hpp). Empty unless compiled by nvcc.*/
+#ifdef __CUDACC__
+#define ABSEIR_HD __host__ __device__
+#else
+#define ABSEIR_HD
+#endif
+
+#endif
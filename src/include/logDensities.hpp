@@ -0,0 +1,97 @@
+#ifndef SPATIALSEIR_LOG_DENSITIES
+#define SPATIALSEIR_LOG_DENSITIES
+
+#include <cmath>
+#include <limits>
+
+/** Log densities of the prior distributions, following the conventions of
+ * R's dnorm, dgamma and dbeta with log = TRUE, including their values on
+ * the boundary of the support.*/
+
+inline double logDnorm(double x, double mean, double sd)
+{
+    if (std::isnan(x) || std::isnan(mean) || std::isnan(sd) || sd < 0)
+    {
+        return(std::numeric_limits<double>::quiet_NaN());
+    }
+    if (sd == 0)
+    {
+        return(x == mean ? std::numeric_limits<double>::infinity()
+                         : -std::numeric_limits<double>::infinity());
+    }
+    const double z = (x - mean)/sd;
+    return(-(0.918938533204672741780329736406 + std::log(sd) + 0.5*z*z));
+}
+
+/** Gamma log density with the given shape and scale, where lgamma_shape
+ * is std::lgamma(shape). Passing it in keeps std::lgamma, which may set
+ * the global signgam, off the worker threads.*/
+inline double logDgamma(double x, double shape, double scale,
+                        double lgamma_shape)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    if (std::isnan(x) || std::isnan(shape) || std::isnan(scale) || 
+            shape < 0 || scale <= 0)
+    {
+        return(std::numeric_limits<double>::quiet_NaN());
+    }
+    if (x < 0 || !std::isfinite(x))
+    {
+        return(-inf);
+    }
+    if (shape == 0)
+    {
+        return(x == 0 ? inf : -inf);
+    }
+    if (x == 0)
+    {
+        if (shape < 1) return(inf);
+        if (shape > 1) return(-inf);
+        return(-std::log(scale));
+    }
+    return((shape - 1.0)*std::log(x) - x/scale - lgamma_shape 
+            - shape*std::log(scale));
+}
+
+/** Gamma log density with the given shape and scale*/
+inline double logDgamma(double x, double shape, double scale)
+{
+    return(logDgamma(x, shape, scale, std::lgamma(shape)));
+}
+
+/** Beta(a, b) log density, where log_beta is 
+ * std::lgamma(a) + std::lgamma(b) - std::lgamma(a + b)*/
+inline double logDbeta(double x, double a, double b, double log_beta)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    if (std::isnan(x) || std::isnan(a) || std::isnan(b) || a < 0 || b < 0)
+    {
+        return(std::numeric_limits<double>::quiet_NaN());
+    }
+    if (x < 0 || x > 1)
+    {
+        return(-inf);
+    }
+    if (x == 0)
+    {
+        if (a < 1) return(inf);
+        if (a > 1) return(-inf);
+        return(std::log(b));
+    }
+    if (x == 1)
+    {
+        if (b < 1) return(inf);
+        if (b > 1) return(-inf);
+        return(std::log(a));
+    }
+    return((a - 1.0)*std::log(x) + (b - 1.0)*std::log1p(-x) 
+            - log_beta);
+}
+
+inline double logDbeta(double x, double a, double b)
+{
+    return(logDbeta(x, a, b, 
+                    std::lgamma(a) + std::lgamma(b) - std::lgamma(a + b)));
+}
+
+#endif
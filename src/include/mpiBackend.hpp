@@ -0,0 +1,66 @@
+#ifndef SPATIALSEIR_MPI_BACKEND
+#define SPATIALSEIR_MPI_BACKEND
+
+#ifdef ABSEIR_USE_MPI
+
+#include <memory>
+#include <vector>
+#include <simulationBackend.hpp>
+
+/** Spreads simulation batches over the ranks of MPI_COMM_WORLD. The sampler
+ * runs on rank 0, and every other rank runs mpiServe. The model data is
+ * sent to the workers once, when the backend is created, after which a
+ * chunk of rows only carries parameter rows out and distances back.
+ * Chunks are handed out as ranks finish them, with rank 0 simulating its
+ * share on the local pool. As the random streams are keyed on the row of
+ * the batch, results do not depend on which rank ran a row. Compartment
+ * capture (sim_result_atom) runs on rank 0 only.*/
+class mpiBackend : public simulationBackend
+{
+    public:
+        mpiBackend(std::shared_ptr<const simulationContext> context,
+                   NodePool* pool,
+                   int threads,
+                   int chunk_size);
+        ~mpiBackend();
+        void run(const Eigen::MatrixXd& params,
+                 int replicates,
+                 simulationAction sim_type_atom,
+                 Eigen::MatrixXd* results_dest,
+                 compartmentStore* results_c_dest,
+                 double threshold,
+                 int accept_needed,
+                 const std::function<bool(int)>* accept);
+        void resetTelemetry();
+        long totalSimulations() const;
+        /** Number of worker ranks, initializing MPI if it is not already.
+         * Zero unless called on rank 0 of a world of several ranks.*/
+        static int workerCount();
+
+    private:
+        /** Simulate rows [first, first + n) of params on this rank*/
+        void runLocalChunk(const Eigen::MatrixXd& params,
+                           int first,
+                           int n,
+                           double threshold,
+                           unsigned int batch_id,
+                           Eigen::MatrixXd* results_dest);
+        NodePool* pool;
+        localBackend local;
+        /** Tells the models served by the workers apart*/
+        int model_id;
+        int nWorkers;
+        /** Simulations run by the workers since the last reset*/
+        long remote_simulations;
+        /** Working storage for local chunks*/
+        Eigen::MatrixXd chunk_params;
+        Eigen::MatrixXd chunk_results;
+};
+
+/** Serve the models of rank 0 until it shuts down, initializing and
+ * finalizing MPI. Run on every rank but 0, see mpi/abseirWorker.cpp.*/
+int mpiServe();
+
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef SPATIALSEIR_PARTICLE_KERNEL_DENSITY
+#define SPATIALSEIR_PARTICLE_KERNEL_DENSITY
+
+#include <vector>
+#include <Eigen/Core>
+
+/** Weighted mixture of normal kernels centred on a particle population, 
+ * the denominator of the Beaumont et al. (2009) importance weights. 
+ * Kernels are independent normals or share a covariance matrix, in which
+ * case points and centres are whitened by its Cholesky factor. Inverse 
+ * scales and normalizing constants are computed once, and evaluate is safe
+ * to call from several threads at a time. */
+class particleKernelDensity
+{
+    public:
+        /** Kernels have scale tau(k) in dimension k, and dimensions with
+         * fixed(k) != 0 are left out. With a positive cutoff, kernels 
+         * further than cutoff*tau(k) from a point in any dimension are 
+         * skipped. Each skipped kernel is below exp(-cutoff^2/2) of its 
+         * peak value at the point. A cutoff of zero is exact.*/
+        particleKernelDensity(const Eigen::MatrixXd& particles,
+                              const Eigen::VectorXd& weights,
+                              const Eigen::VectorXd& tau,
+                              const Eigen::VectorXi& fixed,
+                              double cutoff);
+        /** Kernels have covariance chol*chol^T over the dimensions with
+         * fixed(k) == 0, where chol is lower triangular. The cutoff applies
+         * to the whitened coordinates.*/
+        particleKernelDensity(const Eigen::MatrixXd& particles,
+                              const Eigen::VectorXd& weights,
+                              const Eigen::MatrixXd& chol,
+                              const Eigen::VectorXi& fixed,
+                              double cutoff);
+        /** Density at rows [start, end) of points, written to the same 
+         * rows of out*/
+        void evaluate(const Eigen::MatrixXd& points, 
+                      int start, 
+                      int end,
+                      Eigen::VectorXd& out) const;
+
+    private:
+        /** Set up the kernels from the free coordinates of scales, which
+         * are the kernel scales or, with a covariance, ones*/
+        void initialize(const Eigen::MatrixXd& particles,
+                        const Eigen::VectorXd& wts,
+                        const Eigen::VectorXd& scales,
+                        const Eigen::VectorXi& fixed,
+                        double cut);
+        /** Sort the kernels for the truncated search*/
+        void sortKernels();
+        double exactDensity(const double* x) const; 
+        double truncatedDensity(const double* x) const; 
+        /** Scaled squared distance from x to kernel j, or a negative value
+         * once any dimension is further away than limit*/
+        double scaledDistance(const double* x, int j, double limit) const;
+
+        std::vector<int> free_dims;
+        /** Cholesky factor of the kernel covariance, empty for independent
+         * kernels*/
+        Eigen::MatrixXd chol;
+        /** Inverse kernel scales of the free dimensions*/
+        Eigen::VectorXd inv_tau;
+        /** Log normalizing constant shared by all kernels*/
+        double log_norm;
+        /** Free coordinates of the kernel centres, one column per kernel*/
+        Eigen::MatrixXd centres;
+        Eigen::VectorXd weights;
+        double cutoff;
+        /** Position in free_dims along which kernels are sorted for the
+         * truncated search*/
+        int sort_dim;
+        std::vector<double> sorted_values;
+        std::vector<int> sorted_idx;
+};
+
+#endif
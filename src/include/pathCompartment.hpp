@@ -0,0 +1,110 @@
+#ifndef SPATIALSEIR_PATH_COMPARTMENT
+#define SPATIALSEIR_PATH_COMPARTMENT
+
+#include <vector>
+#include <Eigen/Core>
+#include <philox.hpp>
+#include <binomialSampler.hpp>
+#include <hostDevice.hpp>
+
+/** Residence time bins of a compartment with non-exponential transitions,
+ * for every location. Each location's bins are contiguous and used as a 
+ * ring buffer: all locations share a head index which moves back one bin 
+ * per time step, so ageing the compartment moves no data. The highest 
+ * occupied bin of each location is tracked so empty bins are skipped. */
+class pathCompartment
+{
+    public:
+        pathCompartment(int nBins, int nLoc);
+        /** Empty every bin*/
+        void reset();
+        /** Draw departures of location loc over nSteps time steps, using
+         * samplers[k] for bin k, and return how many left. Everyone in the
+         * last bin leaves. Every location must be advanced by the same
+         * nSteps before calling advanceHead.*/
+        int advance(int loc, 
+                    int nSteps, 
+                    std::vector<binomialSampler>& samplers,
+                    philox4x32& generator);
+        /** Finish a time step of nSteps, after which bin 0 is empty*/
+        void advanceHead(int nSteps);
+        /** Fill bin 0 of each location, which must be empty*/
+        void setEntrants(const Eigen::Ref<const Eigen::VectorXi>& entrants);
+        /** advance on the nBins bins col of one location, stored as a ring
+         * buffer with the given head, whose highest occupied bin is *top_bin.
+         * Shared with the CUDA backend, which keeps bins in plain arrays.*/
+        ABSEIR_HD static int advanceBins(int* col,
+                                         int* top_bin,
+                                         int nBins,
+                                         int head,
+                                         int nSteps,
+                                         binomialSampler* samplers,
+                                         philox4x32& generator);
+        /** Storage index of bin bin_idx, for a head moved back by lag*/
+        ABSEIR_HD static int physicalIndex(int nBins, int head, int bin_idx,
+                                           int lag)
+        {
+            int idx = head - lag + bin_idx;
+            idx %= nBins;
+            return(idx < 0 ? idx + nBins : idx);
+        }
+
+    private:
+        int physical(int bin_idx, int lag) const
+        {
+            return(physicalIndex(nBins, head, bin_idx, lag));
+        }
+        int nBins;
+        int head;
+        /** One column of bins per location*/
+        Eigen::MatrixXi bins;
+        /** Highest bin of each location which may be occupied, or -1*/
+        Eigen::VectorXi max_bin;
+};
+
+ABSEIR_HD inline int pathCompartment::advanceBins(int* col,
+                                                  int* top_bin,
+                                                  int nBins,
+                                                  int head,
+                                                  int nSteps,
+                                                  binomialSampler* samplers,
+                                                  philox4x32& generator)
+{
+    const int last = nBins - 1;
+    int top = *top_bin;
+    int out = 0;
+    int j, k, idx, tmpDraw;
+    for (j = 0; j < nSteps && top >= 0; j++)
+    {
+        if (top == last)
+        {
+            idx = physicalIndex(nBins, head, last, j);
+            out += col[idx];
+            col[idx] = 0;
+            top--;
+        }
+        for (k = top; k >= 0; k--)
+        {
+            idx = physicalIndex(nBins, head, k, j);
+            if (col[idx] > 0)
+            {
+                tmpDraw = samplers[k](col[idx], generator);
+                out += tmpDraw;
+                col[idx] -= tmpDraw;
+            }
+        }
+        while (top >= 0 && col[physicalIndex(nBins, head, top, j)] == 0)
+        {
+            top--;
+        }
+        // Everyone remaining moves up a bin
+        if (top >= 0)
+        {
+            top++;
+        }
+    }
+    *top_bin = top;
+    return(out);
+}
+
+#endif
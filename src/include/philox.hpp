@@ -0,0 +1,93 @@
+#ifndef SPATIALSEIR_PHILOX
+#define SPATIALSEIR_PHILOX
+
+#include <cstdint>
+#include <hostDevice.hpp>
+
+/** Philox4x32-10 counter based random number generator (Salmon et al. 2011).
+ * Each output block is a keyed bijection of a 128 bit counter, so a stream is
+ * fully described by its key and the upper half of the counter. Streams can
+ * be rebuilt at any time without carrying state between simulations, which
+ * makes simulation results independent of which thread ran them, or
+ * whether it ran on a GPU.
+ * Satisfies the UniformRandomBitGenerator requirements. */
+class philox4x32
+{
+    public:
+        typedef std::uint32_t result_type;
+
+        ABSEIR_HD philox4x32()
+        {
+            seed(0, 0, 0, 0);
+        }
+
+        /** Select the stream given by the key (key0, key1) and counter
+         * words (stream0, stream1), and rewind it to its first draw. */
+        ABSEIR_HD void seed(std::uint32_t key0, std::uint32_t key1,
+                            std::uint32_t stream0, std::uint32_t stream1)
+        {
+            key[0] = key0;
+            key[1] = key1;
+            counter[0] = 0;
+            counter[1] = 0;
+            counter[2] = stream0;
+            counter[3] = stream1;
+            output_idx = 4;
+        }
+
+        ABSEIR_HD result_type operator()()
+        {
+            if (output_idx == 4)
+            {
+                generateBlock();
+                output_idx = 0;
+            }
+            return(output[output_idx++]);
+        }
+
+        ABSEIR_HD static constexpr result_type min() {return(0);}
+        ABSEIR_HD static constexpr result_type max() {return(0xFFFFFFFF);}
+
+    private:
+        std::uint32_t key[2];
+        std::uint32_t counter[4];
+        std::uint32_t output[4];
+        int output_idx;
+
+        ABSEIR_HD void generateBlock()
+        {
+            std::uint32_t k0 = key[0];
+            std::uint32_t k1 = key[1];
+            std::uint32_t c0 = counter[0];
+            std::uint32_t c1 = counter[1];
+            std::uint32_t c2 = counter[2];
+            std::uint32_t c3 = counter[3];
+            std::uint64_t prod0, prod1;
+            int round;
+            for (round = 0; round < 10; round++)
+            {
+                if (round > 0)
+                {
+                    k0 += 0x9E3779B9;
+                    k1 += 0xBB67AE85;
+                }
+                prod0 = ((std::uint64_t) 0xD2511F53)*c0;
+                prod1 = ((std::uint64_t) 0xCD9E8D57)*c2;
+                c0 = ((std::uint32_t) (prod1 >> 32)) ^ c1 ^ k0;
+                c2 = ((std::uint32_t) (prod0 >> 32)) ^ c3 ^ k1;
+                c1 = (std::uint32_t) prod1;
+                c3 = (std::uint32_t) prod0;
+            }
+            output[0] = c0;
+            output[1] = c1;
+            output[2] = c2;
+            output[3] = c3;
+            // Only the lower 64 bits of the counter belong to the stream
+            if (++counter[0] == 0)
+            {
+                counter[1]++;
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef SPATIALSEIR_PRIOR_DISTRIBUTION
+#define SPATIALSEIR_PRIOR_DISTRIBUTION
+
+#include <memory>
+#include <Eigen/Core>
+#include <SEIRSimNodes.hpp>
+#include <philox.hpp>
+
+/** Prior distribution of the model parameters, in the column order of the
+ * sampler's parameter matrices. Normalizing constants are computed once,
+ * and logDensity and draw only read the model data, so both are safe to
+ * call from several threads at a time. */
+class priorDistribution
+{
+    public:
+        priorDistribution(std::shared_ptr<const simulationContext> context);
+        /** Number of parameter columns*/
+        int nParams() const;
+        /** Log prior density of rows [start, end) of params, written to
+         * the same rows of out. Parameters are visited a column at a time,
+         * but each row sums its terms in the order evalPrior always has.*/
+        void logDensity(const Eigen::MatrixXd& params,
+                        int start,
+                        int end,
+                        Eigen::VectorXd& out) const;
+        /** Draw row row of params from the prior using generator. Spatial
+         * parameters are redrawn until they sum to at most one; returns
+         * false if 100 tries did not manage it, keeping the last try.*/
+        bool draw(philox4x32& generator, Eigen::MatrixXd& params,
+                  int row) const;
+
+    private:
+        std::shared_ptr<const simulationContext> context;
+        int nBeta;
+        int nBetaRS;
+        int nRho;
+        int nTrans;
+        int nReport;
+        /** Prior standard deviations of the exposure and reinfection
+         * coefficients*/
+        Eigen::VectorXd exposure_sd;
+        Eigen::VectorXd reinfection_sd;
+        /** Log beta functions of the spatial and report fraction priors*/
+        double rho_log_beta;
+        double rf_alpha;
+        double rf_beta;
+        double rf_log_beta;
+        /** Shapes, rates and std::lgamma of the shapes of the gamma
+         * priors on the transition parameters, E to I first*/
+        Eigen::VectorXd trans_shape;
+        Eigen::VectorXd trans_rate;
+        Eigen::VectorXd trans_lgamma;
+        /** -trans_lgamma + trans_shape*log(trans_rate), for the Weibull
+         * hyperpriors*/
+        Eigen::VectorXd trans_log_norm;
+        /** Total initial population of each location*/
+        Eigen::VectorXi N;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SPATIALSEIR_SAMPLER_CHECKPOINT
+#define SPATIALSEIR_SAMPLER_CHECKPOINT
+
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+#include <telemetry.hpp>
+
+/** Bumped whenever the checkpoint layout changes*/
+#define CHECKPOINT_VERSION 1
+
+/** State of a Beaumont2009 or DelMoral2012 run after an epoch, enough to
+ * continue it exactly as if it had not stopped.*/
+struct samplerCheckpoint
+{
+    samplerCheckpoint() : algorithm(0), completed_epochs(0),
+                          terminated(false), proposal_counter(0),
+                          batch_counter(0), batch_accepted(0),
+                          batch_examined(0), eps(0.0) {}
+    int algorithm;
+    int completed_epochs;
+    /** Whether the run stopped early because too few proposals were
+     * accepted*/
+    bool terminated;
+    /** Positions of the proposal and simulation random streams*/
+    unsigned int proposal_counter;
+    unsigned int batch_counter;
+    /** Acceptance of the last batch, which sizes adaptive batches*/
+    int batch_accepted;
+    int batch_examined;
+    double eps;
+    Eigen::MatrixXd params;
+    Eigen::VectorXd weights;
+    /** Distances of the particles*/
+    Eigen::MatrixXd results;
+    /** State of the sampler's std::mt19937, as written by operator<<*/
+    std::string generator_state;
+    std::vector<epochTelemetry> epochs;
+};
+
+/** Write checkpoint to path. The file is written next to path and renamed
+ * over it, so an interrupted write leaves any previous checkpoint intact.
+ * On Windows the replacement is not guaranteed to be atomic.
+ * A fixed header is followed by params, weights and results as column
+ * major doubles at 8 byte aligned offsets, so the particle arrays of a
+ * checkpoint may be memory mapped, then the generator state and epoch
+ * telemetry.*/
+void writeSamplerCheckpoint(const std::string& path,
+                            const samplerCheckpoint& checkpoint);
+
+/** Read a checkpoint written by writeSamplerCheckpoint, raising
+ * abseirError if the file is missing, truncated or from another version or
+ * byte order*/
+samplerCheckpoint readSamplerCheckpoint(const std::string& path);
+
+#endif
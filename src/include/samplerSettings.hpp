@@ -0,0 +1,45 @@
+#ifndef SPATIALSEIR_SAMPLER_SETTINGS
+#define SPATIALSEIR_SAMPLER_SETTINGS
+
+#include <string>
+#include <vector>
+#include <ABSEIR_constants.hpp>
+
+#define ALG_BasicABC 1
+#define ALG_ModifiedBeaumont2009 2
+#define ALG_DelMoral2012 3
+#define ALG_Simulate 4
+
+/** Tuning of the ABC samplers, see SamplingControl in the R package for
+ * their meaning*/
+struct samplerSettings
+{
+    int simulation_width;
+    int random_seed;
+    int algorithm;
+    double target_eps;
+    double accept_fraction;
+    double shrinkage;
+    int batch_size;
+    int init_batch_size;
+    int max_batches;
+    int CPU_cores;
+    int epochs;
+    int m;
+    double lpow;
+    bool multivariatePerturbation;
+    bool early_rejection;
+    int chunk_size;
+    bool adaptive_batch;
+    double weight_cutoff;
+    double binomial_approx_threshold;
+    /** If not empty, Beaumont2009 and DelMoral2012 state is written here
+     * after every epoch, see abcSampler::loadCheckpoint*/
+    std::string checkpoint_file;
+    /** Placement of the worker threads, one of the AFFINITY_* policies of
+     * threadAffinity.hpp, and the cores used by AFFINITY_LIST*/
+    int affinity;
+    std::vector<int> affinity_cores;
+};
+
+#endif
@@ -1,21 +1,15 @@
 #ifndef SPATIALSEIR_SAMPLING_CONTROL
 #define SPATIALSEIR_SAMPLING_CONTROL
 
-//#define SPATIALSEIR_SINGLETHREAD
-
-#define ALG_BasicABC 1
-#define ALG_ModifiedBeaumont2009 2
-#define ALG_DelMoral2012 3
-#define ALG_Simulate 4
-
 #include <Rcpp.h>
-#include<modelComponent.hpp>
+#include <modelComponent.hpp>
+#include <samplerSettings.hpp>
 
 
 using namespace Rcpp;
 
 RCPP_EXPOSED_CLASS(samplingControl)
-class samplingControl : public modelComponent
+class samplingControl : public modelComponent, public samplerSettings
 {
     public:
         samplingControl(SEXP integerParameters,
@@ -23,20 +17,12 @@ class samplingControl : public modelComponent
         ~samplingControl();
     void summary();
     int getModelComponentType();
-    int simulation_width;
-    int random_seed;
-    int algorithm;
-    double target_eps;
-    double accept_fraction;
-    double shrinkage;
-    int batch_size;
-    int init_batch_size;
-    int max_batches;
-    int CPU_cores;
-    int epochs;
-    int m;
-	double lpow;
-    bool multivariatePerturbation;
+    /** Write sampler state to path after every epoch, or never if path
+     * is empty*/
+    void setCheckpointFile(std::string path);
+    /** Place worker threads by policy, one of "none", "compact", 
+     * "scatter" or "list", with cores giving the CPUs for "list"*/
+    void setAffinity(std::string policy, Rcpp::IntegerVector cores);
 };
 
 
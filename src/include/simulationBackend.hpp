@@ -0,0 +1,60 @@
+#ifndef SPATIALSEIR_SIMULATION_BACKEND
+#define SPATIALSEIR_SIMULATION_BACKEND
+
+#include <functional>
+#include <Eigen/Core>
+#include <ABSEIR_constants.hpp>
+#include <SEIRSimNodes.hpp>
+#include <compartmentStore.hpp>
+
+/** Where abcSampler::run_simulations sends its batches. Backends must give
+ * the same distances for a row whichever process or thread simulates it,
+ * except that the rows cudaBackend simulates on a device are only
+ * statistically equivalent to the CPU ones.*/
+class simulationBackend
+{
+    public:
+        virtual ~simulationBackend() {}
+        /** Simulate every row of params replicates times, writing 
+         * distances to row i of results_dest and, for sim_result_atom, 
+         * compartments to slot i of results_c_dest, which is already 
+         * allocated. Replicates of a row are in consecutive rows, as for
+         * NodePool::enqueue. threshold is the early rejection threshold on
+         * the accumulated distance. If accept is given, replicates must be
+         * one, and only the leading rows holding accept_needed accepted
+         * rows need to be simulated, as for NodePool::enqueueUntil.*/
+        virtual void run(const Eigen::MatrixXd& params,
+                         int replicates,
+                         simulationAction sim_type_atom,
+                         Eigen::MatrixXd* results_dest,
+                         compartmentStore* results_c_dest,
+                         double threshold,
+                         int accept_needed,
+                         const std::function<bool(int)>* accept) = 0;
+        /** Zero the simulation counters*/
+        virtual void resetTelemetry() = 0;
+        /** Simulations run since the last reset, by all processes*/
+        virtual long totalSimulations() const = 0;
+};
+
+/** Runs every batch on the threads of a NodePool in this process*/
+class localBackend : public simulationBackend
+{
+    public:
+        localBackend(NodePool* pool);
+        void run(const Eigen::MatrixXd& params,
+                 int replicates,
+                 simulationAction sim_type_atom,
+                 Eigen::MatrixXd* results_dest,
+                 compartmentStore* results_c_dest,
+                 double threshold,
+                 int accept_needed,
+                 const std::function<bool(int)>* accept);
+        void resetTelemetry();
+        long totalSimulations() const;
+
+    private:
+        NodePool* pool;
+};
+
+#endif
@@ -13,6 +13,7 @@
 #include "./SEIRSimNodes.hpp"
 #include "./transitionPriors.hpp"
 #include "./transitionDistribution.hpp"
+#include "./abcSampler.hpp"
 
 struct samplingResultSet
 {
@@ -20,25 +21,6 @@ struct samplingResultSet
     Rcpp::NumericMatrix params;
 };
 
-struct simulationResultSet
-{
-    Eigen::MatrixXi S;
-    Eigen::MatrixXi E;
-    Eigen::MatrixXi I;
-    Eigen::MatrixXi R;
-    Eigen::MatrixXi S_star;
-    Eigen::MatrixXi E_star;
-    Eigen::MatrixXi I_star;
-    Eigen::MatrixXi R_star;
-    Eigen::MatrixXd X;
-    Eigen::MatrixXd p_se;
-    Eigen::MatrixXd p_ei;
-    Eigen::MatrixXd p_ir;
-    Eigen::MatrixXd rho;
-    Eigen::MatrixXd beta;
-    Eigen::MatrixXd result; 
-};
-
 class dataModel;
 class exposureModel;
 class distanceModel;
@@ -46,10 +28,11 @@ class initialValueContainer;
 class reinfectionModel;
 class samplingControl;
 class transitionPriors;
-class NodePool;
 
 using namespace Rcpp;
 
+/** R binding of abcSampler: checks and collects the model components, and
+ * converts the sampler output to R objects.*/
 class spatialSEIRModel
 {
     public: 
@@ -65,112 +48,45 @@ class spatialSEIRModel
          * posterior, and optionally set verbose to 0, 1, or 2 for 
          * different levels of output.*/ 
         Rcpp::List sample(SEXP nSample, SEXP returnComps, SEXP verbose);
-        /** Evaluate the prior distribution of a particular set of parameters*/
-        double evalPrior(Eigen::VectorXd param_values);
+        /** Simulate every row of params replicates times, reusing the
+         * worker pool and model data of this object. Returns the distances
+         * as result, one row per simulation with the replicates of a row
+         * together, and with returnComps the compartments chosen by 
+         * setCompartmentCapture as simulationResults.*/
+        Rcpp::List simulate(Eigen::MatrixXd params, int replicates,
+                            bool returnComps);
+        /** Choose which compartments sample returns when asked for them 
+         * (names among S, E, I, R, S_star, E_star, I_star, R_star and 
+         * p_se), whether integer compartments are stored in 16 bits, and 
+         * whether they are returned as T x L x N arrays rather than one
+         * list per simulation.*/
+        void setCompartmentCapture(SEXP compartments, SEXP compact, 
+                                   SEXP arrays);
         /** Assign the parameter values manually */
         bool setParameters(Eigen::MatrixXd param_values, 
                            Eigen::VectorXd weights,
                            Eigen::MatrixXd results,
                            double eps);
-
-        /** Public for caching purposes. Consider factoring accessors back 
-         * into class methods*/
-        /* Parameter sample covariance matrix*/
-        Eigen::MatrixXd parameterCov;
-
-        /* Parameter inverse sample covariance matrix*/
-        Eigen::MatrixXd parameterICov;
-
-        /* Parameter sample covariance matrix*/
-        double parameterICovDet;
-
-        /* Parameter sample covariance matrix cholesky factor*/
-        Eigen::MatrixXd parameterL;
+        /** Continue the run saved to the checkpoint file at path with the
+         * next call to sample, returning its number of completed epochs*/
+        int loadCheckpoint(std::string path);
 
         /** Destructor */
         ~spatialSEIRModel();
 
     private:
-        /** Set parameters from prior distribution*/
-        Eigen::MatrixXd generateParamsPrior(int N);
-
-        /** Simulate epidemics based on parameters*/
-        void run_simulations(Eigen::MatrixXd params, 
-                             std::string sim_type_atom,
-                             Eigen::MatrixXd* result_recip,
-                             std::vector<simulationResultSet>* result_c_recip);
-
-        /** Run simulation using basic ABC algorithm */
-        Rcpp::List sample_basic(int nSample, int verbose, 
-                                std::string sim_type_atom);
-
-        /** Run simulation using Beaumont 2009 algorithm */
-        Rcpp::List sample_Beaumont2009(int nSample, int verbose, 
-                                std::string sim_type_atom);
-
-        /** Run simulation using Del Moral 2012 algorithm */
-        Rcpp::List sample_DelMoral2012(int nSample, int verbose, 
-                                std::string sim_type_atom);
-
-        /** Use current parameters to simulate epidemics*/
-        Rcpp::List sample_Simulate(int nSample, int enforceEps, int verbose);
-
-        /** Flag for whether params have been initialized*/
-        bool is_initialized;
-
-        /** If simulation is re-started, need initial epsilon stored*/
-        double init_eps;
-
-        /** If simulation is re-started, need initial weights stored*/
-        Eigen::VectorXd init_weights;
+        /** Convert the first nSim slots of store to R, in the format 
+         * chosen by setCompartmentCapture*/
+        Rcpp::List wrapCompartments(const compartmentStore& store, int nSim);
 
-        /** If simulation is re-started, need initial params stored */
-        Eigen::MatrixXd init_param_matrix;
+        /** Epoch and worker telemetry of the last run, converted to R*/
+        Rcpp::List telemetryList();
 
-        /** If simulation is re-started, need initial results stored */
-        Eigen::MatrixXd init_results_double;
+        /** The ABC samplers*/
+        std::unique_ptr<abcSampler> sampler;
 
-        /** General E to I transition Distribution*/
-        std::unique_ptr<transitionDistribution> EI_transition_dist;
-
-        /** General I to R transition Distribution*/
-        std::unique_ptr<transitionDistribution> IR_transition_dist;
-
-        /** Matrix of parameters */
-        Eigen::MatrixXd proposed_param_matrix;
-
-        /** Matrix of parameters */
-        Eigen::MatrixXd param_matrix;
-
-        /** Matrix of parameters */
-        Eigen::MatrixXd prev_param_matrix;  
-
-        /** Result index vector */
-        std::vector<int> result_idx;
-
-        /** Results vector*/
-        Eigen::MatrixXd results_double;
-
-        /** Results vector*/
-        Eigen::MatrixXd prev_results_double;
-
-        /** Results vector*/
-        Eigen::MatrixXd proposed_results_double;
-
-        /** particles - cache*/
-        Eigen::MatrixXd proposal_cache;
-
-        /** particles - cache*/
-        Eigen::MatrixXd preproposal_params;
-
-        /** particles - cache*/
-        Eigen::MatrixXd preproposal_results;
-
-        /** Complete results vector */
-        std::vector<simulationResultSet> results_complete;
-
-        /** Complete results vector */
-        std::vector<simulationResultSet> proposed_results_complete;
+        /** Whether captured compartments are returned as arrays*/
+        bool capture_arrays;
 
         /** Pointer to a dataModel object*/
         dataModel* dataModelInstance;
@@ -192,13 +108,6 @@ class spatialSEIRModel
 
         /** Pointer to a samplingControl object.*/
         samplingControl* samplingControlInstance;
-
-        /** Thread pool */
-        std::unique_ptr<NodePool> worker_pool; 
-
-        /** A persistant pointer to a properly initialized random 
-         * number generator.*/
-        std::mt19937* generator;
 };
 
 #endif
@@ -0,0 +1,73 @@
+#ifndef SPATIALSEIR_TELEMETRY
+#define SPATIALSEIR_TELEMETRY
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock telemetryClock;
+
+/** Stopwatch for splitting an epoch into phases*/
+class phaseTimer
+{
+    public:
+        phaseTimer() : start(telemetryClock::now()), last(start) {}
+        /** Seconds since construction or the previous lap*/
+        double lap()
+        {
+            const telemetryClock::time_point now = telemetryClock::now();
+            const double out = std::chrono::duration<double>(now - last).count();
+            last = now;
+            return(out);
+        }
+        /** Seconds since construction*/
+        double total() const
+        {
+            return(std::chrono::duration<double>(telemetryClock::now()
+                        - start).count());
+        }
+
+    private:
+        telemetryClock::time_point start;
+        telemetryClock::time_point last;
+};
+
+/** Wall time spent in each phase of one sampler epoch, and the number of
+ * simulations it ran and accepted*/
+struct epochTelemetry
+{
+    epochTelemetry(const std::string& stg) : stage(stg), proposal_seconds(0.0),
+                       simulation_seconds(0.0), weight_seconds(0.0), 
+                       epsilon_seconds(0.0), total_seconds(0.0), 
+                       simulations(0), accepted(0) {}
+    /** "prior" for the initial draw from the prior, "epoch" for sampler
+     * iterations and "compartments" for the compartment capture pass*/
+    std::string stage;
+    double proposal_seconds;
+    double simulation_seconds;
+    double weight_seconds;
+    double epsilon_seconds;
+    double total_seconds;
+    long simulations;
+    long accepted;
+    /** Rows and acceptances of each simulation batch of the epoch*/
+    std::vector<int> batch_sizes;
+    std::vector<int> batch_accepted;
+};
+
+/** Work done by one NodePool worker since its counters were reset*/
+struct workerTelemetry
+{
+    workerTelemetry() : busy_seconds(0.0), simulation_seconds(0.0),
+                        queue_wait_seconds(0.0), tasks(0), simulations(0) {}
+    /** Time spent running tasks*/
+    double busy_seconds;
+    /** Part of busy_seconds spent running simulation tasks*/
+    double simulation_seconds;
+    /** Summed time tasks waited in a queue before this worker took them*/
+    double queue_wait_seconds;
+    long tasks;
+    long simulations;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef SPATIALSEIR_THREAD_AFFINITY
+#define SPATIALSEIR_THREAD_AFFINITY
+
+#include <vector>
+
+/** Placement of NodePool workers on CPUs, see SamplingControl in the R
+ * package*/
+#define AFFINITY_NONE 0
+#define AFFINITY_COMPACT 1
+#define AFFINITY_SCATTER 2
+#define AFFINITY_LIST 3
+
+/** A CPU the process may run on, and the NUMA node it belongs to*/
+struct cpuSlot
+{
+    int cpu;
+    int numa_node;
+};
+
+/** CPUs the process may run on, in id order. Empty where threads can not
+ * be placed, i.e. outside Linux.*/
+std::vector<cpuSlot> availableCpus();
+
+/** The CPU of each of nThreads workers. AFFINITY_COMPACT fills the CPUs
+ * of one NUMA node before moving to the next, AFFINITY_SCATTER deals
+ * workers round robin across nodes and AFFINITY_LIST takes cores in
+ * order. Workers wrap around when there are more than CPUs. Empty for
+ * AFFINITY_NONE, or if threads can not be placed. Raises abseirError for
+ * listed cores the process may not run on.*/
+std::vector<cpuSlot> placeWorkers(int policy, const std::vector<int>& cores,
+                                  int nThreads);
+
+/** Restrict the calling thread to cpu, returning false on failure*/
+bool pinCurrentThread(int cpu);
+
+#endif
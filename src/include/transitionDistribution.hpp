@@ -1,6 +1,7 @@
 #ifndef SPATIALSEIR_TRANSITION_DISTRIBUTIONS
 #define SPATIALSEIR_TRANSITION_DISTRIBUTIONS
 
+#include<vector>
 #include<Eigen/Core>
 
 class transitionDistribution 
@@ -8,10 +9,19 @@ class transitionDistribution
     public:
         virtual ~transitionDistribution(){};
         virtual double evalParamPrior(Eigen::VectorXd params) = 0;
-        virtual void setCurrentParams(Eigen::VectorXd currentParams) = 0;
+        /** Set the parameters and refill the transition table*/
+        virtual void setCurrentParams(const Eigen::VectorXd& currentParams) = 0;
         virtual double getTransitionProb(int startIdx, 
                                          int stopIdx) = 0; 
         virtual double getAvgMembership() = 0;
+        /** Entry k is getTransitionProb(k, k+1) at the current parameters*/
+        const std::vector<double>& getTransitionTable() const
+        {
+            return(transition_table);
+        }
+
+    protected:
+        std::vector<double> transition_table;
 };
 
 class weibullTransitionDistribution : public transitionDistribution
@@ -19,7 +29,7 @@ class weibullTransitionDistribution : public transitionDistribution
     public:
         weibullTransitionDistribution(Eigen::VectorXd priorParams);
         double evalParamPrior(Eigen::VectorXd params);
-        void setCurrentParams(Eigen::VectorXd currentParams);
+        void setCurrentParams(const Eigen::VectorXd& currentParams);
         double getTransitionProb(int startIdx, 
                                  int stopIdx);
         double getAvgMembership();
@@ -31,6 +41,8 @@ class weibullTransitionDistribution : public transitionDistribution
         double scalePriorBeta;
         double currentShape;
         double currentScale;
+        /** Cumulative hazard at each bin boundary, for filling the table*/
+        std::vector<double> cumulative_hazard;
 };
 
 #endif
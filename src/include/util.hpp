@@ -1,21 +1,25 @@
 #ifndef SPATIALSEIR_UTILDEF
 #define SPATIALSEIR_UTILDEF
-#include <Rcpp.h>
+#include <vector>
 #include <Eigen/Core>
 
-using namespace Rcpp;
+typedef Eigen::Matrix<bool, Eigen::Dynamic, Eigen::Dynamic> MatrixXb;
 
+/** Ring buffer of the last nLags nrow x ncol pressure matrices*/
 class compartment_tap{
     public:
-        compartment_tap(int nrow, int ncol);
-        virtual void push(Eigen::VectorXi current_comp);
-        Eigen::VectorXi get(int lag);
+        compartment_tap(int nLags, int nrow, int ncol);
+        virtual void push(const Eigen::MatrixXd& current_pressure);
+        /** Values from lag+1 pushes ago, read in place*/
+        const Eigen::MatrixXd& get(int lag) const;
+        /** Forget all stored values, keeping the storage*/
+        void reset();
 
     private:
         int idx;
         int nLags;
         std::vector<int> beenSet;
-        Eigen::MatrixXi compartment;
+        std::vector<Eigen::MatrixXd> pressure;
 };
 
 
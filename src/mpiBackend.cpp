@@ -0,0 +1,510 @@
+#include <mpiBackend.hpp>
+
+#ifdef ABSEIR_USE_MPI
+
+#include <mpi.h>
+#include <map>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+/** Commands from rank 0, sent as the first int of a message*/
+#define MPI_CMD_OPEN 1
+#define MPI_CMD_BATCH 2
+#define MPI_CMD_CLOSE 3
+#define MPI_CMD_SHUTDOWN 4
+
+#define MPI_TAG_COMMAND 1
+#define MPI_TAG_REPLY 2
+
+namespace
+{
+    /** Packs values into a byte buffer sent as a single message*/
+    class messageWriter
+    {
+        public:
+            template<typename T> void put(const T& x)
+            {
+                putArray(&x, 1);
+            }
+            template<typename T> void putArray(const T* x, long n)
+            {
+                const char* p = reinterpret_cast<const char*>(x);
+                bytes.insert(bytes.end(), p, p + n*sizeof(T));
+            }
+            template<typename Derived>
+            void putMatrix(const Eigen::PlainObjectBase<Derived>& x)
+            {
+                put<long>(x.rows());
+                put<long>(x.cols());
+                putArray(x.data(), x.size());
+            }
+            void putString(const std::string& x)
+            {
+                put<long>(x.size());
+                putArray(x.data(), x.size());
+            }
+            void send(int dest, int tag) const
+            {
+                MPI_Send(const_cast<char*>(bytes.data()), bytes.size(),
+                         MPI_BYTE, dest, tag, MPI_COMM_WORLD);
+            }
+
+        private:
+            std::vector<char> bytes;
+    };
+
+    /** Receives a message and unpacks it in the order it was written*/
+    class messageReader
+    {
+        public:
+            /** Block until a message with tag arrives from source, which
+             * may be MPI_ANY_SOURCE*/
+            messageReader(int source, int tag) : pos(0)
+            {
+                MPI_Status status;
+                int n;
+                MPI_Probe(source, tag, MPI_COMM_WORLD, &status);
+                MPI_Get_count(&status, MPI_BYTE, &n);
+                bytes.resize(n);
+                src = status.MPI_SOURCE;
+                MPI_Recv(bytes.data(), n, MPI_BYTE, src, tag, MPI_COMM_WORLD,
+                         MPI_STATUS_IGNORE);
+            }
+            template<typename T> T get()
+            {
+                T x;
+                getArray(&x, 1);
+                return(x);
+            }
+            template<typename T> void getArray(T* x, long n)
+            {
+                std::memcpy(x, bytes.data() + pos, n*sizeof(T));
+                pos += n*sizeof(T);
+            }
+            template<typename M> M getMatrix()
+            {
+                const long rows = get<long>();
+                const long cols = get<long>();
+                M x(rows, cols);
+                getArray(x.data(), x.size());
+                return(x);
+            }
+            std::string getString()
+            {
+                std::string x(get<long>(), ' ');
+                getArray(&x[0], x.size());
+                return(x);
+            }
+            int source() const
+            {
+                return(src);
+            }
+
+        private:
+            std::vector<char> bytes;
+            size_t pos;
+            int src;
+    };
+
+    void putDistanceMatrix(messageWriter& msg, const distanceMatrix& dm)
+    {
+        msg.put<int>(dm.isSparse() ? DM_STORAGE_SPARSE : DM_STORAGE_DENSE);
+        msg.put<int>(dm.isSingle() ? DM_PRECISION_SINGLE : 
+                                     DM_PRECISION_DOUBLE);
+        msg.putMatrix(dm.toDense());
+    }
+
+    distanceMatrix getDistanceMatrix(messageReader& msg)
+    {
+        const int storage = msg.get<int>();
+        const int precision = msg.get<int>();
+        return(distanceMatrix(msg.getMatrix<Eigen::MatrixXd>(), storage,
+                              precision));
+    }
+
+    /** Write the parts of the context read by the simulation nodes*/
+    void putContext(messageWriter& msg, const simulationContext& ctx)
+    {
+        msg.put<int>(ctx.random_seed);
+        msg.putMatrix(ctx.S0);
+        msg.putMatrix(ctx.E0);
+        msg.putMatrix(ctx.I0);
+        msg.putMatrix(ctx.R0);
+        msg.putMatrix(ctx.offset);
+        msg.putMatrix(ctx.Y);
+        msg.putMatrix(ctx.na_mask);
+        msg.put<int>(ctx.dataModelType);
+        msg.put<long>(ctx.DM_vec.size());
+        for (unsigned int i = 0; i < ctx.DM_vec.size(); i++)
+        {
+            putDistanceMatrix(msg, ctx.DM_vec[i]);
+        }
+        msg.put<long>(ctx.TDM_vec.size());
+        for (unsigned int i = 0; i < ctx.TDM_vec.size(); i++)
+        {
+            msg.put<long>(ctx.TDM_vec[i].size());
+            for (unsigned int j = 0; j < ctx.TDM_vec[i].size(); j++)
+            {
+                putDistanceMatrix(msg, ctx.TDM_vec[i][j]);
+            }
+        }
+        msg.put<long>(ctx.TDM_empty.size());
+        msg.putArray(ctx.TDM_empty.data(), ctx.TDM_empty.size());
+        msg.putMatrix(ctx.X);
+        msg.putMatrix(ctx.X_rs);
+        msg.putString(ctx.transitionMode);
+        msg.putMatrix(ctx.E_to_I_prior);
+        msg.putMatrix(ctx.I_to_R_prior);
+        msg.put<double>(ctx.inf_mean);
+        msg.putMatrix(ctx.spatial_prior);
+        msg.putMatrix(ctx.exposure_precision);
+        msg.putMatrix(ctx.reinfection_precision);
+        msg.putMatrix(ctx.exposure_mean);
+        msg.putMatrix(ctx.reinfection_mean);
+        msg.put<double>(ctx.phi);
+        msg.put<int>(ctx.data_compartment);
+        msg.put<bool>(ctx.cumulative);
+        msg.put<int>(ctx.m);
+        msg.put<double>(ctx.lpow);
+        msg.put<double>(ctx.binomial_approx_threshold);
+    }
+
+    std::shared_ptr<const simulationContext> getContext(messageReader& msg)
+    {
+        std::shared_ptr<simulationContext> ctx(new simulationContext());
+        ctx -> random_seed = msg.get<int>();
+        ctx -> S0 = msg.getMatrix<Eigen::VectorXi>();
+        ctx -> E0 = msg.getMatrix<Eigen::VectorXi>();
+        ctx -> I0 = msg.getMatrix<Eigen::VectorXi>();
+        ctx -> R0 = msg.getMatrix<Eigen::VectorXi>();
+        ctx -> offset = msg.getMatrix<Eigen::VectorXd>();
+        ctx -> Y = msg.getMatrix<Eigen::MatrixXi>();
+        ctx -> na_mask = msg.getMatrix<MatrixXb>();
+        ctx -> dataModelType = msg.get<int>();
+        const long nDM = msg.get<long>();
+        for (long i = 0; i < nDM; i++)
+        {
+            ctx -> DM_vec.push_back(getDistanceMatrix(msg));
+        }
+        ctx -> TDM_vec.resize(msg.get<long>());
+        for (unsigned int i = 0; i < ctx -> TDM_vec.size(); i++)
+        {
+            const long nTDM = msg.get<long>();
+            for (long j = 0; j < nTDM; j++)
+            {
+                ctx -> TDM_vec[i].push_back(getDistanceMatrix(msg));
+            }
+        }
+        ctx -> TDM_empty.resize(msg.get<long>());
+        msg.getArray(ctx -> TDM_empty.data(), ctx -> TDM_empty.size());
+        ctx -> X = msg.getMatrix<Eigen::MatrixXd>();
+        ctx -> X_rs = msg.getMatrix<Eigen::MatrixXd>();
+        ctx -> transitionMode = msg.getString();
+        ctx -> E_to_I_prior = msg.getMatrix<Eigen::MatrixXd>();
+        ctx -> I_to_R_prior = msg.getMatrix<Eigen::MatrixXd>();
+        ctx -> inf_mean = msg.get<double>();
+        ctx -> spatial_prior = msg.getMatrix<Eigen::VectorXd>();
+        ctx -> exposure_precision = msg.getMatrix<Eigen::VectorXd>();
+        ctx -> reinfection_precision = msg.getMatrix<Eigen::VectorXd>();
+        ctx -> exposure_mean = msg.getMatrix<Eigen::VectorXd>();
+        ctx -> reinfection_mean = msg.getMatrix<Eigen::VectorXd>();
+        ctx -> phi = msg.get<double>();
+        ctx -> data_compartment = msg.get<int>();
+        ctx -> cumulative = msg.get<bool>();
+        ctx -> m = msg.get<int>();
+        ctx -> lpow = msg.get<double>();
+        ctx -> binomial_approx_threshold = msg.get<double>();
+        return(ctx);
+    }
+
+    /** Tell the workers to exit, and finalize MPI. Registered with atexit
+     * when workerCount initializes MPI.*/
+    void shutdownWorkers()
+    {
+        int size;
+        MPI_Comm_size(MPI_COMM_WORLD, &size);
+        messageWriter msg;
+        msg.put<int>(MPI_CMD_SHUTDOWN);
+        for (int w = 1; w < size; w++)
+        {
+            msg.send(w, MPI_TAG_COMMAND);
+        }
+        MPI_Finalize();
+    }
+
+    int next_model_id = 0;
+}
+
+mpiBackend::mpiBackend(std::shared_ptr<const simulationContext> context,
+                       NodePool* pl,
+                       int threads,
+                       int chunk_size)
+    : pool(pl), local(pl), model_id(next_model_id++),
+      nWorkers(workerCount()), remote_simulations(0)
+{
+    messageWriter msg;
+    msg.put<int>(MPI_CMD_OPEN);
+    msg.put<int>(model_id);
+    msg.put<int>(threads);
+    msg.put<int>(chunk_size);
+    putContext(msg, *context);
+    for (int w = 1; w <= nWorkers; w++)
+    {
+        msg.send(w, MPI_TAG_COMMAND);
+    }
+}
+
+mpiBackend::~mpiBackend()
+{
+    int finalized;
+    MPI_Finalized(&finalized);
+    if (finalized)
+    {
+        return;
+    }
+    messageWriter msg;
+    msg.put<int>(MPI_CMD_CLOSE);
+    msg.put<int>(model_id);
+    for (int w = 1; w <= nWorkers; w++)
+    {
+        msg.send(w, MPI_TAG_COMMAND);
+    }
+}
+
+int mpiBackend::workerCount()
+{
+    int initialized, rank, size;
+    MPI_Initialized(&initialized);
+    if (!initialized)
+    {
+        // Only this thread talks to MPI
+        int provided;
+        MPI_Init_thread(nullptr, nullptr, MPI_THREAD_FUNNELED, &provided);
+        std::atexit(shutdownWorkers);
+    }
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    return(rank == 0 ? size - 1 : 0);
+}
+
+void mpiBackend::runLocalChunk(const Eigen::MatrixXd& params,
+                               int first,
+                               int n,
+                               double threshold,
+                               unsigned int batch_id,
+                               Eigen::MatrixXd* results_dest)
+{
+    chunk_params = params.middleRows(first, n);
+    chunk_results.resize(n, results_dest -> cols());
+    pool -> setResultsDest(&chunk_results, nullptr);
+    pool -> enqueueRows(sim_atom, &chunk_params, threshold, batch_id, first);
+    pool -> awaitFinished();
+    results_dest -> middleRows(first, n) = chunk_results;
+}
+
+void mpiBackend::run(const Eigen::MatrixXd& params,
+                     int replicates,
+                     simulationAction sim_type_atom,
+                     Eigen::MatrixXd* results_dest,
+                     compartmentStore* results_c_dest,
+                     double threshold,
+                     int accept_needed,
+                     const std::function<bool(int)>* accept)
+{
+    if (sim_type_atom == sim_result_atom || nWorkers == 0)
+    {
+        local.run(params, replicates, sim_type_atom, results_dest, 
+                  results_c_dest, threshold, accept_needed, accept);
+        return;
+    }
+    if (replicates > 1)
+    {
+        // Chunks are blocks of rows, so replicated rows are sent repeated
+        Eigen::MatrixXd repeated(params.rows()*replicates, params.cols());
+        for (int i = 0; i < repeated.rows(); i++)
+        {
+            repeated.row(i) = params.row(i/replicates);
+        }
+        run(repeated, 1, sim_type_atom, results_dest, results_c_dest,
+            threshold, accept_needed, accept);
+        return;
+    }
+    const int nRows = params.rows();
+    if (nRows == 0)
+    {
+        return;
+    }
+    const unsigned int batch_id = pool -> reserveBatch();
+    // Several chunks per rank, so that ranks finishing early take more
+    const int chunk = std::max(1, nRows/(4*(nWorkers + 1)));
+    const int nChunks = (nRows + chunk - 1)/chunk;
+
+    // As in NodePool::enqueueUntil, no new chunks are handed out once the
+    // finished chunks from row 0 hold enough acceptances.
+    std::vector<int> chunk_accepted(nChunks, -1);
+    int frontier_chunk = 0;
+    int frontier_accepted = 0;
+    bool satisfied = false;
+    auto chunkFinished = [&](int c)
+    {
+        if (accept == nullptr)
+        {
+            return;
+        }
+        int nAccepted = 0;
+        for (int i = c*chunk; i < std::min(nRows, (c + 1)*chunk); i++)
+        {
+            nAccepted += (*accept)(i);
+        }
+        chunk_accepted[c] = nAccepted;
+        while (!satisfied && frontier_chunk < nChunks &&
+               chunk_accepted[frontier_chunk] >= 0)
+        {
+            frontier_accepted += chunk_accepted[frontier_chunk];
+            frontier_chunk++;
+            satisfied = (frontier_accepted >= accept_needed);
+        }
+    };
+
+    std::vector<int> assigned(nWorkers, -1);
+    int nOutstanding = 0;
+    auto receiveChunk = [&]()
+    {
+        messageReader msg(MPI_ANY_SOURCE, MPI_TAG_REPLY);
+        const int c = msg.get<int>();
+        const Eigen::MatrixXd distances = msg.getMatrix<Eigen::MatrixXd>();
+        results_dest -> middleRows(c*chunk, distances.rows()) = distances;
+        remote_simulations += distances.rows();
+        assigned[msg.source() - 1] = -1;
+        nOutstanding--;
+        chunkFinished(c);
+    };
+
+    int next = 0;
+    while (true)
+    {
+        for (int w = 0; w < nWorkers; w++)
+        {
+            if (assigned[w] < 0 && next < nChunks && !satisfied)
+            {
+                const int first = next*chunk;
+                messageWriter msg;
+                msg.put<int>(MPI_CMD_BATCH);
+                msg.put<int>(model_id);
+                msg.put<int>(next);
+                msg.put<unsigned int>(batch_id);
+                msg.put<int>(first);
+                msg.put<double>(threshold);
+                msg.putMatrix(Eigen::MatrixXd(params.middleRows(first,
+                                std::min(chunk, nRows - first))));
+                msg.send(w + 1, MPI_TAG_COMMAND);
+                assigned[w] = next++;
+                nOutstanding++;
+            }
+        }
+        if (next < nChunks && !satisfied)
+        {
+            const int c = next++;
+            runLocalChunk(params, c*chunk, std::min(chunk, nRows - c*chunk),
+                          threshold, batch_id, results_dest);
+            chunkFinished(c);
+        }
+        else if (nOutstanding > 0)
+        {
+            receiveChunk();
+        }
+        else
+        {
+            break;
+        }
+        int waiting = 1;
+        while (nOutstanding > 0 && waiting)
+        {
+            MPI_Iprobe(MPI_ANY_SOURCE, MPI_TAG_REPLY, MPI_COMM_WORLD, &waiting,
+                       MPI_STATUS_IGNORE);
+            if (waiting)
+            {
+                receiveChunk();
+            }
+        }
+    }
+}
+
+void mpiBackend::resetTelemetry()
+{
+    remote_simulations = 0;
+    pool -> resetTelemetry();
+}
+
+long mpiBackend::totalSimulations() const
+{
+    return(remote_simulations + pool -> totalSimulations());
+}
+
+/** A model served by a worker rank*/
+struct servedModel
+{
+    std::shared_ptr<const simulationContext> context;
+    Eigen::MatrixXd results;
+    compartmentStore compartments;
+    std::unique_ptr<NodePool> pool;
+};
+
+int mpiServe()
+{
+    int provided;
+    MPI_Init_thread(nullptr, nullptr, MPI_THREAD_FUNNELED, &provided);
+    std::map<int, std::unique_ptr<servedModel> > models;
+    while (true)
+    {
+        messageReader msg(0, MPI_TAG_COMMAND);
+        const int command = msg.get<int>();
+        if (command == MPI_CMD_SHUTDOWN)
+        {
+            break;
+        }
+        const int id = msg.get<int>();
+        if (command == MPI_CMD_OPEN)
+        {
+            const int threads = msg.get<int>();
+            const int chunk_size = msg.get<int>();
+            std::unique_ptr<servedModel> model(new servedModel());
+            model -> context = getContext(msg);
+            model -> pool = std::unique_ptr<NodePool>(
+                    new NodePool(&(model -> results),
+                                 &(model -> compartments),
+                                 threads, model -> context, chunk_size));
+            models[id] = std::move(model);
+        }
+        else if (command == MPI_CMD_CLOSE)
+        {
+            models.erase(id);
+        }
+        else if (command == MPI_CMD_BATCH)
+        {
+            servedModel& model = *models[id];
+            const int c = msg.get<int>();
+            const unsigned int batch_id = msg.get<unsigned int>();
+            const int first = msg.get<int>();
+            const double threshold = msg.get<double>();
+            const Eigen::MatrixXd params = msg.getMatrix<Eigen::MatrixXd>();
+            model.results.resize(params.rows(), model.context -> m);
+            model.pool -> setResultsDest(&(model.results),
+                                         &(model.compartments));
+            model.pool -> enqueueRows(sim_atom, &params, threshold, batch_id,
+                                      first);
+            model.pool -> awaitFinished();
+            messageWriter reply;
+            reply.put<int>(c);
+            reply.putMatrix(model.results);
+            reply.send(0, MPI_TAG_REPLY);
+        }
+    }
+    models.clear();
+    MPI_Finalize();
+    return(0);
+}
+
+#endif
@@ -0,0 +1,176 @@
+#include <particleKernelDensity.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+particleKernelDensity::particleKernelDensity(const Eigen::MatrixXd& particles,
+                                             const Eigen::VectorXd& wts,
+                                             const Eigen::VectorXd& tau,
+                                             const Eigen::VectorXi& fixed,
+                                             double cut)
+{
+    initialize(particles, wts, tau, fixed, cut);
+    sortKernels();
+}
+
+particleKernelDensity::particleKernelDensity(const Eigen::MatrixXd& particles,
+                                             const Eigen::VectorXd& wts,
+                                             const Eigen::MatrixXd& L,
+                                             const Eigen::VectorXi& fixed,
+                                             double cut)
+{
+    initialize(particles, wts, Eigen::VectorXd::Ones(particles.cols()), 
+               fixed, cut);
+    chol = L;
+    centres = chol.triangularView<Eigen::Lower>().solve(centres);
+    log_norm -= chol.diagonal().array().log().sum();
+    sortKernels();
+}
+
+void particleKernelDensity::initialize(const Eigen::MatrixXd& particles,
+                                       const Eigen::VectorXd& wts,
+                                       const Eigen::VectorXd& scales,
+                                       const Eigen::VectorXi& fixed,
+                                       double cut)
+{
+    int i, j, k;
+    const int N = particles.rows();
+    for (k = 0; k < particles.cols(); k++)
+    {
+        if (!fixed(k))
+        {
+            free_dims.push_back(k);
+        }
+    }
+    const int nFree = free_dims.size();
+    weights = wts;
+    cutoff = (nFree > 0 ? cut : 0.0);
+    inv_tau = Eigen::VectorXd(nFree);
+    centres = Eigen::MatrixXd(nFree, N);
+    log_norm = -0.5*nFree*std::log(2.0*M_PI);
+    for (i = 0; i < nFree; i++)
+    {
+        k = free_dims[i];
+        inv_tau(i) = 1.0/scales(k);
+        log_norm -= std::log(scales(k));
+        for (j = 0; j < N; j++)
+        {
+            centres(i, j) = particles(j, k);
+        }
+    }
+}
+
+void particleKernelDensity::sortKernels()
+{
+    int i, j;
+    const int N = centres.cols();
+    const int nFree = free_dims.size();
+    sort_dim = 0;
+    if (cutoff > 0)
+    {
+        // Sort along the dimension in which the particles are most spread
+        // out relative to the kernel scale, so the search window holds as 
+        // few kernels as possible.
+        double spread, maxSpread = -1.0;
+        for (i = 0; i < nFree; i++)
+        {
+            spread = (centres.row(i).maxCoeff() - 
+                      centres.row(i).minCoeff())*inv_tau(i);
+            if (spread > maxSpread)
+            {
+                maxSpread = spread;
+                sort_dim = i;
+            }
+        }
+        sorted_idx = std::vector<int>(N);
+        for (j = 0; j < N; j++)
+        {
+            sorted_idx[j] = j;
+        }
+        std::sort(sorted_idx.begin(), sorted_idx.end(),
+                [this](int j1, int j2){
+                    return(centres(sort_dim, j1) < centres(sort_dim, j2));});
+        sorted_values = std::vector<double>(N);
+        for (j = 0; j < N; j++)
+        {
+            sorted_values[j] = centres(sort_dim, sorted_idx[j]);
+        }
+    }
+}
+
+double particleKernelDensity::scaledDistance(const double* x, 
+                                             int j, 
+                                             double limit) const
+{
+    const double* c = centres.col(j).data();
+    double z, out = 0.0;
+    for (int i = 0; i < (int) free_dims.size(); i++)
+    {
+        z = (x[i] - c[i])*inv_tau(i);
+        if (std::abs(z) > limit)
+        {
+            return(-1.0);
+        }
+        out += z*z;
+    }
+    return(out);
+}
+
+double particleKernelDensity::exactDensity(const double* x) const
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    double out = 0.0;
+    for (int j = 0; j < centres.cols(); j++)
+    {
+        out += weights(j)*std::exp(log_norm - 0.5*scaledDistance(x, j, inf));
+    }
+    return(out);
+}
+
+double particleKernelDensity::truncatedDensity(const double* x) const
+{
+    const double halfWidth = cutoff/inv_tau(sort_dim);
+    auto first = std::lower_bound(sorted_values.begin(), sorted_values.end(),
+                                  x[sort_dim] - halfWidth);
+    auto last = std::upper_bound(first, sorted_values.end(),
+                                 x[sort_dim] + halfWidth);
+    double q, out = 0.0;
+    int j;
+    for (auto itr = first; itr != last; ++itr)
+    {
+        j = sorted_idx[itr - sorted_values.begin()];
+        q = scaledDistance(x, j, cutoff);
+        if (q >= 0)
+        {
+            out += weights(j)*std::exp(log_norm - 0.5*q);
+        }
+    }
+    return(out);
+}
+
+void particleKernelDensity::evaluate(const Eigen::MatrixXd& points,
+                                     int start,
+                                     int end,
+                                     Eigen::VectorXd& out) const
+{
+    const int nFree = free_dims.size();
+    Eigen::VectorXd x(nFree);
+    int i, row;
+    for (row = start; row < end; row++)
+    {
+        for (i = 0; i < nFree; i++)
+        {
+            x(i) = points(row, free_dims[i]);
+        }
+        if (chol.size() > 0)
+        {
+            chol.triangularView<Eigen::Lower>().solveInPlace(x);
+        }
+        out(row) = (cutoff > 0 ? truncatedDensity(x.data()) : 0.0);
+        // Fall back to the exact sum when no kernel is within the cutoff
+        if (!(out(row) > 0))
+        {
+            out(row) = exactDensity(x.data());
+        }
+    }
+}
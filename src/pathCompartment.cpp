@@ -0,0 +1,44 @@
+#include <pathCompartment.hpp>
+
+pathCompartment::pathCompartment(int nb, int nLoc)
+{
+    nBins = nb;
+    head = 0;
+    bins = Eigen::MatrixXi::Zero(nBins, nLoc);
+    max_bin = Eigen::VectorXi::Constant(nLoc, -1);
+}
+
+void pathCompartment::reset()
+{
+    head = 0;
+    bins.setZero();
+    max_bin.setConstant(-1);
+}
+
+int pathCompartment::advance(int loc,
+                             int nSteps,
+                             std::vector<binomialSampler>& samplers,
+                             philox4x32& generator)
+{
+    return(advanceBins(bins.col(loc).data(), &max_bin(loc), nBins, head,
+                       nSteps, samplers.data(), generator));
+}
+
+void pathCompartment::advanceHead(int nSteps)
+{
+    head = physical(0, nSteps);
+}
+
+void pathCompartment::setEntrants(
+        const Eigen::Ref<const Eigen::VectorXi>& entrants)
+{
+    const int idx = physical(0, 0);
+    for (int loc = 0; loc < bins.cols(); loc++)
+    {
+        bins(idx, loc) = entrants(loc);
+        if (entrants(loc) > 0 && max_bin(loc) < 0)
+        {
+            max_bin(loc) = 0;
+        }
+    }
+}
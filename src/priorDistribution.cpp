@@ -0,0 +1,310 @@
+#include <priorDistribution.hpp>
+#include <logDensities.hpp>
+#include <cmath>
+#include <limits>
+#include <random>
+
+/** Gamma log density with the given shape and rate and log normalizing
+ * constant -std::lgamma(shape) + shape*std::log(rate), zero at zero like
+ * the Weibull hyperpriors*/
+static double logDgammaRate(double x, double shape, double rate,
+                            double log_norm)
+{
+    if (x <= 0)
+    {
+        return(-std::numeric_limits<double>::infinity());
+    }
+    return(log_norm + (shape - 1.0)*std::log(x) - x*rate);
+}
+
+static double rbeta(double a, double b, philox4x32& generator)
+{
+    double x = std::gamma_distribution<double>(a,1)(generator);
+    double y = std::gamma_distribution<double>(b,1)(generator);
+    return(x/(x+y));
+}
+
+static double rdunif(int a, int b, philox4x32& generator)
+{
+    return((double) std::uniform_int_distribution<int>(a,b)(generator));
+}
+
+priorDistribution::priorDistribution(
+        std::shared_ptr<const simulationContext> ctx)
+    : context(ctx)
+{
+    const bool hasReinfection = (context -> reinfection_precision)(0) > 0;
+    const bool hasSpatial = (context -> Y).cols() > 1;
+    const std::string& transitionMode = context -> transitionMode;
+    int i;
+
+    nBeta = (context -> X).cols();
+    nBetaRS = (context -> X_rs).cols()*hasReinfection;
+    nRho = ((context -> DM_vec).size() +
+            (context -> TDM_vec)[0].size())*hasSpatial;
+    nTrans = (transitionMode == "exponential" ? 2 :
+             (transitionMode == "weibull" ? 4 : 0));
+    nReport = (context -> dataModelType == 2 ? 1 : 0);
+
+    exposure_sd = Eigen::VectorXd(nBeta);
+    for (i = 0; i < nBeta; i++)
+    {
+        exposure_sd(i) = 1.0/((context -> exposure_precision)(i));
+    }
+    reinfection_sd = Eigen::VectorXd(nBetaRS);
+    for (i = 0; i < nBetaRS; i++)
+    {
+        reinfection_sd(i) = 1.0/((context -> reinfection_precision)(i));
+    }
+
+    rho_log_beta = 0.0;
+    if (nRho > 0)
+    {
+        const double rho_a = (context -> spatial_prior)(0);
+        const double rho_b = (context -> spatial_prior)(1);
+        rho_log_beta = std::lgamma(rho_a) + std::lgamma(rho_b) -
+                       std::lgamma(rho_a + rho_b);
+    }
+
+    rf_alpha = (context -> dataModelType == 2  ?
+               (context -> report_fraction)*(context -> report_fraction_ess) :
+               -1.0);
+    rf_beta = (context -> dataModelType == 2 ?
+              (1.0 - context -> report_fraction)*
+                (context -> report_fraction_ess) :
+              -1.0);
+    rf_log_beta = (nReport > 0 ? std::lgamma(rf_alpha) + std::lgamma(rf_beta)
+                                 - std::lgamma(rf_alpha + rf_beta) : 0.0);
+
+    // Exponential models have a gamma prior on each rate, Weibull models
+    // on the shape and scale of each transition
+    trans_shape = Eigen::VectorXd(nTrans);
+    trans_rate = Eigen::VectorXd(nTrans);
+    for (i = 0; i < nTrans/2; i++)
+    {
+        trans_shape(i) = (context -> E_to_I_prior)(2*i, 0);
+        trans_rate(i) = (context -> E_to_I_prior)(2*i + 1, 0);
+        trans_shape(nTrans/2 + i) = (context -> I_to_R_prior)(2*i, 0);
+        trans_rate(nTrans/2 + i) = (context -> I_to_R_prior)(2*i + 1, 0);
+    }
+    trans_lgamma = Eigen::VectorXd(nTrans);
+    trans_log_norm = Eigen::VectorXd(nTrans);
+    for (i = 0; i < nTrans; i++)
+    {
+        trans_lgamma(i) = std::lgamma(trans_shape(i));
+        trans_log_norm(i) = -trans_lgamma(i) + 
+                            trans_shape(i)*std::log(trans_rate(i));
+    }
+
+    N = (context -> S0) + (context -> E0) + (context -> I0) + (context -> R0);
+}
+
+int priorDistribution::nParams() const
+{
+    return(nBeta + nBetaRS + nRho + nTrans + nReport +
+           (context -> S0).size()*4);
+}
+
+void priorDistribution::logDensity(const Eigen::MatrixXd& params,
+                                   int start,
+                                   int end,
+                                   Eigen::VectorXd& out) const
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    const std::string& transitionMode = context -> transitionMode;
+    int i, j;
+    int paramIdx = 0;
+
+    for (i = start; i < end; i++)
+    {
+        out(i) = 0.0;
+    }
+    for (j = 0; j < nBeta; j++)
+    {
+        for (i = start; i < end; i++)
+        {
+            out(i) += logDnorm(params(i, paramIdx),
+                               (context -> exposure_mean)(j),
+                               exposure_sd(j));
+        }
+        paramIdx++;
+    }
+    for (j = 0; j < nBetaRS; j++)
+    {
+        for (i = start; i < end; i++)
+        {
+            out(i) += logDnorm(params(i, paramIdx),
+                               (context -> reinfection_mean)(j),
+                               reinfection_sd(j));
+        }
+        paramIdx++;
+    }
+
+    if (nRho > 0)
+    {
+        Eigen::VectorXd constr = Eigen::VectorXd::Zero(end - start);
+        for (j = 0; j < nRho; j++)
+        {
+            for (i = start; i < end; i++)
+            {
+                constr(i - start) += params(i, paramIdx);
+                out(i) += logDbeta(params(i, paramIdx),
+                                   (context -> spatial_prior)(0),
+                                   (context -> spatial_prior)(1),
+                                   rho_log_beta);
+            }
+            paramIdx++;
+        }
+        for (i = start; i < end; i++)
+        {
+            if (constr(i - start) > 1)
+            {
+                out(i) = -inf;
+            }
+        }
+    }
+
+    if (transitionMode == "exponential")
+    {
+        for (j = 0; j < 2; j++)
+        {
+            for (i = start; i < end; i++)
+            {
+                out(i) += logDgamma(params(i, paramIdx), trans_shape(j),
+                                    1.0/trans_rate(j), trans_lgamma(j));
+            }
+            paramIdx++;
+        }
+    }
+    else if (transitionMode == "weibull")
+    {
+        // Shape and scale of a transition are summed before they are added
+        for (j = 0; j < 4; j += 2)
+        {
+            for (i = start; i < end; i++)
+            {
+                out(i) += (logDgammaRate(params(i, paramIdx), trans_shape(j),
+                                         trans_rate(j), trans_log_norm(j)) +
+                           logDgammaRate(params(i, paramIdx + 1),
+                                         trans_shape(j + 1),
+                                         trans_rate(j + 1),
+                                         trans_log_norm(j + 1)));
+            }
+            paramIdx += 2;
+        }
+    }
+    if (nReport > 0)
+    {
+        for (i = start; i < end; i++)
+        {
+            out(i) += logDbeta(params(i, paramIdx), rf_alpha, rf_beta,
+                               rf_log_beta);
+        }
+        paramIdx++;
+    }
+
+    const int sz = N.size();
+    for (i = start; i < end; i++)
+    {
+        for (j = 0; j < sz; j++)
+        {
+            int S = params(i, paramIdx+j);
+            int E = params(i, paramIdx+j+sz);
+            int I = params(i, paramIdx+j+2*sz);
+            int R = params(i, paramIdx+j+3*sz);
+
+            bool validIVC = ((S >= 0 && S <= context -> S0_max(j)) &&
+                             (E >= 0 && E <= context -> E0_max(j)) &&
+                             (I >= 0 && I <= context -> I0_max(j)) &&
+                             (R >= 0 && R <= context -> R0_max(j)));
+            if (!validIVC)
+            {
+                out(i) = -inf;
+            }
+        }
+    }
+}
+
+bool priorDistribution::draw(philox4x32& generator, Eigen::MatrixXd& params,
+                             int row) const
+{
+    // Distributions are set up for each row, as std::normal_distribution
+    // keeps every other draw for the next call
+    std::normal_distribution<double> standardNormal(0,1);
+    int j;
+    int paramIdx = 0;
+    for (j = 0; j < nBeta; j++)
+    {
+        params(row, paramIdx) = (context -> exposure_mean(j)) +
+                                standardNormal(generator) /
+                                (context -> exposure_precision(j));
+        paramIdx++;
+    }
+    for (j = 0; j < nBetaRS; j++)
+    {
+        params(row, paramIdx) = (context -> reinfection_mean(j)) +
+                                standardNormal(generator) /
+                                (context -> reinfection_precision(j));
+        paramIdx++;
+    }
+
+    bool validRho = true;
+    if (nRho > 0)
+    {
+        std::gamma_distribution<> rhoDist((context -> spatial_prior)(0),
+                                          1.0/(context -> spatial_prior)(1));
+        double rhoTot = 2.0;
+        int rhoItrs = 0;
+        while (rhoTot > 1.0 && rhoItrs < 100)
+        {
+            rhoTot = 0.0;
+            for (j = 0; j < nRho; j++)
+            {
+                params(row, paramIdx + j) = rhoDist(generator);
+                rhoTot += params(row, paramIdx + j);
+            }
+            rhoItrs++;
+        }
+        validRho = (rhoTot <= 1.0);
+        paramIdx += nRho;
+    }
+
+    for (j = 0; j < nTrans; j++)
+    {
+        params(row, paramIdx) = std::gamma_distribution<>(
+                trans_shape(j), 1.0/trans_rate(j))(generator);
+        paramIdx++;
+    }
+    if (nReport > 0)
+    {
+        params(row, paramIdx) = rbeta(rf_alpha, rf_beta, generator);
+        paramIdx++;
+    }
+
+    const int sz = N.size();
+    for (j = 0; j < sz; j++)
+    {
+        if (context -> ivc_type == 2)
+        {
+            // E, I and R are drawn, S makes up the rest of the population
+            params(row, paramIdx+j+sz) = rdunif(0, context -> E0_max(j),
+                                                generator);
+            params(row, paramIdx+j+2*sz) = rdunif(0, context -> I0_max(j),
+                                                  generator);
+            params(row, paramIdx+j+3*sz) = rdunif(0, context -> R0_max(j),
+                                                  generator);
+            params(row, paramIdx+j) = N(j) -
+                params(row, paramIdx+j+sz) -
+                params(row, paramIdx+j+2*sz) -
+                params(row, paramIdx+j+3*sz);
+        }
+        else
+        {
+            params(row, paramIdx+j) = (context -> S0(j));
+            params(row, paramIdx+j+sz) = (context -> E0(j));
+            params(row, paramIdx+j+2*sz) = (context -> I0(j));
+            params(row, paramIdx+j+3*sz) = (context -> R0(j));
+        }
+    }
+    return(validRho);
+}
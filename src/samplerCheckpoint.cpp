@@ -0,0 +1,247 @@
+#include <samplerCheckpoint.hpp>
+#include <coreError.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+/** Fixed part at the start of a checkpoint file, a multiple of 8 bytes so
+ * that the arrays following it stay aligned*/
+struct checkpointHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    /** CHECKPOINT_BYTE_ORDER as written, to reject files from machines of
+     * the other endianness*/
+    std::uint32_t byte_order;
+    std::int32_t algorithm;
+    std::int32_t completed_epochs;
+    std::int32_t terminated;
+    std::uint32_t proposal_counter;
+    std::uint32_t batch_counter;
+    std::int32_t batch_accepted;
+    std::int32_t batch_examined;
+    std::int32_t n_epochs;
+    std::int64_t n_particles;
+    std::int64_t n_params;
+    std::int64_t m;
+    std::int64_t generator_bytes;
+    double eps;
+};
+
+#define CHECKPOINT_BYTE_ORDER 0x01020304u
+
+static const char checkpointMagic[8] = {'A', 'B', 'S', 'E', 'I', 'R', 'C',
+                                        'K'};
+
+static_assert(sizeof(checkpointHeader) % 8 == 0,
+              "checkpoint arrays must stay 8 byte aligned");
+
+template<typename T> static void writeValue(std::ofstream& out,
+                                            const T& value)
+{
+    out.write((const char*) &value, sizeof(T));
+}
+
+template<typename T> static void readValue(std::ifstream& in, T* value)
+{
+    in.read((char*) value, sizeof(T));
+}
+
+/** Move the file at from over to, replacing it. std::rename does so in one
+ * step on POSIX systems, but fails on Windows if to exists, where 
+ * MoveFileEx replaces it instead. Returns false on failure.*/
+static bool replaceFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+    return(MoveFileExA(from.c_str(), to.c_str(),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)
+           != 0);
+#else
+    return(std::rename(from.c_str(), to.c_str()) == 0);
+#endif
+}
+
+static void writeIntVector(std::ofstream& out, const std::vector<int>& v)
+{
+    writeValue(out, (std::int64_t) v.size());
+    for (unsigned int i = 0; i < v.size(); i++)
+    {
+        writeValue(out, (std::int32_t) v[i]);
+    }
+}
+
+static std::vector<int> readIntVector(std::ifstream& in)
+{
+    std::int64_t n = 0;
+    readValue(in, &n);
+    if (!in || n < 0)
+    {
+        throw abseirError("checkpoint telemetry is corrupt.\n");
+    }
+    std::vector<int> v(n);
+    std::int32_t value;
+    for (unsigned int i = 0; i < v.size(); i++)
+    {
+        readValue(in, &value);
+        v[i] = value;
+    }
+    return(v);
+}
+
+void writeSamplerCheckpoint(const std::string& path,
+                            const samplerCheckpoint& checkpoint)
+{
+    const std::string tmp_path = path + ".tmp";
+    checkpointHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.byte_order = CHECKPOINT_BYTE_ORDER;
+    header.algorithm = checkpoint.algorithm;
+    header.completed_epochs = checkpoint.completed_epochs;
+    header.terminated = checkpoint.terminated;
+    header.proposal_counter = checkpoint.proposal_counter;
+    header.batch_counter = checkpoint.batch_counter;
+    header.batch_accepted = checkpoint.batch_accepted;
+    header.batch_examined = checkpoint.batch_examined;
+    header.n_epochs = checkpoint.epochs.size();
+    header.n_particles = checkpoint.params.rows();
+    header.n_params = checkpoint.params.cols();
+    header.m = checkpoint.results.cols();
+    header.generator_bytes = checkpoint.generator_state.size();
+    header.eps = checkpoint.eps;
+    if (checkpoint.weights.size() != checkpoint.params.rows() ||
+        checkpoint.results.rows() != checkpoint.params.rows())
+    {
+        throw abseirError("checkpoint particle arrays differ in size.\n");
+    }
+
+    {
+        std::ofstream out(tmp_path.c_str(),
+                          std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            throw abseirError("could not open checkpoint file " + tmp_path +
+                              "\n");
+        }
+        writeValue(out, header);
+        out.write((const char*) checkpoint.params.data(),
+                  checkpoint.params.size()*sizeof(double));
+        out.write((const char*) checkpoint.weights.data(),
+                  checkpoint.weights.size()*sizeof(double));
+        out.write((const char*) checkpoint.results.data(),
+                  checkpoint.results.size()*sizeof(double));
+        out.write(checkpoint.generator_state.data(),
+                  checkpoint.generator_state.size());
+        for (unsigned int i = 0; i < checkpoint.epochs.size(); i++)
+        {
+            const epochTelemetry& epoch = checkpoint.epochs[i];
+            writeValue(out, (std::int64_t) epoch.stage.size());
+            out.write(epoch.stage.data(), epoch.stage.size());
+            writeValue(out, epoch.proposal_seconds);
+            writeValue(out, epoch.simulation_seconds);
+            writeValue(out, epoch.weight_seconds);
+            writeValue(out, epoch.epsilon_seconds);
+            writeValue(out, epoch.total_seconds);
+            writeValue(out, (std::int64_t) epoch.simulations);
+            writeValue(out, (std::int64_t) epoch.accepted);
+            writeIntVector(out, epoch.batch_sizes);
+            writeIntVector(out, epoch.batch_accepted);
+        }
+        out.flush();
+        if (!out)
+        {
+            throw abseirError("could not write checkpoint file " + tmp_path +
+                              "\n");
+        }
+    }
+    if (!replaceFile(tmp_path, path))
+    {
+        throw abseirError("could not replace checkpoint file " + path + "\n");
+    }
+}
+
+samplerCheckpoint readSamplerCheckpoint(const std::string& path)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in)
+    {
+        throw abseirError("could not open checkpoint file " + path + "\n");
+    }
+    checkpointHeader header;
+    readValue(in, &header);
+    if (!in || std::memcmp(header.magic, checkpointMagic,
+                           sizeof(header.magic)) != 0)
+    {
+        throw abseirError(path + " is not an ABSEIR checkpoint.\n");
+    }
+    if (header.version != CHECKPOINT_VERSION ||
+        header.byte_order != CHECKPOINT_BYTE_ORDER)
+    {
+        throw abseirError("checkpoint " + path + " was written by an "
+                          "incompatible version or machine.\n");
+    }
+    if (header.n_particles < 0 || header.n_params < 0 || header.m < 0 ||
+        header.generator_bytes < 0 || header.n_epochs < 0)
+    {
+        throw abseirError("checkpoint " + path + " is corrupt.\n");
+    }
+
+    samplerCheckpoint checkpoint;
+    checkpoint.algorithm = header.algorithm;
+    checkpoint.completed_epochs = header.completed_epochs;
+    checkpoint.terminated = (header.terminated != 0);
+    checkpoint.proposal_counter = header.proposal_counter;
+    checkpoint.batch_counter = header.batch_counter;
+    checkpoint.batch_accepted = header.batch_accepted;
+    checkpoint.batch_examined = header.batch_examined;
+    checkpoint.eps = header.eps;
+    checkpoint.params.resize(header.n_particles, header.n_params);
+    checkpoint.weights.resize(header.n_particles);
+    checkpoint.results.resize(header.n_particles, header.m);
+    in.read((char*) checkpoint.params.data(),
+            checkpoint.params.size()*sizeof(double));
+    in.read((char*) checkpoint.weights.data(),
+            checkpoint.weights.size()*sizeof(double));
+    in.read((char*) checkpoint.results.data(),
+            checkpoint.results.size()*sizeof(double));
+    checkpoint.generator_state.resize(header.generator_bytes);
+    in.read(&(checkpoint.generator_state[0]), header.generator_bytes);
+    for (int i = 0; i < header.n_epochs && in; i++)
+    {
+        std::int64_t stage_bytes = 0;
+        readValue(in, &stage_bytes);
+        if (!in || stage_bytes < 0)
+        {
+            break;
+        }
+        std::string stage(stage_bytes, ' ');
+        in.read(&(stage[0]), stage_bytes);
+        epochTelemetry epoch(stage);
+        std::int64_t count;
+        readValue(in, &(epoch.proposal_seconds));
+        readValue(in, &(epoch.simulation_seconds));
+        readValue(in, &(epoch.weight_seconds));
+        readValue(in, &(epoch.epsilon_seconds));
+        readValue(in, &(epoch.total_seconds));
+        readValue(in, &count);
+        epoch.simulations = count;
+        readValue(in, &count);
+        epoch.accepted = count;
+        epoch.batch_sizes = readIntVector(in);
+        epoch.batch_accepted = readIntVector(in);
+        checkpoint.epochs.push_back(epoch);
+    }
+    if (!in)
+    {
+        throw abseirError("checkpoint " + path + " is truncated.\n");
+    }
+    return(checkpoint);
+}
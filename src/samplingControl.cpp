@@ -1,5 +1,6 @@
 #include <Rcpp.h>
 #include <samplingControl.hpp>
+#include <threadAffinity.hpp>
 
 
 using namespace Rcpp;
@@ -10,10 +11,10 @@ samplingControl::samplingControl(SEXP integerParameters,
     Rcpp::IntegerVector inIntegerParams(integerParameters);
     Rcpp::NumericVector inNumericParams(numericParameters);
 
-    if (inIntegerParams.size() != 10 ||
-        inNumericParams.size() != 4)
+    if (inIntegerParams.size() != 13 ||
+        inNumericParams.size() != 6)
     {
-        Rcpp::stop("Exactly 15 samplingControl parameters are required.");
+        Rcpp::stop("Exactly 13 integer and 6 numeric samplingControl parameters are required.");
     }
 
     simulation_width = inIntegerParams(0);
@@ -26,6 +27,10 @@ samplingControl::samplingControl(SEXP integerParameters,
     max_batches = inIntegerParams(7);
     multivariatePerturbation = inIntegerParams(8) != 0;
     m = inIntegerParams(9);
+    early_rejection = inIntegerParams(10) != 0;
+    chunk_size = inIntegerParams(11);
+    adaptive_batch = inIntegerParams(12) != 0;
+    affinity = AFFINITY_NONE;
 #ifdef SPATIALSEIR_SINGLETHREAD
     if (CPU_cores > 1)
     {
@@ -38,6 +43,8 @@ samplingControl::samplingControl(SEXP integerParameters,
     shrinkage = inNumericParams(1);
     lpow = inNumericParams(2);
     target_eps = inNumericParams(3);
+    weight_cutoff = inNumericParams(4);
+    binomial_approx_threshold = inNumericParams(5);
     
 
     if (algorithm != ALG_BasicABC && 
@@ -47,6 +54,14 @@ samplingControl::samplingControl(SEXP integerParameters,
     {
         Rcpp::stop("Algorithm specification must be of length 1 and equal to 1 or 2 or 3.");
     }
+    if (weight_cutoff < 0)
+    {
+        Rcpp::stop("weight_cutoff must be non-negative.");
+    }
+    if (binomial_approx_threshold < 0)
+    {
+        Rcpp::stop("binomial_approximation must be non-negative.");
+    }
     if (max_batches <= 0)
     {
         Rcpp::stop("max_batches must be greater than zero.");
@@ -67,10 +82,20 @@ void samplingControl::summary()
     Rcpp::Rcout << "    max_batches: " << max_batches << "\n";
     Rcpp::Rcout << "    multivariatePerturbation: " << multivariatePerturbation << "\n";
     Rcpp::Rcout << "    m: " << m << "\n";
+    Rcpp::Rcout << "    early_rejection: " << early_rejection << "\n";
+    Rcpp::Rcout << "    chunk_size: " << chunk_size << "\n";
+    Rcpp::Rcout << "    adaptive_batch: " << adaptive_batch << "\n";
     Rcpp::Rcout << "    accept_fraction: " << accept_fraction << "\n";
     Rcpp::Rcout << "    shrinkage: " << shrinkage << "\n";
     Rcpp::Rcout << "    lpow: " << lpow << "\n";
     Rcpp::Rcout << "    target_eps: " << target_eps << "\n";
+    Rcpp::Rcout << "    weight_cutoff: " << weight_cutoff << "\n";
+    Rcpp::Rcout << "    binomial_approx_threshold: " << binomial_approx_threshold << "\n";
+    Rcpp::Rcout << "    affinity: " << affinity << "\n";
+    if (!checkpoint_file.empty())
+    {
+        Rcpp::Rcout << "    checkpoint_file: " << checkpoint_file << "\n";
+    }
     Rcpp::Rcout << "    Note: not all parameters are used for all algorithms.\n\n";
 
 }
@@ -82,6 +107,55 @@ samplingControl::~samplingControl()
     }
 }
 
+void samplingControl::setCheckpointFile(std::string path)
+{
+    if (!path.empty() && 
+        algorithm != ALG_ModifiedBeaumont2009 && 
+        algorithm != ALG_DelMoral2012)
+    {
+        Rcpp::stop("Checkpoints are only written by the Beaumont2009 and DelMoral2012 algorithms.");
+    }
+    checkpoint_file = path;
+}
+
+void samplingControl::setAffinity(std::string policy, 
+                                  Rcpp::IntegerVector cores)
+{
+    if (policy == "none")
+    {
+        affinity = AFFINITY_NONE;
+    }
+    else if (policy == "compact")
+    {
+        affinity = AFFINITY_COMPACT;
+    }
+    else if (policy == "scatter")
+    {
+        affinity = AFFINITY_SCATTER;
+    }
+    else if (policy == "list")
+    {
+        if (cores.size() == 0)
+        {
+            Rcpp::stop("affinity core list must not be empty.");
+        }
+        affinity = AFFINITY_LIST;
+    }
+    else
+    {
+        Rcpp::stop("affinity must be one of none, compact, scatter or an integer vector of cores.");
+    }
+    affinity_cores.clear();
+    for (int i = 0; i < cores.size(); i++)
+    {
+        if (cores(i) < 0)
+        {
+            Rcpp::stop("affinity cores must be non-negative.");
+        }
+        affinity_cores.push_back(cores(i));
+    }
+}
+
 int samplingControl::getModelComponentType()
 {
     return(LSS_SAMPLING_CONTROL_MODEL_TYPE);
@@ -91,7 +165,9 @@ RCPP_MODULE(mod_samplingControl)
 {
     using namespace Rcpp;
     class_<samplingControl>( "samplingControl" )
-    .constructor<SEXP, SEXP>();
+    .constructor<SEXP, SEXP>()
+    .method("setCheckpointFile", &samplingControl::setCheckpointFile)
+    .method("setAffinity", &samplingControl::setAffinity);
 }
 
 
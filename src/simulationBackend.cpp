@@ -0,0 +1,37 @@
+#include <simulationBackend.hpp>
+
+localBackend::localBackend(NodePool* pl) : pool(pl)
+{
+}
+
+void localBackend::run(const Eigen::MatrixXd& params,
+                       int replicates,
+                       simulationAction sim_type_atom,
+                       Eigen::MatrixXd* results_dest,
+                       compartmentStore* results_c_dest,
+                       double threshold,
+                       int accept_needed,
+                       const std::function<bool(int)>* accept)
+{
+    pool -> setResultsDest(results_dest, results_c_dest);
+    if (accept != nullptr)
+    {
+        pool -> enqueueUntil(sim_type_atom, &params, threshold,
+                             accept_needed, accept);
+    }
+    else
+    {
+        pool -> enqueue(sim_type_atom, &params, threshold, replicates);
+    }
+    pool -> awaitFinished();
+}
+
+void localBackend::resetTelemetry()
+{
+    pool -> resetTelemetry();
+}
+
+long localBackend::totalSimulations() const
+{
+    return(pool -> totalSimulations());
+}
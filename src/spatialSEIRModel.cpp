@@ -1,8 +1,7 @@
 #include <Rcpp.h>
 #include <Eigen/Core>
 #include <RcppEigen.h>
-#include <cmath>
-#include <math.h>
+#include <algorithm>
 #include <spatialSEIRModel.hpp>
 #include <dataModel.hpp>
 #include <exposureModel.hpp>
@@ -12,20 +11,10 @@
 #include <initialValueContainer.hpp>
 #include <samplingControl.hpp>
 #include <util.hpp>
-#include <SEIRSimNodes.hpp>
+#include <abcSampler.hpp>
 
 using namespace Rcpp; 
 
-double rbeta(double a, double b, std::mt19937* generator){
-    double x = std::gamma_distribution<double>(a,1)(*generator);
-    double y = std::gamma_distribution<double>(b,1)(*generator);
-    return(x/(x+y));
-}
-
-double rdunif(int a, int b, std::mt19937* generator){
-    return((double) std::uniform_int_distribution<int>(a,b)(*generator));
-}
-
 spatialSEIRModel::spatialSEIRModel(dataModel& dataModel_,
                                    exposureModel& exposureModel_,
                                    reinfectionModel& reinfectionModel_,
@@ -116,523 +105,390 @@ spatialSEIRModel::spatialSEIRModel(dataModel& dataModel_,
                 (transitionPriorsInstance -> mode));
     }
 
-    // Optionally, set up transition distribution
-    if (transitionPriorsInstance -> mode == "weibull")
-    {
-        EI_transition_dist = std::unique_ptr<weibullTransitionDistribution>(
-                new weibullTransitionDistribution(
-                (transitionPriorsInstance -> E_to_I_params).col(0))); 
-        IR_transition_dist = std::unique_ptr<weibullTransitionDistribution>(
-                new weibullTransitionDistribution(
-                (transitionPriorsInstance -> I_to_R_params).col(0))); 
-    }
-    else
+    // The core reports through R
+    setLogHandler([](const std::string& msg){Rcpp::Rcout << msg;});
+    setWarningHandler([](const std::string& msg){Rcpp::warning("%s", msg);});
+    setInterruptHandler([](){Rcpp::checkUserInterrupt();});
+
+    capture_arrays = false;
+
+    // Collect the data needed by the simulation nodes, shared by all of them
+    std::shared_ptr<simulationContext> context(new simulationContext());
+    context -> random_seed = samplingControlInstance -> random_seed;
+    context -> S0 = initialValueContainerInstance -> S0;
+    context -> E0 = initialValueContainerInstance -> E0;
+    context -> I0 = initialValueContainerInstance -> I0;
+    context -> R0 = initialValueContainerInstance -> R0;
+    context -> S0_max = initialValueContainerInstance -> S0_max;
+    context -> E0_max = initialValueContainerInstance -> E0_max;
+    context -> I0_max = initialValueContainerInstance -> I0_max;
+    context -> R0_max = initialValueContainerInstance -> R0_max;
+    context -> ivc_type = initialValueContainerInstance -> type;
+    context -> offset = exposureModelInstance -> offset;
+    context -> Y = dataModelInstance -> Y;
+    context -> na_mask = dataModelInstance -> na_mask;
+    context -> dataModelType = dataModelInstance -> dataModelType;
+    context -> DM_vec = distanceModelInstance -> dm_list;
+    context -> TDM_vec = distanceModelInstance -> tdm_list;
+    context -> TDM_empty = distanceModelInstance -> tdm_empty;
+    context -> X = exposureModelInstance -> X;
+    context -> X_rs = reinfectionModelInstance -> X_rs;
+    context -> transitionMode = transitionPriorsInstance -> mode;
+    context -> E_to_I_prior = transitionPriorsInstance -> E_to_I_params;
+    context -> I_to_R_prior = transitionPriorsInstance -> I_to_R_params;
+    context -> inf_mean = transitionPriorsInstance -> inf_mean;
+    context -> spatial_prior = distanceModelInstance -> spatial_prior;
+    context -> exposure_precision = exposureModelInstance -> betaPriorPrecision;
+    context -> reinfection_precision = reinfectionModelInstance -> betaPriorPrecision;
+    context -> exposure_mean = exposureModelInstance -> betaPriorMean;
+    context -> reinfection_mean = reinfectionModelInstance -> betaPriorMean;
+    context -> phi = dataModelInstance -> phi;
+    context -> report_fraction = dataModelInstance -> report_fraction;
+    context -> report_fraction_ess = dataModelInstance -> report_fraction_ess;
+    context -> data_compartment = dataModelInstance -> dataModelCompartment;
+    context -> cumulative = dataModelInstance -> cumulative;
+    context -> m = samplingControlInstance -> m;
+    context -> lpow = samplingControlInstance -> lpow;
+    context -> binomial_approx_threshold = 
+        samplingControlInstance -> binomial_approx_threshold;
+
+    sampler = std::unique_ptr<abcSampler>(
+                new abcSampler(context, *samplingControlInstance));
+    sampler -> summary_function = [this]()
     {
-        Eigen::VectorXd DummyParams(4);
-        DummyParams(0) = 1.0;
-        DummyParams(1) = 1.0;
-        DummyParams(2) = 1.0;
-        DummyParams(3) = 1.0;
-        EI_transition_dist = std::unique_ptr<weibullTransitionDistribution>(new 
-            weibullTransitionDistribution(DummyParams));
-        IR_transition_dist = std::unique_ptr<weibullTransitionDistribution>(new 
-            weibullTransitionDistribution(DummyParams));
-    }
-    // Set up param matrix
-    const bool hasReinfection = (reinfectionModelInstance -> 
-            betaPriorPrecision)(0) > 0;
-    const bool hasSpatial = (dataModelInstance -> Y).cols() > 1;
-    std::string transitionMode = transitionPriorsInstance -> mode;
-
-    const int nBeta = (exposureModelInstance -> X).cols();
-    const int nBetaRS = (reinfectionModelInstance -> X_rs).cols()*hasReinfection;
-    const int nRho = ((distanceModelInstance -> dm_list).size() + 
-                      (distanceModelInstance -> tdm_list)[0].size())*hasSpatial;
-    const int nTrans = (transitionMode == "exponential" ? 2 :
-                       (transitionMode == "weibull" ? 4 : 0));
-    const int nReport = (dataModelInstance -> dataModelType == 2 ? 1 : 0);
-
-    const int nIVC = (initialValueContainerInstance -> S0).size()*4;
-    const int nParams = nBeta + nBetaRS + nRho + nTrans + nReport + nIVC;
-
-    // Set up random number provider 
-    std::minstd_rand0 lc_generator(samplingControlInstance -> random_seed + 1);
-    std::uint_least32_t seed_data[std::mt19937::state_size];
-    std::generate_n(seed_data, std::mt19937::state_size, std::ref(lc_generator));
-    std::seed_seq q(std::begin(seed_data), std::end(seed_data));
-    generator = new std::mt19937{q};   
-
-    // Parameters are not initialized
-    is_initialized = false;
-
-    results_complete = std::vector<simulationResultSet>();
-    results_double = Eigen::MatrixXd::Zero(samplingControlInstance -> init_batch_size, 
-                                               samplingControlInstance -> m); 
-    param_matrix = Eigen::MatrixXd::Zero(samplingControlInstance -> init_batch_size, 
-                                            nParams);
-
-    // Parameter covariance matrix and related items are not initialized
-
-    parameterCov = Eigen::MatrixXd::Zero(nParams, nParams);
-    parameterICov = Eigen::MatrixXd::Zero(nParams, nParams);
-    parameterL = Eigen::MatrixXd::Zero(nParams, nParams);
-    parameterICovDet = 0.0;
-
-    result_idx = std::vector<int>();
-
-    // Create the worker pool
-    worker_pool = std::unique_ptr<NodePool>(
-                new NodePool(&results_double,
-                     &results_complete,
-                     &result_idx,
-                     (unsigned int) samplingControlInstance -> CPU_cores,
-                     samplingControlInstance->random_seed,
-                     initialValueContainerInstance -> S0,
-                     initialValueContainerInstance -> E0,
-                     initialValueContainerInstance -> I0,
-                     initialValueContainerInstance -> R0,
-                     exposureModelInstance -> offset,
-                     dataModelInstance -> Y,
-                     dataModelInstance -> na_mask,
-                     dataModelInstance -> dataModelType,
-                     distanceModelInstance -> dm_list,
-                     distanceModelInstance -> tdm_list,
-                     distanceModelInstance -> tdm_empty,
-                     exposureModelInstance -> X,
-                     reinfectionModelInstance -> X_rs,
-                     transitionPriorsInstance -> mode,
-                     transitionPriorsInstance -> E_to_I_params,
-                     transitionPriorsInstance -> I_to_R_params,
-                     transitionPriorsInstance -> inf_mean,
-                     distanceModelInstance -> spatial_prior,
-                     exposureModelInstance -> betaPriorPrecision,
-                     reinfectionModelInstance -> betaPriorPrecision, 
-                     exposureModelInstance -> betaPriorMean,
-                     reinfectionModelInstance -> betaPriorMean,
-                     dataModelInstance -> phi,
-                     dataModelInstance -> dataModelCompartment,
-                     dataModelInstance -> cumulative,
-                     samplingControlInstance -> m,
-                     samplingControlInstance -> lpow
-                ));
+        dataModelInstance -> summary();
+        exposureModelInstance -> summary();
+        reinfectionModelInstance -> summary();
+        distanceModelInstance -> summary();
+        transitionPriorsInstance -> summary();
+        initialValueContainerInstance -> summary();
+        samplingControlInstance -> summary();
+    };
 }
 
-Eigen::MatrixXd spatialSEIRModel::generateParamsPrior(int nParticles)
+Rcpp::List spatialSEIRModel::sample(SEXP nSample, SEXP returnComps, SEXP verbose)
 {
-    const bool hasReinfection = (reinfectionModelInstance -> 
-            betaPriorPrecision)(0) > 0;
-    const bool hasSpatial = (dataModelInstance -> Y).cols() > 1;
-    std::string transitionMode = transitionPriorsInstance -> mode;
-    
-    const bool estimateIVC = initialValueContainerInstance -> type == 2;
-
-    const int nBeta = (exposureModelInstance -> X).cols();
-    const int nBetaRS = (reinfectionModelInstance -> X_rs).cols()*hasReinfection;
-    const int nRho = ((distanceModelInstance -> dm_list).size() + 
-                      (distanceModelInstance -> tdm_list)[0].size())*hasSpatial;
-    const int nTrans = (transitionMode == "exponential" ? 2 :
-                       (transitionMode == "weibull" ? 4 : 0));
-    const int nReport = (dataModelInstance -> dataModelType == 2 ? 1 : 0);
-    const int nIVC = (initialValueContainerInstance -> S0).size()*4;
-    const int nParams = nBeta + nBetaRS + nRho + nTrans + nReport + nIVC;
-
-    int N = nParticles;
-
-    int i, j;
-
-    double rf_alpha = (dataModelInstance -> dataModelType == 2  ?
-                       (dataModelInstance -> report_fraction)*(dataModelInstance -> report_fraction_ess) :
-                       -1.0);
-    double rf_beta = (dataModelInstance -> dataModelType == 2 ?
-                       (1.0 - dataModelInstance -> report_fraction)*(dataModelInstance -> report_fraction_ess) :
-                       -1.0);
-
+    Rcpp::IntegerVector n(nSample);
+    Rcpp::IntegerVector r(returnComps);
+    Rcpp::IntegerVector v(verbose);
 
+    int N = n(0);
+    bool R = r(0) > 0;
+    int V = v(0);
 
-    Eigen::MatrixXd outParams = Eigen::MatrixXd::Zero(N, nParams);
+    if (R && V)
+    {
+        Rcpp::Rcout << "return compartments: true\n";
+    }
 
+    simulationAction sim_type_atom = (R ? sim_result_atom : sim_atom);
+    const samplerResult rslt = sampler -> sample(N, sim_type_atom, V);
 
-    // Set up random samplers 
-    // beta, beta_RS
-    std::normal_distribution<double> standardNormal(0,1); 
-    // rho  
-    std::gamma_distribution<> rhoDist(
-            (distanceModelInstance -> spatial_prior)(0),
-        1.0/(distanceModelInstance -> spatial_prior)(1));
-    // Hyperprior distributions for E to I and I to R transitions
-    std::vector<std::gamma_distribution<> > gammaEIDist;
-    std::vector<std::gamma_distribution<> > gammaIRDist;
+    // keep_samples indicates a debug mode, so don't worry if we can't make
+    // a regular data frame from the list.
+    if (samplingControlInstance -> algorithm == ALG_Simulate)
+    {
+        return(wrapCompartments(sampler -> compartments(), 
+                                rslt.compartment_slots));
+    }
 
-    if (transitionMode == "exponential")
+    Rcpp::List outList;
+    if (rslt.compartment_slots >= 0)
     {
-        gammaEIDist.push_back(std::gamma_distribution<>(
-                (transitionPriorsInstance -> E_to_I_params)(0,0),
-            1.0/(transitionPriorsInstance -> E_to_I_params)(1,0)));
-        gammaIRDist.push_back(std::gamma_distribution<>(
-                (transitionPriorsInstance -> I_to_R_params)(0,0),
-            1.0/(transitionPriorsInstance -> I_to_R_params)(1,0)));
-    }   
-    else if (transitionMode == "weibull")
+        outList["simulationResults"] = wrapCompartments(
+                sampler -> compartments(), rslt.compartment_slots);
+    }
+    if (rslt.has_result)
     {
-        gammaEIDist.push_back(std::gamma_distribution<>(
-                (transitionPriorsInstance -> E_to_I_params)(0,0),
-            1.0/(transitionPriorsInstance -> E_to_I_params)(1,0)));
-        gammaEIDist.push_back(std::gamma_distribution<>(
-                (transitionPriorsInstance -> E_to_I_params)(2,0),
-            1.0/(transitionPriorsInstance -> E_to_I_params)(3,0)));
-
-        gammaIRDist.push_back(std::gamma_distribution<>(
-                (transitionPriorsInstance -> I_to_R_params)(0,0),
-            1.0/(transitionPriorsInstance -> I_to_R_params)(1,0)));
-        gammaIRDist.push_back(std::gamma_distribution<>(
-                (transitionPriorsInstance -> I_to_R_params)(2,0),
-            1.0/(transitionPriorsInstance -> I_to_R_params)(3,0)));
+        outList["result"] = Rcpp::wrap(rslt.result);
     }
-    // If this is too slow, consider column-wise operations
-    double rhoTot = 0.0;
-    int rhoItrs = 0;
-    for (i = 0; i < nParticles; i++)
+    outList["params"] = Rcpp::wrap(rslt.params);
+    if (rslt.has_epochs)
     {
-        // Draw beta
-        for (j = 0; j < nBeta; j++)
-        {
-            outParams(i, j) = (exposureModelInstance -> betaPriorMean(j)) + 
-                                 standardNormal(*generator) /
-                                 (exposureModelInstance -> betaPriorPrecision(j));
-        }
+        outList["completedEpochs"] = rslt.completed_epochs;
     }
-    // draw gammaEI, gammaIR
-    if (transitionMode == "exponential")
+    if (rslt.has_weights)
     {
-        for (i = 0; i < nParticles; i++)
-        {
-            // Draw gamma_ei
-            outParams(i, nBeta + nBetaRS + nRho) = 
-                gammaEIDist[0](*generator);
-            // Draw gamma_ir
-            outParams(i, nBeta + nBetaRS + nRho + 1) = 
-                gammaIRDist[0](*generator);
-        }
+        outList["weights"] = Rcpp::wrap(rslt.weights);
     }
-    else if (transitionMode == "weibull")
+    outList["currentEps"] = rslt.current_eps;
+    outList["telemetry"] = telemetryList();
+    return(outList);
+}
+
+Rcpp::List spatialSEIRModel::simulate(Eigen::MatrixXd params, int replicates,
+                                      bool returnComps)
+{
+    const samplerResult rslt = sampler -> simulate(params, replicates,
+            (returnComps ? sim_result_atom : sim_atom));
+    Rcpp::List outList;
+    if (rslt.compartment_slots >= 0)
     {
-        for (i = 0; i < nParticles; i++)
+        outList["simulationResults"] = wrapCompartments(
+                sampler -> compartments(), rslt.compartment_slots);
+    }
+    outList["result"] = Rcpp::wrap(rslt.result);
+    return(outList);
+}
+
+/** Names of the integer compartments, in CAPTURE_* order*/
+static const char* compartmentNames[CAPTURE_N_COMPARTMENTS] = {
+    "S", "E", "I", "R", "S_star", "E_star", "I_star", "R_star"};
+
+/** One row per simulation, holding the values of each of the first n 
+ * entries of v*/
+static Rcpp::NumericMatrix stackRows(const std::vector<Eigen::MatrixXd>& v,
+                                     int n)
+{
+    const int width = (n > 0 ? v[0].size() : 0);
+    Rcpp::NumericMatrix out(n, width);
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < width; j++)
         {
-            outParams(i, nBeta + nBetaRS + nRho) = gammaEIDist[0](*generator);
-            outParams(i, nBeta + nBetaRS + nRho + 1) = gammaEIDist[1](*generator);
-            outParams(i, nBeta + nBetaRS + nRho + 2) = gammaIRDist[0](*generator);
-            outParams(i, nBeta + nBetaRS + nRho + 3) = gammaIRDist[1](*generator);
+            out(i, j) = v[i](j);
         }
     }
-    // Draw reinfection parameters
-    if (hasReinfection)
+    return(out);
+}
+
+void spatialSEIRModel::setCompartmentCapture(SEXP compartments, 
+                                             SEXP compact, 
+                                             SEXP arrays)
+{
+    Rcpp::CharacterVector names(compartments);
+    Rcpp::LogicalVector cmpct(compact);
+    Rcpp::LogicalVector arr(arrays);
+    int flags = 0;
+    int i, c;
+    for (i = 0; i < names.size(); i++)
     {
-        for (i = 0; i < nParticles; i++)
+        const std::string name = Rcpp::as<std::string>(names[i]);
+        for (c = 0; c < CAPTURE_N_COMPARTMENTS; c++)
+        {
+            if (name == compartmentNames[c])
+            {
+                flags |= (1 << c);
+                break;
+            }
+        }
+        if (c == CAPTURE_N_COMPARTMENTS)
         {
-            for (j = nBeta; j < nBeta + nBetaRS; j++)
+            if (name != "p_se")
             {
-                outParams(i, j) = 
-                    (reinfectionModelInstance -> betaPriorMean(j-nBeta)) + 
-                     standardNormal(*generator) /
-                    (reinfectionModelInstance -> betaPriorPrecision(j-nBeta));           
+                Rcpp::stop("Unknown compartment: " + name);
             }
+            flags |= CAPTURE_P_SE;
         }
     }
-    // Draw rho
-    if (hasSpatial)
+    sampler -> setCapture(flags, cmpct(0));
+    capture_arrays = arr(0);
+}
+
+Rcpp::List spatialSEIRModel::wrapCompartments(const compartmentStore& store,
+                                              int nSim)
+{
+    if (store.overflowed())
     {
-        for (i = 0; i < nParticles; i++)
+        Rcpp::stop("Compartment values do not fit compact storage, "
+                   "use compact = FALSE.");
+    }
+    const bool hasReinfection = (reinfectionModelInstance -> 
+            betaPriorPrecision)(0) > 0;
+    const bool hasSpatial = (dataModelInstance -> Y).cols() > 1;
+    const bool exponential = (transitionPriorsInstance -> mode == 
+                              "exponential");
+    const int nTpt = store.tpt();
+    const int nLoc = store.locations();
+    const int slotSize = nTpt*nLoc;
+    // The design matrix is shared by every simulation, so it is only 
+    // converted once.
+    Rcpp::RObject X(Rcpp::wrap(exposureModelInstance -> X));
+    int i, c;
+
+    Rcpp::List outList;
+    if (capture_arrays)
+    {
+        for (c = 0; c < CAPTURE_N_COMPARTMENTS; c++)
         {
-            rhoTot = 2.0; 
-            rhoItrs = 0;
-            while (rhoTot > 1.0 && rhoItrs < 100)
+            if (store.keeps(1 << c))
             {
-                rhoTot = 0.0;
-                for (j = nBeta + nBetaRS; j < nBeta + nBetaRS + nRho; j++)
-                {
-                   outParams(i, j) = rhoDist(*generator); 
-                   rhoTot += outParams(i,j);
-                }
-                rhoItrs++;
+                Rcpp::IntegerVector block(slotSize*nSim);
+                store.copyCompartment(c, 0, nSim, block.begin());
+                block.attr("dim") = Rcpp::IntegerVector::create(nTpt, nLoc, 
+                                                                nSim);
+                outList[compartmentNames[c]] = block;
             }
-            if (rhoTot > 1.0)
+        }
+        if (store.keeps(CAPTURE_P_SE))
+        {
+            Rcpp::NumericVector block(slotSize*nSim);
+            if (nSim > 0)
             {
-                Rcpp::Rcout << "Error, valid rho value not obtained\n";
+                std::copy(store.pSE(0), store.pSE(0) + slotSize*nSim,
+                          block.begin());
             }
+            block.attr("dim") = Rcpp::IntegerVector::create(nTpt, nLoc, nSim);
+            outList["p_se"] = block;
         }
-    }
-    // Draw report fraction
-    if (dataModelInstance -> dataModelType == 2)
-    {
-        int reportcol = nBeta + nBetaRS + nRho + nTrans;
-        
-        for (i = 0; i < nParticles; i++)
+        if (exponential)
         {
-            outParams(i,reportcol) = rbeta(rf_alpha, rf_beta, generator);
+            outList["p_ei"] = stackRows(store.p_ei, nSim);
+            outList["p_ir"] = stackRows(store.p_ir, nSim);
         }
+        if (hasSpatial)
+        {
+            outList["rho"] = stackRows(store.rho, nSim);
+        }
+        outList["beta"] = stackRows(store.beta, nSim);
+        outList["X"] = X;
+        outList["result"] = stackRows(store.result, nSim);
+        return(outList);
     }
-	
-	int ivcstartcol = nBeta + nBetaRS + nRho + nTrans + nReport;
-    int sz = (initialValueContainerInstance -> S0).size();    
-    if (estimateIVC){
-        //const int nIVC = (estimateIVC ? (initialValueContainerInstance -> S0).size()*4 : 0);
-        
-        auto N = (initialValueContainerInstance -> S0) + 
-                (initialValueContainerInstance -> E0) + 
-                (initialValueContainerInstance -> I0) + 
-                (initialValueContainerInstance -> R0); 
 
-        for (i = 0; i < nParticles; i++)
+    for (i = 0; i < nSim; i++)
+    {
+        Rcpp::List subList;
+        for (c = 0; c < CAPTURE_N_COMPARTMENTS; c++)
         {
-            for (j = 0; j < sz; j++){
-                // E
-                outParams(i,ivcstartcol+j+sz) = rdunif(0, initialValueContainerInstance -> E0_max(j), generator);
-                // I
-                outParams(i,ivcstartcol+j+2*sz) = rdunif(0, initialValueContainerInstance -> I0_max(j), generator);
-                // R
-                outParams(i,ivcstartcol+j+3*sz) = rdunif(0, initialValueContainerInstance -> R0_max(j), generator);
-                // S
-                outParams(i,ivcstartcol+j) = N(j) - 
-                    outParams(i,ivcstartcol+j+sz) - 
-                    outParams(i,ivcstartcol+j+2*sz) - 
-                    outParams(i,ivcstartcol+j+3*sz);
+            if (store.keeps(1 << c))
+            {
+                Rcpp::IntegerMatrix comp(nTpt, nLoc);
+                store.copyCompartment(c, i, 1, comp.begin());
+                subList[compartmentNames[c]] = comp;
             }
         }
-    } else {
-		for (i = 0; i < nParticles; i++)
+        if (store.keeps(CAPTURE_P_SE))
         {
-            for (j = 0; j < sz; j++){
-                // S
-                outParams(i,ivcstartcol+j) = (initialValueContainerInstance -> S0(j));
-                // E
-                outParams(i,ivcstartcol+j+sz) = (initialValueContainerInstance -> E0(j));
-                // I
-                outParams(i,ivcstartcol+j+2*sz) = (initialValueContainerInstance -> I0(j));
-                // R
-                outParams(i,ivcstartcol+j+3*sz) = (initialValueContainerInstance -> R0(j));
-            }
+            Rcpp::NumericMatrix comp(nTpt, nLoc);
+            std::copy(store.pSE(i), store.pSE(i) + slotSize, comp.begin());
+            subList["p_se"] = comp;
         }
-	}
-    return(outParams);
-}
-
-Rcpp::List spatialSEIRModel::sample(SEXP nSample, SEXP returnComps, SEXP verbose)
-{
-    Rcpp::IntegerVector n(nSample);
-    Rcpp::IntegerVector r(returnComps);
-    Rcpp::IntegerVector v(verbose);
-
-    int N = n(0);
-    bool R = r(0) > 0;
-    int V = v(0);
-
-    if (R && V)
-    {
-        Rcpp::Rcout << "return compartments: true\n";
-    }
-
-    std::string sim_type_atom = (R ? sim_result_atom : sim_atom);
-    
-    if (samplingControlInstance -> algorithm == ALG_BasicABC)
-    {
-        return(sample_basic(N, V, sim_type_atom));
-    }
-    else if (samplingControlInstance -> algorithm == ALG_ModifiedBeaumont2009)
-    {
-        return(sample_Beaumont2009(N, V, sim_type_atom));
-    }
-    else if (samplingControlInstance -> algorithm == ALG_DelMoral2012)
-    {
-        return(sample_DelMoral2012(N, V, sim_type_atom));
-    }
-    else 
-    {
-	    if (samplingControlInstance -> algorithm != ALG_Simulate)
-    	{
-            Rcpp::stop("Unknown algorithm.");
-    	}
-        if (!is_initialized)
+        // We p_ei and p_ir not generally defined in non-exponential case.  
+        if (exponential)
         {
-            Rcpp::stop("Model must be initialized before simulating.");
+            subList["p_ei"] = Rcpp::wrap(store.p_ei[i]);
+            subList["p_ir"] = Rcpp::wrap(store.p_ir[i]);
         }
-        return(sample_Simulate(N, 0, V));
-    }
-}
-
-bool spatialSEIRModel::setParameters(Eigen::MatrixXd params, 
-        Eigen::VectorXd weights, Eigen::MatrixXd results, double eps)
-{
-    const bool hasReinfection = (reinfectionModelInstance ->                    
-                        betaPriorPrecision)(0) > 0; 
-    const bool hasSpatial = (dataModelInstance -> Y).cols() > 1;                
-    std::string transitionMode = transitionPriorsInstance -> mode;
-    const bool estimateIVC = initialValueContainerInstance -> type == 2;
-    
-    const int nBeta = (exposureModelInstance -> X).cols();
-    const int nBetaRS = (reinfectionModelInstance -> X_rs).cols()*hasReinfection;
-    const int nRho = ((distanceModelInstance -> dm_list).size() + 
-                      (distanceModelInstance -> tdm_list)[0].size())*hasSpatial;
-
-    const int nTrans = (transitionMode == "exponential" ? 2 :
-                       (transitionMode == "weibull" ? 4 : 0));
-    const int nReport = (dataModelInstance -> dataModelType == 2 ? 1 : 0);
-    const int nIVC = (initialValueContainerInstance -> S0).size()*4;
-    const int nParams = nBeta + nBetaRS + nRho + nTrans + nReport + nIVC;
-    
-    if (params.cols() != nParams)
-    {
-        Rcpp::stop("Number of supplied parameters does not match model specification.\n");
-    }
-    if (params.rows() != weights.size())
-    {
-        Rcpp::stop("Number of weights not equal to number of particles.\n");
+        if (hasSpatial)
+        {
+            subList["rho"] = Rcpp::wrap(store.rho[i]);
+        }
+        subList["beta"] = Rcpp::wrap(store.beta[i]);
+        subList["X"] = X;
+        if (hasReinfection)
+        {
+            // TODO: output reinfection info
+        }
+        subList["result"] = Rcpp::wrap(store.result[i]);
+        outList[std::to_string(i)] = subList;
     }
-
-    init_eps = eps;
-
-    init_param_matrix = params; 
-    param_matrix = params;
-
-    init_results_double = results;
-    results_double = results;
-
-    init_weights = weights;
-    is_initialized = true;
-    return(true);
+    return(outList);
 }
 
-double spatialSEIRModel::evalPrior(Eigen::VectorXd param_vector)
+Rcpp::List spatialSEIRModel::telemetryList()
 {
-    double outPrior = 0.0;
-    double constr = 0.0;
-    const bool hasReinfection = (reinfectionModelInstance -> betaPriorPrecision)(0) > 0;
-    const bool hasSpatial = (dataModelInstance -> Y).cols() > 1;
-    std::string transitionMode = transitionPriorsInstance -> mode;
-    const int nBeta = (exposureModelInstance -> X).cols();
-    const int nBetaRS = (reinfectionModelInstance -> X_rs).cols()*hasReinfection;
-    const int nRho = ((distanceModelInstance -> dm_list).size() + 
-                      (distanceModelInstance -> tdm_list)[0].size())*hasSpatial;
-    //const int nReport = (dataModelInstance -> dataModelType == 2 ? 1 : 0);
-    double rf_alpha = (dataModelInstance -> dataModelType == 2 ?
-                       (dataModelInstance -> report_fraction)*(dataModelInstance -> report_fraction_ess) :
-                       -1.0);
-    double rf_beta = (dataModelInstance -> dataModelType == 2 ?
-                       (1.0 - dataModelInstance -> report_fraction)*(dataModelInstance -> report_fraction_ess) :
-                       -1.0);
-
-
-
+    const std::vector<epochTelemetry>& epoch_telemetry = 
+        sampler -> getEpochTelemetry();
+    const int nEpoch = epoch_telemetry.size();
+    Rcpp::StringVector stage(nEpoch);
+    Rcpp::NumericVector total(nEpoch), proposal(nEpoch), 
+        simulation(nEpoch), weights(nEpoch), epsilon(nEpoch), 
+        simulations(nEpoch), accepted(nEpoch);
     int i;
-    int paramIdx = 0;
-    for (i = 0; i < nBeta; i++)
+    for (i = 0; i < nEpoch; i++)
     {
-        outPrior += R::dnorm(param_vector(paramIdx), 
-                (exposureModelInstance -> betaPriorMean)(i), 
-                1.0/((exposureModelInstance -> betaPriorPrecision)(i)), 1);
-        paramIdx++;
-    }
-
-    if (nBetaRS > 0)
+        const epochTelemetry& epoch = epoch_telemetry[i];
+        stage[i] = epoch.stage;
+        total[i] = epoch.total_seconds;
+        proposal[i] = epoch.proposal_seconds;
+        simulation[i] = epoch.simulation_seconds;
+        weights[i] = epoch.weight_seconds;
+        epsilon[i] = epoch.epsilon_seconds;
+        simulations[i] = epoch.simulations;
+        accepted[i] = epoch.accepted;
+    }
+    Rcpp::List epochs;
+    epochs["stage"] = stage;
+    epochs["total"] = total;
+    epochs["proposal"] = proposal;
+    epochs["simulation"] = simulation;
+    epochs["weights"] = weights;
+    epochs["epsilon"] = epsilon;
+    epochs["simulations"] = simulations;
+    epochs["accepted"] = accepted;
+
+    int nBatch = 0;
+    for (i = 0; i < nEpoch; i++)
     {
-        for (i = 0; i < nBetaRS; i++)
-        {
-            outPrior += R::dnorm(param_vector(paramIdx), 
-                    (reinfectionModelInstance -> betaPriorMean)(i), 
-                    1.0/((reinfectionModelInstance -> betaPriorPrecision)(i)), 1);
-            paramIdx++;
-        }
+        nBatch += epoch_telemetry[i].batch_sizes.size();
     }
-
-    if (nRho > 0)
+    Rcpp::IntegerVector batchEpoch(nBatch), batchSize(nBatch),
+        batchAccepted(nBatch);
+    int b = 0;
+    for (i = 0; i < nEpoch; i++)
     {
-        for (i = 0; i < nRho; i++)
+        const epochTelemetry& epoch = epoch_telemetry[i];
+        for (unsigned int j = 0; j < epoch.batch_sizes.size(); j++, b++)
         {
-             constr += param_vector(paramIdx);
-             outPrior += R::dbeta(param_vector(paramIdx), 
-                         (distanceModelInstance -> spatial_prior)(0),
-                         (distanceModelInstance -> spatial_prior)(1), 1);
-             paramIdx++;
-        }
-        if (constr > 1){
-            outPrior = -std::numeric_limits<double>::infinity();
+            batchEpoch[b] = i + 1;
+            batchSize[b] = epoch.batch_sizes[j];
+            batchAccepted[b] = epoch.batch_accepted[j];
         }
     }
-
-    if (transitionMode == "exponential")
+    Rcpp::List batches;
+    batches["epoch"] = batchEpoch;
+    batches["size"] = batchSize;
+    batches["accepted"] = batchAccepted;
+
+    // Workers are idle between batches, so their counters can be read
+    const std::vector<workerTelemetry> stats = sampler -> getWorkerTelemetry();
+    const double wall = sampler -> telemetrySeconds();
+    const int nWorker = stats.size();
+    Rcpp::NumericVector busy(nWorker), idle(nWorker), queueWait(nWorker),
+        tasks(nWorker), workerSims(nWorker);
+    double simSeconds = 0.0;
+    double nSims = 0.0;
+    for (i = 0; i < nWorker; i++)
     {
-        outPrior += R::dgamma(param_vector(paramIdx), 
-                (transitionPriorsInstance -> E_to_I_params)(0,0),
-                1.0/(transitionPriorsInstance -> E_to_I_params)(1,0), 1);
-        paramIdx++;
-
-        outPrior += R::dgamma(param_vector(paramIdx), 
-                (transitionPriorsInstance -> I_to_R_params)(0,0),
-                1.0/(transitionPriorsInstance -> I_to_R_params)(1,0), 1);
-        paramIdx++;
-    }
-    else if (transitionMode == "weibull")
-    {
-        outPrior += EI_transition_dist -> evalParamPrior(
-                param_vector.segment(paramIdx, 2)); 
-        paramIdx += 2;
-        outPrior += IR_transition_dist -> evalParamPrior(
-                param_vector.segment(paramIdx, 2)); 
-        paramIdx += 2;
-    }
-    if (dataModelInstance -> dataModelType == 2)
-    {
-        outPrior += R::dbeta(param_vector(paramIdx), 
-                            rf_alpha,
-                            rf_beta,
-                            1);
-        paramIdx++;
-    }
-
-
-    auto N = (initialValueContainerInstance -> S0) + 
-            (initialValueContainerInstance -> E0) + 
-            (initialValueContainerInstance -> I0) + 
-            (initialValueContainerInstance -> R0); 
-    int sz = N.size();
-    for (int j = 0; j < sz; j++){
-        int S = param_vector(paramIdx+j);
-        int E = param_vector(paramIdx+j+sz);
-        int I = param_vector(paramIdx+j+2*sz);
-        int R = param_vector(paramIdx+j+3*sz);
-    
-        bool validIVC = ((S >= 0 && S <= initialValueContainerInstance -> S0_max(j)) &&
-                         (E >= 0 && E <= initialValueContainerInstance -> E0_max(j)) &&
-                         (I >= 0 && I <= initialValueContainerInstance -> I0_max(j)) &&
-                         (R >= 0 && R <= initialValueContainerInstance -> R0_max(j)));
-        if (!validIVC){
-            outPrior = -std::numeric_limits<double>::infinity();
-        }
-    }
- 
-    return(std::exp(outPrior));
+        busy[i] = stats[i].busy_seconds;
+        idle[i] = std::max(0.0, wall - stats[i].busy_seconds);
+        queueWait[i] = stats[i].queue_wait_seconds;
+        tasks[i] = stats[i].tasks;
+        workerSims[i] = stats[i].simulations;
+        simSeconds += stats[i].simulation_seconds;
+        nSims += stats[i].simulations;
+    }
+    Rcpp::List workers;
+    workers["busy"] = busy;
+    workers["idle"] = idle;
+    workers["queue_wait"] = queueWait;
+    workers["tasks"] = tasks;
+    workers["simulations"] = workerSims;
+
+    Rcpp::List outList;
+    outList["epochs"] = epochs;
+    outList["batches"] = batches;
+    outList["workers"] = workers;
+    outList["wall_seconds"] = wall;
+    outList["mean_simulation_seconds"] = (nSims > 0 ? simSeconds/nSims 
+                                          : NA_REAL);
+    return(outList);
 }
 
-void spatialSEIRModel::run_simulations(Eigen::MatrixXd params, 
-                                       std::string sim_type_atom,
-                                       Eigen::MatrixXd* results_dest,
-                                       std::vector<simulationResultSet>* results_c_dest)
+bool spatialSEIRModel::setParameters(Eigen::MatrixXd params, 
+        Eigen::VectorXd weights, Eigen::MatrixXd results, double eps)
 {
+    return(sampler -> setParameters(params, weights, results, eps));
+}
 
-    result_idx.clear();
-    int i;
-    worker_pool -> setResultsDest(results_dest, 
-                                  results_c_dest,
-                                  &result_idx);
-    for (i = 0; i < params.rows(); i++)
-    {
-        worker_pool -> enqueue(sim_type_atom, i, params.row(i));
-    }
-    worker_pool -> awaitFinished();
+int spatialSEIRModel::loadCheckpoint(std::string path)
+{
+    return(sampler -> loadCheckpoint(path));
 }
 
 spatialSEIRModel::~spatialSEIRModel()
 {   
-    delete generator;
 }
 
 RCPP_MODULE(mod_spatialSEIRModel)
@@ -647,6 +503,8 @@ RCPP_MODULE(mod_spatialSEIRModel)
                  initialValueContainer&,
                  samplingControl&>()
     .method("sample", &spatialSEIRModel::sample)
-    .method("setParameters", &spatialSEIRModel::setParameters);
+    .method("simulate", &spatialSEIRModel::simulate)
+    .method("setCompartmentCapture", &spatialSEIRModel::setCompartmentCapture)
+    .method("setParameters", &spatialSEIRModel::setParameters)
+    .method("loadCheckpoint", &spatialSEIRModel::loadCheckpoint);
 }
-
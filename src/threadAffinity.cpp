@@ -0,0 +1,197 @@
+#include <threadAffinity.hpp>
+#include <coreError.hpp>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef __linux__
+/** CPU ids of a sysfs list such as "0-3,8-11"*/
+static std::vector<int> parseCpuList(const std::string& list)
+{
+    std::vector<int> out;
+    std::stringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ','))
+    {
+        if (range.empty() || range[0] < '0' || range[0] > '9')
+        {
+            continue;
+        }
+        const std::size_t dash = range.find('-');
+        const int first = std::atoi(range.substr(0, dash).c_str());
+        const int last = (dash == std::string::npos ? first :
+                          std::atoi(range.substr(dash + 1).c_str()));
+        for (int cpu = first; cpu <= last; cpu++)
+        {
+            out.push_back(cpu);
+        }
+    }
+    return(out);
+}
+
+/** NUMA node of each CPU listed under /sys. Machines without NUMA
+ * information have a single node, 0.*/
+static std::map<int, int> cpuNodes()
+{
+    std::map<int, int> out;
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (dir == nullptr)
+    {
+        return(out);
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        const std::string name(entry -> d_name);
+        if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+            name[4] < '0' || name[4] > '9')
+        {
+            continue;
+        }
+        std::ifstream file(("/sys/devices/system/node/" + name +
+                            "/cpulist").c_str());
+        std::string list;
+        std::getline(file, list);
+        const std::vector<int> cpus = parseCpuList(list);
+        for (unsigned int i = 0; i < cpus.size(); i++)
+        {
+            out[cpus[i]] = std::atoi(name.c_str() + 4);
+        }
+    }
+    closedir(dir);
+    return(out);
+}
+#endif
+
+std::vector<cpuSlot> availableCpus()
+{
+    std::vector<cpuSlot> out;
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0)
+    {
+        return(out);
+    }
+    const std::map<int, int> nodes = cpuNodes();
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &mask))
+        {
+            const std::map<int, int>::const_iterator node = nodes.find(cpu);
+            cpuSlot slot;
+            slot.cpu = cpu;
+            slot.numa_node = (node == nodes.end() ? 0 : node -> second);
+            out.push_back(slot);
+        }
+    }
+#endif
+    return(out);
+}
+
+std::vector<cpuSlot> placeWorkers(int policy, const std::vector<int>& cores,
+                                  int nThreads)
+{
+    std::vector<cpuSlot> out;
+    const std::vector<cpuSlot> cpus = availableCpus();
+    if (policy == AFFINITY_NONE || cpus.empty() || nThreads <= 0)
+    {
+        return(out);
+    }
+    int i;
+    if (policy == AFFINITY_LIST)
+    {
+        if (cores.empty())
+        {
+            throw abseirError("an explicit affinity needs at least one core.\n");
+        }
+        std::vector<cpuSlot> listed;
+        for (i = 0; i < (int) cores.size(); i++)
+        {
+            unsigned int j = 0;
+            while (j < cpus.size() && cpus[j].cpu != cores[i])
+            {
+                j++;
+            }
+            if (j == cpus.size())
+            {
+                std::stringstream msg;
+                msg << "core " << cores[i] << " is not available to this "
+                    << "process.\n";
+                throw abseirError(msg.str());
+            }
+            listed.push_back(cpus[j]);
+        }
+        for (i = 0; i < nThreads; i++)
+        {
+            out.push_back(listed[i % listed.size()]);
+        }
+        return(out);
+    }
+
+    // CPUs of each node, in id order
+    std::map<int, std::vector<cpuSlot> > byNode;
+    for (i = 0; i < (int) cpus.size(); i++)
+    {
+        byNode[cpus[i].numa_node].push_back(cpus[i]);
+    }
+    if (policy == AFFINITY_COMPACT)
+    {
+        std::vector<cpuSlot> ordered;
+        std::map<int, std::vector<cpuSlot> >::const_iterator node;
+        for (node = byNode.begin(); node != byNode.end(); ++node)
+        {
+            ordered.insert(ordered.end(), (node -> second).begin(),
+                           (node -> second).end());
+        }
+        for (i = 0; i < nThreads; i++)
+        {
+            out.push_back(ordered[i % ordered.size()]);
+        }
+    }
+    else if (policy == AFFINITY_SCATTER)
+    {
+        std::vector<std::vector<cpuSlot> > nodes;
+        std::map<int, std::vector<cpuSlot> >::const_iterator node;
+        for (node = byNode.begin(); node != byNode.end(); ++node)
+        {
+            nodes.push_back(node -> second);
+        }
+        std::vector<int> used(nodes.size(), 0);
+        for (i = 0; i < nThreads; i++)
+        {
+            const int k = i % nodes.size();
+            out.push_back(nodes[k][used[k] % nodes[k].size()]);
+            used[k]++;
+        }
+    }
+    else
+    {
+        throw abseirError("unknown affinity policy.\n");
+    }
+    return(out);
+}
+
+bool pinCurrentThread(int cpu)
+{
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        return(false);
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    return(pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0);
+#else
+    return(false);
+#endif
+}
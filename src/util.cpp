@@ -1,55 +1,44 @@
-#include <iostream>
-#include <sstream>
-#include <random>
-#include <math.h>
-#include <Rmath.h>
-#include "SEIRSimNodes.hpp"
-#include "spatialSEIRModel.hpp"
 #include <util.hpp>
-#include <chrono>
-#include <thread>
-using namespace std;
 
 
-compartment_tap::compartment_tap(int nrow, int ncol)
+compartment_tap::compartment_tap(int lags, int nrow, int ncol)
 {
-    int i,j;
-    compartment = Eigen::MatrixXi(nrow, ncol);
-    for (i = 0; i < compartment.rows(); i++)
-    {
-        for (j = 0; j < compartment.cols(); j++)
-        {
-            //compartment(i,j) = -1;
-        }
-    }
+    int i;
     idx = 0;
     beenSet = std::vector<int>();
-    nLags = compartment.rows();
+    pressure = std::vector<Eigen::MatrixXd>();
+    nLags = lags;
     for (i = 0; i < nLags; i++)
     {
         beenSet.push_back(0);
+        pressure.push_back(Eigen::MatrixXd::Zero(nrow, ncol));
     }
 }
 
-void compartment_tap::push(Eigen::VectorXi newComp)
+void compartment_tap::reset()
 {
-    compartment.row(idx) = newComp.transpose();
+    idx = 0;
+    for (int i = 0; i < nLags; i++)
+    {
+        beenSet[i] = 0;
+    }
+}
+
+void compartment_tap::push(const Eigen::MatrixXd& newPressure)
+{
+    pressure[idx] = newPressure;
     beenSet[idx] = 1;
     idx += 1;
-    idx = (idx >= compartment.rows() ? 0 : idx);
+    idx = (idx >= nLags ? 0 : idx);
 }
 
-Eigen::VectorXi compartment_tap::get(int lag)
+const Eigen::MatrixXd& compartment_tap::get(int lag) const
 {
-    int proposed = idx - lag - 1; 
-    int itr = 0;
-    while (proposed < 0 && itr < 1e6){
-        proposed += nLags;
-        itr++;
-    }
+    int proposed = (idx - lag - 1) % nLags;
+    proposed = (proposed < 0 ? proposed + nLags : proposed);
     if (!beenSet[proposed])
     {
         // Error
     }
-    return(compartment.row(proposed));
+    return(pressure[proposed]);
 }
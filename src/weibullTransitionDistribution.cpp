@@ -21,6 +21,10 @@ weibullTransitionDistribution::weibullTransitionDistribution(
     scalePriorBeta  = priorParams(3);
     currentShape = 1.0;
     currentScale = 1.0;
+    // The fifth prior parameter, if present, is the number of bins tabulated
+    const int nBins = (priorParams.size() > 4 ? (int) priorParams(4) : 0);
+    transition_table = std::vector<double>(nBins, 0.0);
+    cumulative_hazard = std::vector<double>(nBins + 1, 0.0);
 }
 
 weibullTransitionDistribution::~weibullTransitionDistribution()
@@ -46,10 +50,21 @@ double weibullTransitionDistribution::getAvgMembership()
 }
 
 void weibullTransitionDistribution::setCurrentParams(
-                                                Eigen::VectorXd currentParams)
+                                        const Eigen::VectorXd& currentParams)
 {
     currentShape = currentParams(0);
     currentScale = currentParams(1);
+    const int nBins = (int) transition_table.size();
+    int k;
+    for (k = 0; k <= nBins; k++)
+    {
+        cumulative_hazard[k] = std::pow(k/currentScale, currentShape);
+    }
+    for (k = 0; k < nBins; k++)
+    {
+        transition_table[k] = 1.0 - std::exp(cumulative_hazard[k] 
+                                             - cumulative_hazard[k+1]);
+    }
 }
 
 